@@ -0,0 +1,86 @@
+/*Copyright 2012-2016 Joseph "Mitch" Davis mitchd@vt.edu
+ *
+ *This file is part of usrp-utils.
+ *
+ *   usrp-utils is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   usrp-utils is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with usrp-utils.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ *Frequency-subset output of the FFT programs (usrp-sensor and fftcompute).
+ *
+ *A selection lists output bins by their position in a full output frame
+ *(0 is the most negative frequency, fft_size/2 is DC), e.g. "1000:1199,4096".
+ *Only the selected bins are computed and written, in list order.
+ *
+ *When only a handful of bins is selected, a Goertzel filter per bin is
+ *cheaper than the FFT.  The choice is made once from rough operation counts:
+ *
+ *  FFT       __FFT_COST * N log2(N)
+ *  Goertzel  __GOERTZEL_COST * N * bins
+ *
+ *Both produce the same magnitudes (to float rounding).  A chirp-z transform
+ *never wins here: it needs FFTs longer than N to produce N-point DFT bins.
+ */
+#ifndef BIN_SELECTION_H_INCLUDED
+#define BIN_SELECTION_H_INCLUDED
+
+//Operations per point and stage of FFTW's vectorized butterflies, and per
+//point and bin of the (double precision, complex input) Goertzel recursion
+#define __FFT_COST            2.5
+#define __GOERTZEL_COST       8.0
+
+struct bin_selection
+{
+    int       count;          //selected bins
+    int*      bins;           //FFT bin of every output, in output order
+    bool      goertzel;       //compute with Goertzel filters, not the FFT
+
+    double*   coeff;          //2 cos(w) of every output (Goertzel only)
+    double*   cosw;           //cos(w) of every output (Goertzel only)
+    double*   sinw;           //sin(w) of every output (Goertzel only)
+};
+
+/*parseBinSelection( const char*, int, bin_selection& )
+ *
+ *Translates a comma separated list of output bins and first:last ranges into
+ *a selection for fftSize-point transforms, and picks FFT or Goertzel with
+ *the cost model.  Returns 0 on a malformed list or a bin outside the frame.
+ *Free with destroyBinSelection.
+ */
+int parseBinSelection( const char* list, int fftSize, bin_selection& selection );
+
+/*destroyBinSelection( bin_selection& )
+ *
+ *Frees the selection arrays
+ */
+void destroyBinSelection( bin_selection& selection );
+
+/*selectBins( const bin_selection&, const float*, float* )
+ *
+ *Gathers the magnitudes of the selected bins from a full fftSize-point FFT
+ *output (interleaved complex floats)
+ */
+void selectBins( const bin_selection& selection, const float* spectrum,
+                 float* magnitude );
+
+/*goertzelBins( const bin_selection&, const float*, int, float* )
+ *
+ *Computes the magnitudes of the selected bins straight from fftSize
+ *(windowed) interleaved complex float samples
+ */
+void goertzelBins( const bin_selection& selection, const float* iq,
+                   int fftSize, float* magnitude );
+
+
+#endif // BIN_SELECTION_H_INCLUDED
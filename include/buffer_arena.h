@@ -0,0 +1,88 @@
+/*Copyright 2012-2016 Joseph "Mitch" Davis mitchd@vt.edu
+ *
+ *This file is part of usrp-utils.
+ *
+ *   usrp-utils is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   usrp-utils is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with usrp-utils.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ *
+ *Buffer arena of the usrp-sensor streaming buffers (and of the resampler
+ *ring of usrp-recorder).
+ *
+ *Every buffer the receive loop and the workers touch while streaming (the
+ *input rings, the FFT buffers of every planned size, the PFB frames and the
+ *magnitude scratch of the workers) is carved out of one mapping that is
+ *reserved before streaming starts.  The mapping is backed by 1 GB or 2 MB
+ *huge pages when the system has them reserved (vm.nr_hugepages), or by
+ *normal pages with transparent huge pages requested otherwise.
+ *
+ *Slices are cache line aligned and zeroed as they are carved, which faults
+ *their pages in.  A thread that carves a slice while running on a worker's
+ *cpu therefore places it on that worker's NUMA node (see cpu_affinity.h);
+ *with huge pages the whole page goes to the node of the slice that touches
+ *it first.  lockMemory then keeps every page resident, so a steady-state
+ *run allocates nothing and takes no page faults.
+ */
+#ifndef BUFFER_ARENA_H_INCLUDED
+#define BUFFER_ARENA_H_INCLUDED
+
+#include <stddef.h>
+
+//Alignment of every slice: one cache line
+#define __ARENA_ALIGNMENT   64
+
+struct buffer_arena
+{
+    char*     base;       //the mapping (NULL when closed)
+    size_t    size;       //bytes mapped
+    size_t    used;       //bytes carved out so far
+    size_t    pageSize;   //huge page size backing it (0: normal pages)
+};
+
+/*arenaBytes( size_t )
+ *
+ *Room a slice of bytes takes in an arena, for sizing one up front
+ */
+size_t arenaBytes( size_t bytes );
+
+/*openArena( buffer_arena&, size_t )
+ *
+ *Maps an arena of at least bytes, on the largest huge pages available.
+ *Returns 0 if the memory cannot be mapped.
+ */
+int openArena( buffer_arena& arena, size_t bytes );
+
+/*arenaAlloc( buffer_arena&, size_t )
+ *
+ *Carves a zeroed, aligned slice of bytes out of arena.  Returns NULL when
+ *the arena is full.
+ */
+void* arenaAlloc( buffer_arena& arena, size_t bytes );
+
+/*closeArena( buffer_arena& )
+ *
+ *Unmaps the arena and every slice carved out of it
+ */
+void closeArena( buffer_arena& arena );
+
+/*lockMemory()
+ *
+ *mlockall: keeps the pages mapped now and later resident.  Needs
+ *CAP_IPC_LOCK or a large enough memlock limit.  Returns 0 on failure.
+ */
+int lockMemory();
+
+
+#endif // BUFFER_ARENA_H_INCLUDED
@@ -0,0 +1,107 @@
+/*Copyright 2012-2016 Joseph "Mitch" Davis mitchd@vt.edu
+ *
+ *This file is part of usrp-utils.
+ *
+ *   usrp-utils is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   usrp-utils is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with usrp-utils.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ *Energy-threshold burst detector.  Used in the usrp-energy and
+ *energycalculator programs.
+ *
+ *The detector watches a stream of energy values (bins or sliding windows)
+ *and writes one text line per event instead of the energy itself:
+ *
+ *  start <sample> <energy> <noise floor>
+ *  stop  <sample> <peak sample> <peak energy>
+ *
+ *Sample numbers count from the first sample of the stream.  A start gives
+ *the first sample of the output that crossed the threshold, a stop the last
+ *sample of the final output of the burst and the first sample of its peak
+ *output.
+ *
+ *The noise floor is the mean of the first timeConstant outputs and after
+ *that an exponential average with the same time constant.  It is only
+ *updated outside of bursts.  A burst starts when an output rises threshold
+ *dB above the floor and stops when it falls below (threshold - hysteresis)
+ *dB above the floor.  While the floor is zero (silent input) nothing is
+ *detected, since no burst could ever stop.
+ */
+#ifndef BURST_DETECTOR_H_INCLUDED
+#define BURST_DETECTOR_H_INCLUDED
+
+#include <stdio.h>
+
+struct burst_detector
+{
+    double                  start_ratio;  //start threshold over the floor
+    double                  stop_ratio;   //stop threshold over the floor
+    int                     time_constant;//noise floor time constant, outputs
+    int                     stride;       //samples between outputs
+    int                     span;         //samples covered by one output
+
+    double                  floor;        //noise floor estimate
+    unsigned long long int  outputs;      //energy outputs seen
+    unsigned long long int  skipped;      //stream samples skipped (see
+                                          //skipBurstDetector)
+
+    bool                    in_burst;     //currently inside a burst
+    unsigned long long int  peak_output;  //output index of the burst peak
+    double                  peak;         //burst peak energy
+    unsigned long long int  events;       //events written
+
+    FILE*                   eventsFile;
+};
+
+/*initializeBurstDetector( burst_detector&, const char*, double, double, int,
+ *                         int, int )
+ *
+ *Opens the events file and sets up the detector.  threshold and hysteresis
+ *are in dB, stride and span describe the energy outputs in samples (both are
+ *the bin size for binned energy, hop and window for sliding energy).  Returns
+ *0 if the file cannot be opened.
+ */
+int initializeBurstDetector( burst_detector& detector,
+                             const char*     eventsFileName,
+                             double          threshold,
+                             double          hysteresis,
+                             int             timeConstant,
+                             int             stride,
+                             int             span );
+
+/*pushBurstDetector( burst_detector&, const double*, int )
+ *
+ *Runs count energy outputs through the detector, writing any events.
+ *Returns 0 on a write error.
+ */
+int pushBurstDetector( burst_detector& detector, const double* energy,
+                       int count );
+
+/*skipBurstDetector( burst_detector&, unsigned long long )
+ *
+ *Accounts for samples stream samples that produced no output (e.g. a short
+ *buffer after an overflow), so the sample numbers of later events stay
+ *right.  A burst in progress ends at the last output before the gap.
+ *Returns 0 on a write error.
+ */
+int skipBurstDetector( burst_detector& detector, unsigned long long samples );
+
+/*closeBurstDetector( burst_detector& )
+ *
+ *Ends a burst still in progress and closes the events file
+ */
+void closeBurstDetector( burst_detector& detector );
+
+
+#endif // BURST_DETECTOR_H_INCLUDED
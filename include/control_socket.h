@@ -0,0 +1,87 @@
+/*Copyright 2012-2016 Joseph "Mitch" Davis mitchd@vt.edu
+ *
+ *This file is part of usrp-utils.
+ *
+ *   usrp-utils is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   usrp-utils is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with usrp-utils.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ *Control socket of the usrp-sensor daemon mode.
+ *
+ *The program listens on a Unix stream socket (a file system path, e.g.
+ *"/tmp/usrp_sensor.sock") for text commands, one per line, and answers every
+ *command with a single line that starts with "ok" or "error".  A client may
+ *send any number of commands over one connection, e.g. with
+ *`socat - UNIX-CONNECT:/tmp/usrp_sensor.sock`.  One client is served at a
+ *time; the next one is accepted when it disconnects.
+ *
+ *A thread of its own does all the socket I/O.  It hands every command to the
+ *program through the pending flag and waits for the answer, so the receive
+ *loop only tests that flag once per buffer and applies the command between
+ *two buffers, without ever blocking on a client.
+ */
+#ifndef CONTROL_SOCKET_H_INCLUDED
+#define CONTROL_SOCKET_H_INCLUDED
+
+#include <pthread.h>
+
+//Longest command or answer, terminating zero included
+#define __CONTROL_LINE_LENGTH   256
+
+//Milliseconds between checks of the stop flag while the thread is idle
+#define __CONTROL_POLL_MS       100
+
+struct control_socket
+{
+    int               listener;   //listening socket
+    char*             path;       //socket file, removed on close
+    pthread_t         thread;     //serves the clients
+    pthread_mutex_t   mutex;      //guards command, reply and the flags
+    pthread_cond_t    answered;   //signalled by replyControl and on close
+    char              command[__CONTROL_LINE_LENGTH]; //pending command line
+    char              reply[__CONTROL_LINE_LENGTH];   //its answer
+    volatile bool     pending;    //a command waits for the program
+    volatile bool     stop;       //the thread is asked to exit
+};
+
+/*openControlSocket( control_socket&, const char* )
+ *
+ *Creates the socket at path (replacing a stale socket file) and starts the
+ *thread that serves it.  Returns 0 on failure.  Close with
+ *closeControlSocket.
+ */
+int openControlSocket( control_socket& control, const char* path );
+
+/*pendingControl( control_socket& )
+ *
+ *The command line waiting for an answer, without the newline, or NULL if
+ *there is none.  Cheap enough to call once per receive buffer.
+ */
+const char* pendingControl( control_socket& control );
+
+/*replyControl( control_socket&, const char* )
+ *
+ *Answers the pending command with reply (one line, no newline)
+ */
+void replyControl( control_socket& control, const char* reply );
+
+/*closeControlSocket( control_socket& )
+ *
+ *Stops the thread, drops the client and removes the socket file.  A command
+ *that was never answered gets "error shutting down".
+ */
+void closeControlSocket( control_socket& control );
+
+
+#endif // CONTROL_SOCKET_H_INCLUDED
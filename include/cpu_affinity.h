@@ -0,0 +1,118 @@
+/*Copyright 2012-2016 Joseph "Mitch" Davis mitchd@vt.edu
+ *
+ *This file is part of usrp-utils.
+ *
+ *   usrp-utils is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   usrp-utils is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with usrp-utils.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ *
+ *CPU placement of the usrp-sensor threads.
+ *
+ *A plan pins the receive thread (the parent, which runs the recv loop and
+ *assembles the frames) to one cpu and the workers to a list of cpus, one
+ *cpu per worker in turn.  "auto" takes the cpus of the NUMA node of the
+ *NIC: the first one for the receive thread and the rest for the workers.
+ *An explicit plan is "[recv cpu]:[worker cpu list]", e.g. "2:4-7,12".
+ *
+ *Memory is placed the way Linux places it by default: on the node of the
+ *thread that touches a page first.  The owner of a buffer therefore
+ *allocates and first writes it while running on the cpu of the thread that
+ *will use it (see placeThread), which needs no NUMA library.
+ *
+ *The workers may also run under a realtime policy ("fifo:[priority]" or
+ *"rr:[priority]").  That needs CAP_SYS_NICE (or an rtprio limit); without
+ *it the workers fall back to the normal policy with a warning.  A worker
+ *busy-waits for its turn to write, and a realtime thread that spins never
+ *yields its cpu, so realtime workers must each have a cpu of their own
+ *(see realtimeFits).
+ */
+#ifndef CPU_AFFINITY_H_INCLUDED
+#define CPU_AFFINITY_H_INCLUDED
+
+#include <pthread.h>
+#include <sched.h>
+#include <vector>
+
+struct cpu_plan
+{
+    int               recvCpu;      //cpu of the receive thread (-1: any)
+    std::vector<int>  workerCpus;   //cpus of the workers, handed out in turn
+                                    //(empty: any)
+    int               node;         //NUMA node picked by "auto" (-1: none)
+    int               policy;       //scheduling policy of the workers
+    int               priority;     //and their priority (0 for SCHED_OTHER)
+    cpu_set_t         allowed;      //cpus the process started with
+};
+
+/*initializeCpuPlan( cpu_plan& )
+ *
+ *An empty plan: nothing pinned, normal scheduling
+ */
+void initializeCpuPlan( cpu_plan& plan );
+
+/*parseCpuList( const char*, std::vector<int>& )
+ *
+ *Parses a comma separated list of cpus and first-last ranges, the format of
+ *the sysfs cpulist files.  Returns 0 on a malformed or empty list.
+ */
+int parseCpuList( const char* list, std::vector<int>& cpus );
+
+/*parseCpuPlan( const char*, cpu_plan& )
+ *
+ *Fills the cpus of plan from "auto", "auto:[interface]" (the node of that
+ *network interface instead of node 0) or "[recv cpu]:[worker cpu list]".
+ *Cpus the process may not run on are left out.  Returns 0 if the spec is
+ *malformed or leaves no cpu.
+ */
+int parseCpuPlan( const char* spec, cpu_plan& plan );
+
+/*parseSchedPolicy( const char*, cpu_plan& )
+ *
+ *Sets the worker policy from "fifo:[priority]", "rr:[priority]" or "other".
+ *Returns 0 on anything else or a priority out of range.
+ */
+int parseSchedPolicy( const char* spec, cpu_plan& plan );
+
+/*workerCpu( const cpu_plan&, int )
+ *
+ *The cpu of worker worker, or -1 if the workers are not pinned
+ */
+int workerCpu( const cpu_plan& plan, int worker );
+
+/*realtimeFits( const cpu_plan&, int )
+ *
+ *Whether workers workers can run under the plan's policy: always under
+ *SCHED_OTHER, and under a realtime policy only if each of them is pinned to
+ *a cpu of its own that is not the receive cpu.  Returns 0 otherwise.
+ */
+int realtimeFits( const cpu_plan& plan, int workers );
+
+/*placeThread( const cpu_plan&, int )
+ *
+ *Moves the calling thread to cpu, or back to every allowed cpu if cpu is
+ *negative.  Returns 0 on failure.
+ */
+int placeThread( const cpu_plan& plan, int cpu );
+
+/*createWorker( pthread_t&, const cpu_plan&, int, void*(*)(void*), void* )
+ *
+ *pthread_create for worker worker, started on its cpu under the plan's
+ *policy.  Returns the pthread_create error code (0 on success).
+ */
+int createWorker( pthread_t& thread, const cpu_plan& plan, int worker,
+                  void* (*start)( void* ), void* arg );
+
+
+#endif // CPU_AFFINITY_H_INCLUDED
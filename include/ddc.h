@@ -0,0 +1,165 @@
+/*Copyright 2012-2016 Joseph "Mitch" Davis mitchd@vt.edu
+ *
+ *This file is part of usrp-utils.
+ *
+ *   usrp-utils is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   usrp-utils is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with usrp-utils.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ *Digital down-converter (DDC) of usrp-sensor.
+ *
+ *A DDC channel cuts a narrowband channel out of the wideband stream: an NCO
+ *mixes the channel's offset from the center frequency down to DC, then the
+ *stream is decimated in stages.  Every factor of 2 in the decimation is a
+ *half-band stage, which only needs every other tap, and what is left over
+ *(an odd factor) is one windowed-sinc FIR stage at the lowest rate.  Both
+ *the mixing and the filters run on AVX when it is available.
+ *
+ *The same FIR kernel drives the rational resampler of usrp-recorder, which
+ *changes the rate by interpolation/decimation in one polyphase filter: the
+ *prototype is split into interpolation branches, and each output sample is
+ *the dot product of one branch with the newest input samples, so the
+ *upsampled stream is never formed.
+ */
+#ifndef DDC_H_INCLUDED
+#define DDC_H_INCLUDED
+
+//Nonzero taps on one side of a half-band filter (the filter has
+//4*__DDC_HALFBAND_PAIRS - 1 taps)
+#define __DDC_HALFBAND_PAIRS    8
+
+//Taps per output sample of the final FIR stage
+#define __DDC_FIR_TAPS          16
+
+//Samples mixed per NCO phase update
+#define __DDC_NCO_BLOCK         64
+
+//Taps per polyphase branch of the resampler
+#define __RESAMPLER_TAPS        32
+
+//Largest interpolation or decimation of a resampler
+#define __RESAMPLER_MAX_FACTOR  512
+
+//Largest relative error of the resampled rate
+#define __RESAMPLER_TOLERANCE   1e-9
+
+struct ddc_stage
+{
+    int       factor;         //decimation (2 for a half-band stage)
+    int       taps;           //taps of each dot product
+    float*    taps2;          //taps in reverse order, duplicated for I and Q
+    int       history;        //input samples carried over between calls
+    float*    buffer;         //history, then the new input (even samples
+    //only in a half-band stage)
+    float*    odd;            //half-band only: odd sample history and input
+};
+
+struct ddc_channel
+{
+    int         decimation;   //total decimation
+    int         stageCount;   //filter stages
+    ddc_stage*  stages;
+
+    double      phase;        //NCO phase of the next sample (radians)
+    double      step;         //NCO phase step per sample (radians)
+    float*      table;        //e^(-j step k) for k < __DDC_NCO_BLOCK
+
+    int         maxSamples;   //largest input of one ddcProcess call
+    float*      work;         //mixer output and the output of every stage
+
+    double      delay;        //group delay of the filters, in input samples
+};
+
+struct resampler
+{
+    int         interpolation;  //L of the L/M rate change
+    int         decimation;     //M of the L/M rate change
+    int         taps;           //taps of each branch
+    float*      branches;       //the taps2 (see ddc_stage) of each branch
+    int         history;        //input samples carried over between calls
+    float*      buffer;         //history, then the new input
+    int         maxSamples;     //largest input of one resample call
+    int         phase;          //branch of the next output
+    int         position;       //newest input of the next output, counted
+    //from the first sample of the next call
+    double      delay;          //group delay of the filter, in input samples
+};
+
+/*initializeDdc( ddc_channel&, double, double, int, int )
+ *
+ *Sets up a channel offset Hz from the center of a stream of rate samples
+ *per second, decimated by decimation.  Every ddcProcess call may pass up to
+ *maxSamples samples.  Output sample n is the input around sample
+ *n*decimation - delay.  Returns 0 if decimation < 1 or the offset lies
+ *outside the stream.  Free with destroyDdc.
+ */
+int initializeDdc( ddc_channel& ddc, double offset, double rate,
+                   int decimation, int maxSamples );
+
+/*destroyDdc( ddc_channel& )
+ *
+ *Frees the buffers of a channel
+ */
+void destroyDdc( ddc_channel& ddc );
+
+/*ddcProcess( ddc_channel&, const float*, int, float* )
+ *
+ *Down-converts samples interleaved complex samples (a multiple of the
+ *decimation) and writes samples/decimation samples to output.  The filter
+ *state carries over, so consecutive calls process one continuous stream.
+ *Returns the number of output samples.
+ */
+int ddcProcess( ddc_channel& ddc, const float* iq, int samples, float* output );
+
+/*rationalFactors( double, double, int&, int& )
+ *
+ *The smallest interpolation/decimation that turns inputRate into outputRate
+ *within __RESAMPLER_TOLERANCE, from the continued fraction of their ratio.
+ *Returns 0 if either factor would exceed __RESAMPLER_MAX_FACTOR.
+ */
+int rationalFactors( double inputRate, double outputRate, int& interpolation,
+                     int& decimation );
+
+/*initializeResampler( resampler&, int, int, int )
+ *
+ *Sets up a resampler by interpolation/decimation (reduced to lowest terms)
+ *whose lowpass passes the lower of the two Nyquist frequencies.  Every
+ *resample call may pass up to maxSamples samples.  Returns 0 for a factor
+ *below 1.  Free with destroyResampler.
+ */
+int initializeResampler( resampler& rs, int interpolation, int decimation,
+                         int maxSamples );
+
+/*destroyResampler( resampler& )
+ *
+ *Frees the buffers of a resampler
+ */
+void destroyResampler( resampler& rs );
+
+/*resamplerOutputs( const resampler&, int )
+ *
+ *Room for the output of one resample call of samples samples
+ */
+int resamplerOutputs( const resampler& rs, int samples );
+
+/*resample( resampler&, const float*, int, float* )
+ *
+ *Resamples samples interleaved complex samples into output and returns the
+ *number of output samples.  The filter state and the phase carry over, so
+ *consecutive calls process one continuous stream.
+ */
+int resample( resampler& rs, const float* iq, int samples, float* output );
+
+
+#endif // DDC_H_INCLUDED
@@ -0,0 +1,139 @@
+/*Copyright 2012-2016 Joseph "Mitch" Davis mitchd@vt.edu
+ *
+ *This file is part of usrp-utils.
+ *
+ *   usrp-utils is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   usrp-utils is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with usrp-utils.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ *Vectorized sample processing kernels shared by the usrp-utils programs.
+ *The SIMD paths are selected at compile time from the -march=native flags;
+ *every kernel has a scalar fallback that produces the same results.
+ */
+#ifndef DSP_KERNELS_H_INCLUDED
+#define DSP_KERNELS_H_INCLUDED
+
+#include <stdint.h>
+
+/*sample_format
+ *
+ *Interleaved I-Q sample formats understood by the kernels.  These match the
+ *UHD host formats of the same name.  Integer formats are scaled to the
+ *range used by fc32 with UHD's own factors (1/32767 and 1/127), so a stream
+ *has the same magnitudes in every host format.
+ */
+enum sample_format
+{
+    SAMPLE_FC32,                      //2 x 32-bit float
+    SAMPLE_SC16,                      //2 x 16-bit signed integer
+    SAMPLE_SC8                        //2 x 8-bit signed integer
+};
+
+/*parseSampleFormat( const char*, sample_format& )
+ *
+ *Translates "fc32", "sc16" or "sc8" into a sample_format.  Returns 0 if the
+ *name is not recognized.
+ */
+int parseSampleFormat( const char* name, sample_format& format );
+
+/*sampleFormatName( sample_format )
+ *
+ *The UHD name of format ("fc32", "sc16" or "sc8")
+ */
+const char* sampleFormatName( sample_format format );
+
+/*sampleFormatSize( sample_format )
+ *
+ *Number of bytes in one complex sample of the given format
+ */
+int sampleFormatSize( sample_format format );
+
+/*sampleFormatScale( sample_format )
+ *
+ *Factor that converts a raw sample component to its fc32 equivalent
+ */
+float sampleFormatScale( sample_format format );
+
+/*interleaveWindow( const float*, int, float )
+ *
+ *Builds a 2*size window with every coefficient duplicated for the I and Q
+ *components and multiplied by scale.  The caller owns the returned array
+ *(delete []).
+ */
+float* interleaveWindow( const float* window, int size, float scale );
+
+/*convertWindow( sample_format, const void*, const float*, float*, int )
+ *
+ *Converts samples raw samples to complex float and applies the interleaved
+ *window (see interleaveWindow) in a single pass:
+ *
+ *  output[k] = raw[k] * window2[k]     for k < 2*samples
+ */
+void convertWindow( sample_format format, const void* input,
+                    const float* window2, float* output, int samples );
+
+/*convertSamples( sample_format, const void*, float*, int )
+ *
+ *Converts samples raw samples to complex float in fc32 units (a plain copy
+ *for fc32).  Lets the receive loops take integer samples from UHD and
+ *convert them in the same pass that moves them into their own buffers.
+ */
+void convertSamples( sample_format format, const void* input, float* output,
+                     int samples );
+
+/*energy_fc32( const float*, int )
+ *
+ *Returns the energy (sum of I^2 + Q^2) of samples interleaved complex float
+ *samples.  The squares are formed in double precision and accumulated in
+ *sample order, so the result is bit-identical to a scalar double loop.
+ */
+double energy_fc32( const float* iq, int samples );
+
+/*energy_sc16( const int16_t*, int ) / energy_sc8( const int8_t*, int )
+ *
+ *Integer versions of energy_fc32.  The sum is exact in 64-bit integers and
+ *scaled to fc32 units at the end.
+ */
+double energy_sc16( const int16_t* iq, int samples );
+double energy_sc8( const int8_t* iq, int samples );
+
+/*energy( sample_format, const void*, int )
+ *
+ *Dispatches to the energy kernel for format
+ */
+double energy( sample_format format, const void* iq, int samples );
+
+/*samplePower( sample_format, const void*, double*, int )
+ *
+ *Writes the power (I^2 + Q^2, in fc32 units) of each of samples samples to
+ *power
+ */
+void samplePower( sample_format format, const void* iq, double* power,
+                  int samples );
+
+/*quantizeDb( const float*, void*, int, int, float, float )
+ *
+ *Converts count FFT magnitudes to dB (20 log10) and quantizes them to
+ *unsigned codes of bits bits (8 or 16):
+ *
+ *  code[k] = clamp( round( (dB(magnitude[k]) - reference)/step ), 0, 2^bits-1 )
+ *
+ *The logarithm is a polynomial on the float mantissa plus the exponent,
+ *accurate to 2e-5 dB, so zero magnitudes land on code 0.
+ */
+void quantizeDb( const float* magnitude, void* codes, int count, int bits,
+                 float reference, float step );
+
+
+#endif // DSP_KERNELS_H_INCLUDED
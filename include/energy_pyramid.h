@@ -0,0 +1,73 @@
+/*Copyright 2012-2016 Joseph "Mitch" Davis mitchd@vt.edu
+ *
+ *This file is part of usrp-utils.
+ *
+ *   usrp-utils is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   usrp-utils is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with usrp-utils.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ *Multi-resolution energy output.  Used in the usrp-energy and
+ *energycalculator programs.
+ *
+ *Level 0 is the stream of energy bins computed by the program.  Every factor
+ *consecutive bins of level n are summed into one bin of level n+1, so level n
+ *has a bin size of (bin size)*factor^n samples.  Level 0 is written to the
+ *output file itself and level n to "<output file>.L<n>".
+ */
+#ifndef ENERGY_PYRAMID_H_INCLUDED
+#define ENERGY_PYRAMID_H_INCLUDED
+
+#include <stdio.h>
+
+struct energy_pyramid
+{
+    int       levels;         //number of levels, including level 0
+    int       factor;         //level n bins summed into one level n+1 bin
+    bool      write_double;   //write doubles (true) or floats (false)
+
+    FILE**    outputFiles;    //one output file per level
+    double*   sums;           //partial sum of the current bin, per level
+    int*      counts;         //bins accumulated into sums, per level
+};
+
+/*initializePyramid( energy_pyramid&, const char*, int, int, bool )
+ *
+ *Opens the output files for every level (see openOutputStream, so level 0
+ *of "-" is standard output).  Returns 0 if a file cannot be opened (any
+ *files already opened are closed again).  A NULL outputFileName
+ *gives an empty pyramid that discards every bin, for callers that only want
+ *the bins for something else (e.g. burst detection).
+ */
+int initializePyramid( energy_pyramid& pyramid,
+                       const char*     outputFileName,
+                       int             levels,
+                       int             factor,
+                       bool            write_double );
+
+/*pushPyramid( energy_pyramid&, const double*, int )
+ *
+ *Writes count level 0 bins and folds them into the coarser levels.  Returns
+ *0 on a write error.
+ */
+int pushPyramid( energy_pyramid& pyramid, const double* energy, int count );
+
+/*closePyramid( energy_pyramid& )
+ *
+ *Closes all the output files and frees the pyramid.  Incomplete coarse bins
+ *are tossed out, just like an incomplete level 0 bin.
+ */
+void closePyramid( energy_pyramid& pyramid );
+
+
+#endif // ENERGY_PYRAMID_H_INCLUDED
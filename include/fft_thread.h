@@ -30,6 +30,11 @@
 #include <iostream>
 #include <mqueue.h>
 
+#include "spectrum_format.h"
+#include "bin_selection.h"
+#include "polyphase.h"
+#include "spectrum_shm.h"
+
 
 #define __FFT_THREAD_START       1
 #define __FFT_THREAD_KILL        2
@@ -38,7 +43,9 @@
 
 struct fft_thread_data
 {
-    FILE*             outputFile;     //File to output the FFT results
+    FILE*             outputFile;     //File to output the FFT results (may
+    //be switched by the parent between frames, e.g. one file per channel;
+    //NULL while the output is stopped)
 
     fftwf_plan        plan;           //fftw3 fft plan
 
@@ -48,14 +55,47 @@ struct fft_thread_data
     _Complex float*    inputData;      //fft input data (depending on the fft plan,
     //these data may get destroyed)
 
-    float*            window;         //window function
+    float*            window;         //window function, or the fft_size*taps
+    //PFB prototype (NULL if the frame is windowed before it is handed to the
+    //thread)
+
+    int               taps;           //PFB taps per channel (1 for a plain
+    //windowed FFT)
+
+    _Complex float*   frameData;      //frame handed to the thread:
+    //fft_size*taps samples that are folded into inputData (see polyphase.h),
+    //or inputData itself when taps is 1
 
     pthread_mutex_t*  output_mutex;   //Output file mutex
 
-    int               fft_size;       //FFT Size
+    int               fft_size;       //FFT Size (may be switched by the
+    //parent between frames, along with plan, inputData, outputData,
+    //frameData and window)
     volatile bool     is_running;     //Signal that the thread is busy
     char*             mq_name;        //mqueue name
 
+    float*            accumulator;    //when not NULL, the magnitude is added
+    //to these fft_size floats (negative freqs first) instead of written to
+    //outputFile.  Used to average the frames of a sweep step.
+
+    volatile int*     pending;        //frames handed out for accumulator and
+    //not summed yet.  Decremented under output_mutex.
+
+    spectrum_format   format;         //format of the frames written to
+    //outputFile (float magnitude or quantized dB)
+
+    spectrum_shm*     shm;            //live feed that also gets every frame
+    //written to outputFile (NULL for none).  Switched along with outputFile.
+
+    const bin_selection* bins;        //bins to compute and write, in output
+    //order (NULL for the whole frame).  accumulator then holds
+    //bins->count floats.
+
+    float*            magnitude;      //scratch of the largest fft_size the
+    //parent may switch to, along with codes (two bytes per bin).  NULL if
+    //the thread allocates (and grows) its own.
+    unsigned char*    codes;
+
     int               my_id;          //child thread id number
     volatile int*     next_thread;    //next thread id to execute
     int               max_children;   //maximum number of child processes
@@ -0,0 +1,98 @@
+/*Copyright 2012-2016 Joseph "Mitch" Davis mitchd@vt.edu
+ *
+ *This file is part of usrp-utils.
+ *
+ *   usrp-utils is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   usrp-utils is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with usrp-utils.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ *
+ *Overload policy of the usrp-sensor workers.
+ *
+ *Once every worker is busy the receive loop has nowhere to put the next
+ *frame.  Waiting for a worker (the "block" policy) stops taking samples off
+ *the receive ring, which fills up (or the device overflows) and loses
+ *samples at an unpredictable point of the stream.  The other policies never
+ *wait: they shed frames instead, so the sample stream stays gap-free and
+ *only the frame rate degrades.
+ *
+ *  drop          The frames of an interval (one per channel) are dropped
+ *                when a worker they need is still busy.
+ *  overlap       The loop hands out frames at only every factor-th frame
+ *                interval, i.e. at a lower overlap.  The factor doubles
+ *                while the workers are loaded and halves again once they
+ *                catch up.  It stops at the FFT overlap (frames that just
+ *                touch), so every sample still reaches a frame; past that
+ *                frames are dropped.
+ *  decimate:[n]  Like overlap, but the factor goes up to n, which may leave
+ *                samples between the frames.
+ *
+ *The load is the share of busy workers when a frame is due: the factor
+ *doubles at 3/4 or more and halves at 1/4 or less.  Shed and dropped frame
+ *intervals (one frame of every channel each) are counted; they also show as
+ *gaps in the sample numbers of the frame time stamps (-I).
+ */
+#ifndef OVERLOAD_POLICY_H_INCLUDED
+#define OVERLOAD_POLICY_H_INCLUDED
+
+enum overload_mode
+{
+    OVERLOAD_BLOCK,
+    OVERLOAD_DROP,
+    OVERLOAD_OVERLAP,
+    OVERLOAD_DECIMATE
+};
+
+struct overload_policy
+{
+    overload_mode       mode;
+    int                 limit;      //largest factor of decimate
+    int                 maxFactor;  //largest factor of this run
+    int                 factor;     //frames go out every factor-th interval
+    int                 phase;      //intervals since the last one handed out
+    int                 peakFactor; //largest factor reached
+    unsigned long long  shed;       //intervals skipped by the factor
+    unsigned long long  dropped;    //intervals dropped on a busy worker
+};
+
+/*parseOverloadPolicy( const char*, overload_policy& )
+ *
+ *Sets the mode from "block", "drop", "overlap" or "decimate:[n]".  Returns 0
+ *on anything else or a factor below 2.
+ */
+int parseOverloadPolicy( const char* spec, overload_policy& policy );
+
+/*resetOverload( overload_policy&, int )
+ *
+ *Starts a run at full rate with FFT overlap overlap, counters cleared.
+ *Call it before the first frameDue.
+ */
+void resetOverload( overload_policy& policy, int overlap );
+
+/*frameDue( overload_policy&, int, int )
+ *
+ *Called at every frame interval with the number of busy workers out of
+ *workers.  Returns 1 if the frames of this interval are to be handed out,
+ *0 if they are shed.  Adjusts the factor on the intervals that go out.
+ */
+int frameDue( overload_policy& policy, int busy, int workers );
+
+/*overloadName( const overload_policy& )
+ *
+ *The policy as -W takes it (without the decimate factor)
+ */
+const char* overloadName( const overload_policy& policy );
+
+
+#endif // OVERLOAD_POLICY_H_INCLUDED
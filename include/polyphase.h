@@ -0,0 +1,56 @@
+/*Copyright 2012-2016 Joseph "Mitch" Davis mitchd@vt.edu
+ *
+ *This file is part of usrp-utils.
+ *
+ *   usrp-utils is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   usrp-utils is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with usrp-utils.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ *Polyphase filter bank (PFB) channelizer front end of the FFT programs
+ *(usrp-sensor and fftcompute).
+ *
+ *A critically sampled PFB with N channels and T taps per channel feeds the
+ *N-point FFT with the sum of T consecutive N-sample blocks, each weighted by
+ *its part of an N*T-point lowpass prototype:
+ *
+ *  y[n] = sum over t of x[n + t*N] * h[n + t*N]      for n < N
+ *
+ *Consecutive frames are N samples apart (hop N, "-l 1").  Compared to a
+ *windowed FFT every channel gets a flat passband and a steep cutoff at the
+ *neighbouring channels, which removes most of the scalloping and leakage for
+ *about T*N extra multiply-adds per frame.
+ */
+#ifndef POLYPHASE_H_INCLUDED
+#define POLYPHASE_H_INCLUDED
+
+/*pfbPrototype( int, int )
+ *
+ *Designs the N*T-point prototype of an N-channel, T-tap filter bank: a
+ *Hamming windowed sinc with its first zeros at the neighbouring channel
+ *centres, scaled to a DC gain of N so magnitudes match a uniform window.
+ *The caller owns the returned array (delete []).
+ */
+float* pfbPrototype( int channels, int taps );
+
+/*pfbFold( const float*, const float*, int, int, float* )
+ *
+ *Folds channels*taps interleaved complex samples into one channels-point
+ *FFT input (see above).  A NULL prototype sums the blocks unweighted, for
+ *frames that were already weighted while they were assembled.
+ */
+void pfbFold( const float* iq, const float* prototype, int channels,
+              int taps, float* output );
+
+
+#endif // POLYPHASE_H_INCLUDED
@@ -0,0 +1,140 @@
+/*Copyright 2012-2016 Joseph "Mitch" Davis mitchd@vt.edu
+ *
+ *This file is part of usrp-utils.
+ *
+ *   usrp-utils is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   usrp-utils is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with usrp-utils.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ *
+ *Sample ring between the receive thread and the rest of usrp-sensor (or the
+ *resampler of usrp-recorder).
+ *
+ *The receive thread does nothing but recv into the next free block of the
+ *ring and publish it, so a stall anywhere else (frame assembly, a daemon
+ *command, a busy worker) delays nothing but the reader of the ring.  A ring
+ *of a fraction of a second of samples absorbs such hiccups; the device only
+ *overflows once the whole ring is full.
+ *
+ *The ring has one writer and one reader and takes no lock: block n lives
+ *in slot n % slots, written counts the published blocks and released the
+ *blocks the reader has handed back.  Each counter is written by one side
+ *only (release) and read by the other (acquire).  The reader may keep the
+ *newest blocks it still needs (e.g. the blocks of the next frame) by
+ *releasing only the older ones.
+ *
+ *A writer that finds the ring full receives into a spare buffer, which is
+ *lost, and marks the next block it publishes as following a gap.  Besides
+ *the received data each block may carry buffers of the reader's own
+ *(derived), e.g. for samples it computes from the received ones.
+ */
+#ifndef SAMPLE_RING_H_INCLUDED
+#define SAMPLE_RING_H_INCLUDED
+
+#include <stddef.h>
+#include <semaphore.h>
+
+#include "buffer_arena.h"
+
+//Seconds of samples the ring holds unless -b says otherwise
+#define __SAMPLE_RING_SECONDS   0.25
+
+struct sample_block
+{
+    char**              data;       //received samples, one buffer per channel
+    char**              derived;    //the reader's buffers (NULL for none)
+    size_t              samples;    //samples per channel in data
+    long long           tick;       //device time of the first sample
+    int                 error;      //error code of the receive
+    bool                gap;        //samples were lost right before it
+};
+
+struct sample_ring
+{
+    sample_block*       blocks;
+    unsigned long long  slots;      //blocks in the ring
+    size_t              channels;   //data buffers per block
+    size_t              derivedChannels;    //derived buffers per block
+    volatile unsigned long long written;    //blocks published (writer)
+    volatile unsigned long long released;   //blocks handed back (reader)
+    volatile unsigned long long peak;       //most blocks in the ring at once
+    volatile unsigned long long lost;       //receives with no free block
+    bool                gapPending; //the next block follows a lost one
+    sem_t               filled;     //posted for every published block
+};
+
+/*createSampleRing( sample_ring&, size_t, size_t, size_t, size_t, size_t,
+                    buffer_arena& )
+ *
+ *A ring of slots blocks, each with channels data buffers of dataBytes and
+ *derivedChannels derived buffers of derivedBytes, all carved out of arena by
+ *the calling thread.  Returns 0 if the arena is too small.
+ */
+int createSampleRing( sample_ring& ring, size_t slots, size_t channels,
+                      size_t dataBytes, size_t derivedChannels,
+                      size_t derivedBytes, buffer_arena& arena );
+
+/*freeBlock( sample_ring& )
+ *
+ *Writer: the block to receive into next, or NULL if the ring is full (then
+ *call loseBlock after receiving into a spare buffer)
+ */
+sample_block* freeBlock( sample_ring& ring );
+
+/*publishBlock( sample_ring& )
+ *
+ *Writer: hands the block of freeBlock to the reader
+ */
+void publishBlock( sample_ring& ring );
+
+/*loseBlock( sample_ring& )
+ *
+ *Writer: counts a receive that found no free block
+ */
+void loseBlock( sample_ring& ring );
+
+/*waitBlock( sample_ring&, unsigned long long, double )
+ *
+ *Reader: block n, once it is published.  Blocks must be waited for in
+ *order.  Returns NULL if it takes longer than timeout seconds.
+ */
+sample_block* waitBlock( sample_ring& ring, unsigned long long n,
+                         double timeout );
+
+/*ringBlock( sample_ring&, unsigned long long )
+ *
+ *Reader: block n, which must be published and not released
+ */
+sample_block* ringBlock( sample_ring& ring, unsigned long long n );
+
+/*latestBlock( sample_ring& )
+ *
+ *Reader: the newest published block, or NULL if there is none yet
+ */
+const sample_block* latestBlock( sample_ring& ring );
+
+/*releaseBlocks( sample_ring&, unsigned long long )
+ *
+ *Reader: hands every block before block n back to the writer
+ */
+void releaseBlocks( sample_ring& ring, unsigned long long n );
+
+/*destroySampleRing( sample_ring& )
+ *
+ *Frees the ring (the buffers go with the arena)
+ */
+void destroySampleRing( sample_ring& ring );
+
+
+#endif // SAMPLE_RING_H_INCLUDED
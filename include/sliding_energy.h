@@ -0,0 +1,82 @@
+/*Copyright 2012-2016 Joseph "Mitch" Davis mitchd@vt.edu
+ *
+ *This file is part of usrp-utils.
+ *
+ *   usrp-utils is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   usrp-utils is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with usrp-utils.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ *Sliding-window energy.  Used in the usrp-energy and energycalculator
+ *programs.
+ *
+ *An output is produced every hop samples once window samples have been seen,
+ *and holds the energy of the last window samples.  Each output is the
+ *difference of two running prefix sums of |x|^2, so it costs O(1) no matter
+ *how much the windows overlap.  The prefix sums are periodically rebased to
+ *the oldest value still needed so they never grow large enough to lose
+ *precision.
+ */
+#ifndef SLIDING_ENERGY_H_INCLUDED
+#define SLIDING_ENERGY_H_INCLUDED
+
+#include "dsp_kernels.h"
+
+struct sliding_energy
+{
+    int                     window;       //window length in samples
+    int                     hop;          //samples between outputs
+
+    double*                 prefix;       //last window+1 prefix sums, indexed
+                                          //by sample count mod (window+1)
+    double                  total;        //prefix sum of all samples so far
+    unsigned long long int  samples;      //samples consumed
+    unsigned long long int  next_output;  //sample count of the next output
+    int                     since_rebase; //samples since the last rebase
+
+    double*                 power;        //scratch for per-sample power
+    int                     power_size;   //size of power
+};
+
+/*initializeSlidingEnergy( sliding_energy&, int, int )
+ *
+ *Sets up a window-sample window that advances hop samples per output
+ */
+void initializeSlidingEnergy( sliding_energy& slider, int window, int hop );
+
+/*slidingEnergyOutputs( const sliding_energy&, int )
+ *
+ *Upper bound on the outputs produced by pushing samples samples.  Use this to
+ *size the output array handed to pushSlidingEnergy.
+ */
+int slidingEnergyOutputs( const sliding_energy& slider, int samples );
+
+/*pushSlidingEnergy( sliding_energy&, sample_format, const void*, int, double* )
+ *
+ *Consumes samples samples and writes any completed window energies to
+ *output.  Returns the number of outputs written.
+ */
+int pushSlidingEnergy( sliding_energy& slider,
+                       sample_format   format,
+                       const void*     iq,
+                       int             samples,
+                       double*         output );
+
+/*destroySlidingEnergy( sliding_energy& )
+ *
+ *Frees the prefix and scratch arrays
+ */
+void destroySlidingEnergy( sliding_energy& slider );
+
+
+#endif // SLIDING_ENERGY_H_INCLUDED
@@ -0,0 +1,82 @@
+/*Copyright 2012-2016 Joseph "Mitch" Davis mitchd@vt.edu
+ *
+ *This file is part of usrp-utils.
+ *
+ *   usrp-utils is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   usrp-utils is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with usrp-utils.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ *Spectrum output formats of the FFT programs (usrp-sensor and fftcompute).
+ *
+ *The default format is the raw magnitude of every bin as a 32-bit float,
+ *with no header.  The quantized formats store each bin as an 8 or 16-bit
+ *unsigned dB code and start with a 20-byte header, all in host byte order:
+ *
+ *  char[4]   "QSPC"
+ *  uint32    bits per bin (8 or 16)
+ *  float     reference: dB (20 log10 of the magnitude) of code 0
+ *  float     step: dB per code
+ *  uint32    bins per frame
+ *
+ *A code decodes to reference + code*step dB.  Bins below the reference read
+ *0 and bins above the top of the range read the largest code.
+ */
+#ifndef SPECTRUM_FORMAT_H_INCLUDED
+#define SPECTRUM_FORMAT_H_INCLUDED
+
+#include <stdio.h>
+
+#define __SPECTRUM_MAGIC        "QSPC"
+#define __SPECTRUM_HEADER_SIZE  20
+
+//Defaults of the quantized formats: code 0 at -100 dB, and a step that
+//covers about 128 dB (8 bits) or 328 dB (16 bits)
+#define __SPECTRUM_REFERENCE    -100.0f
+#define __SPECTRUM_STEP_8       0.5f
+#define __SPECTRUM_STEP_16      0.005f
+
+struct spectrum_format
+{
+    int     bits;         //bits per bin: 32 (float magnitude), 16 or 8
+    float   reference;    //dB of code 0
+    float   step;         //dB per code
+};
+
+/*initializeSpectrumFormat( spectrum_format&, int, float, float )
+ *
+ *Sets up a bits-bit format.  A step <= 0 selects the default step of that
+ *width.  Returns 0 if bits is not 8, 16 or 32.
+ */
+int initializeSpectrumFormat( spectrum_format& format, int bits,
+                              float reference, float step );
+
+/*writeSpectrumHeader( FILE*, const spectrum_format&, int )
+ *
+ *Writes the header of a quantized output file with bins bins per frame.
+ *Float output has no header and writes nothing.  Returns 0 on a write error.
+ */
+int writeSpectrumHeader( FILE* outputFile, const spectrum_format& format,
+                         int bins );
+
+/*writeSpectrum( FILE*, const float*, int, const spectrum_format&, void* )
+ *
+ *Writes count magnitudes in the given format.  scratch holds the quantized
+ *codes and must have room for count 16-bit values.  Returns 0 on a write
+ *error.
+ */
+int writeSpectrum( FILE* outputFile, const float* magnitude, int count,
+                   const spectrum_format& format, void* scratch );
+
+
+#endif // SPECTRUM_FORMAT_H_INCLUDED
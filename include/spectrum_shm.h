@@ -0,0 +1,129 @@
+/*Copyright 2012-2016 Joseph "Mitch" Davis mitchd@vt.edu
+ *
+ *This file is part of usrp-utils.
+ *
+ *   usrp-utils is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   usrp-utils is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with usrp-utils.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ *Shared-memory spectrum feed of usrp-sensor for live local consumers.
+ *
+ *The sensor publishes every output frame into a ring of frames in a POSIX
+ *shared-memory object (shm_open name, e.g. "/usrp_sensor").  Publishing is a
+ *copy into the mapping: no system calls and no waiting for readers, so a
+ *slow reader only ever misses frames.  The object holds, in host byte order:
+ *
+ *  spectrum_shm_header
+ *  slots x ( uint64 sequence, frame data padded to 8 bytes )
+ *
+ *The frame data is a frame exactly as written to the output file (bits per
+ *bin, reference and step as in spectrum_format.h).  Frame n goes to slot
+ *n % slots.  Each slot is a seqlock: its sequence is 2n+1 while frame n is
+ *being written and 2n+2 once it is complete.  The header's frames counter
+ *is raised after every frame, so frames-1 is the newest one.
+ *
+ *A reader of frame n loads the sequence (acquire), reads the data in place
+ *or copies it, then loads the sequence again after an acquire fence.  The
+ *data is valid if both loads read 2n+2, see readSpectrumFrame.
+ */
+#ifndef SPECTRUM_SHM_H_INCLUDED
+#define SPECTRUM_SHM_H_INCLUDED
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "spectrum_format.h"
+
+#define __SPECTRUM_SHM_MAGIC    "SSHM"
+
+//Frames in the ring unless -N says otherwise
+#define __SPECTRUM_SHM_SLOTS    64
+
+struct spectrum_shm_header
+{
+    char        magic[4];     //__SPECTRUM_SHM_MAGIC
+    uint32_t    bits;         //bits per bin: 32 (float magnitude), 16 or 8
+    float       reference;    //dB of code 0
+    float       step;         //dB per code
+    uint32_t    bins;         //bins per frame
+    uint32_t    slots;        //frames in the ring
+    uint64_t    slotSize;     //bytes per slot, sequence included
+    uint64_t    frames;       //frames published so far
+};
+
+struct spectrum_shm
+{
+    char*                 name;     //shm_open name
+    bool                  owner;    //created (and unlinked) by this process
+    size_t                size;     //bytes mapped
+    spectrum_shm_header*  header;   //start of the mapping
+    unsigned char*        slots;    //first slot
+    size_t                frameBytes; //bytes of frame data per slot
+    uint64_t              next;     //writer: number of the next frame
+};
+
+/*createSpectrumShm( spectrum_shm&, const char*, const spectrum_format&, int,
+ *                   int )
+ *
+ *Creates (or replaces) the shared-memory object name holding a ring of slots
+ *frames of bins bins in format, and maps it.  Returns 0 on failure.  Free
+ *with destroySpectrumShm, which also removes the name.
+ */
+int createSpectrumShm( spectrum_shm& shm, const char* name,
+                       const spectrum_format& format, int bins, int slots );
+
+/*attachSpectrumShm( spectrum_shm&, const char* )
+ *
+ *Maps an existing ring read-only.  Returns 0 if it does not exist or is not
+ *a spectrum ring.  Free with destroySpectrumShm.
+ */
+int attachSpectrumShm( spectrum_shm& shm, const char* name );
+
+/*destroySpectrumShm( spectrum_shm& )
+ *
+ *Unmaps the ring, and removes its name if this process created it.  Readers
+ *that still map it keep working.
+ */
+void destroySpectrumShm( spectrum_shm& shm );
+
+/*beginSpectrumFrame( spectrum_shm& ) / endSpectrumFrame( spectrum_shm& )
+ *
+ *Writer side.  beginSpectrumFrame marks the next slot busy and returns its
+ *data, where the caller writes one frame (frameBytes bytes).
+ *endSpectrumFrame publishes it.  Only one thread may write at a time.
+ */
+void* beginSpectrumFrame( spectrum_shm& shm );
+void endSpectrumFrame( spectrum_shm& shm );
+
+/*publishSpectrum( spectrum_shm&, const void* )
+ *
+ *Copies one frame (frameBytes bytes) into the ring
+ */
+void publishSpectrum( spectrum_shm& shm, const void* frame );
+
+/*publishedFrames( const spectrum_shm& )
+ *
+ *Number of frames published so far; the newest one is this minus 1
+ */
+uint64_t publishedFrames( const spectrum_shm& shm );
+
+/*readSpectrumFrame( const spectrum_shm&, uint64_t, void* )
+ *
+ *Copies frame number frame (frameBytes bytes) to data.  Returns 0 if that
+ *frame is not in the ring, i.e. not published yet or already overwritten.
+ */
+int readSpectrumFrame( const spectrum_shm& shm, uint64_t frame, void* data );
+
+
+#endif // SPECTRUM_SHM_H_INCLUDED
@@ -0,0 +1,56 @@
+/*Copyright 2012-2016 Joseph "Mitch" Davis mitchd@vt.edu
+ *
+ *This file is part of usrp-utils.
+ *
+ *   usrp-utils is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   usrp-utils is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with usrp-utils.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ *Input and output streams of the file processing programs (fftcompute and
+ *energycalculator).  The file name "-" stands for standard input or output,
+ *so the programs can sit in a pipeline.  Every stream gets a large stdio
+ *buffer, and nothing seeks, so pipes behave exactly like files.
+ */
+#ifndef STREAM_IO_H_INCLUDED
+#define STREAM_IO_H_INCLUDED
+
+#include <stdio.h>
+
+//stdio buffer of every stream (bytes)
+#define __STREAM_BUFFER_SIZE  (1 << 20)
+
+/*isStandardStream( const char* )
+ *
+ *True for the name "-"
+ */
+bool isStandardStream( const char* name );
+
+/*openInputStream( const char* ) / openOutputStream( const char* )
+ *
+ *Opens name for reading or writing (stdin or stdout for "-") with a
+ *__STREAM_BUFFER_SIZE buffer.  Returns NULL if the file cannot be opened.
+ *Close with closeStream.
+ */
+FILE* openInputStream( const char* name );
+FILE* openOutputStream( const char* name );
+
+/*closeStream( FILE* )
+ *
+ *Closes a stream from openInputStream or openOutputStream.  stdin and stdout
+ *are only flushed.  Returns 0 if buffered output could not be written.
+ */
+int closeStream( FILE* stream );
+
+
+#endif // STREAM_IO_H_INCLUDED
@@ -0,0 +1,161 @@
+/*Copyright 2012-2016 Joseph "Mitch" Davis mitchd@vt.edu
+ *
+ *This file is part of usrp-utils.
+ *
+ *   usrp-utils is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   usrp-utils is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with usrp-utils.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ *Helpers shared by the programs that stream from a USRP (usrp-sensor,
+ *usrp-energy and usrp-recorder).
+ */
+#ifndef USRP_COMMON_H_INCLUDED
+#define USRP_COMMON_H_INCLUDED
+
+#include <uhd/usrp/multi_usrp.hpp>
+#include <vector>
+#include <cstdio>
+
+#include "dsp_kernels.h"
+
+//Default format of the samples on the wire (-O).  sc8 halves the link load
+//and so doubles the achievable rate, at 8 bits of resolution.
+#ifdef WIRE_SC8
+  #define __USRP_WIRE_FMT     SAMPLE_SC8
+#else
+  #define __USRP_WIRE_FMT     SAMPLE_SC16
+#endif
+
+//Seconds between issuing a timed stream start and the first sample.  Long
+//enough for the command to reach every channel before it is due.
+#define __USRP_START_DELAY    0.05
+
+//recv timeout for the first buffer after the stream start
+#define __USRP_FIRST_TIMEOUT  (__USRP_START_DELAY + 0.1)
+
+//Seconds to wait for a PPS edge before giving up on the PPS time source
+#define __USRP_PPS_TIMEOUT    1.5
+
+//Most samples one finite stream command can request.  The device counts
+//them in 28 bits, so longer bursts are chained from several commands.
+#define __USRP_BURST_SAMPS    0x0fffffffULL
+
+//Bytes of one frame time stamp record, see writeFrameTime
+#define __FRAME_TIME_SIZE     24
+
+/*parseChannels( const char*, std::vector<size_t>& )
+ *
+ *Translates a comma separated list of channel numbers (e.g. "0,1") into
+ *channels.  Returns 0 on a malformed or empty list.
+ */
+int parseChannels( const char* list, std::vector<size_t>& channels );
+
+/*parseWireFormat( const char*, sample_format& )
+ *
+ *Like parseSampleFormat, but only for the formats a USRP puts on the wire
+ *(sc16 and sc8).  Returns 0 for any other name.
+ */
+int parseWireFormat( const char* name, sample_format& format );
+
+/*channelFileName( const char*, size_t, size_t )
+ *
+ *Name of the output file of one channel.  With a single channel this is
+ *fileName itself, otherwise "<fileName>.ch<channel>".  The caller owns the
+ *returned string (delete []).
+ */
+char* channelFileName( const char* fileName, size_t channel,
+                       size_t channelCount );
+
+/*syncTime( uhd::usrp::multi_usrp::sptr&, const char* )
+ *
+ *Sets the device time to UNIX time.  timeSource selects how:
+ *  "gpsdo"     GPS time, loaded on a PPS edge of the GPSDO
+ *  "external"  host time (whole seconds), loaded on an external PPS edge
+ *  "host"      host time, loaded right away with set_time_now
+ *If the requested source is missing, unlocked or never ticks, a warning is
+ *printed and the host time is used instead.  Returns 0 on this fallback.
+ */
+int syncTime( uhd::usrp::multi_usrp::sptr& usrp, const char* timeSource );
+
+/*startStream( uhd::usrp::multi_usrp::sptr&, size_t, double )
+ *
+ *Starts continuous streaming on every channel.  With startTime > 0 every
+ *channel starts at that device time (seconds).  Otherwise a single channel
+ *starts right away and several channels start together __USRP_START_DELAY in
+ *the future, so the first sample of every channel carries the same time
+ *stamp.  Returns the recv timeout that covers the wait for the first buffer,
+ *or 0 (stream not started) when startTime has already passed.
+ */
+double startStream( uhd::usrp::multi_usrp::sptr& usrp, size_t channelCount,
+                    double startTime );
+
+/*startBurst( uhd::usrp::multi_usrp::sptr&, size_t, double, unsigned long long& )
+ *
+ *Starts a finite burst of exactly remaining samples on every channel, timed
+ *like startStream.  The device ends the burst by itself (end_of_burst on the
+ *last buffer), so no stop command follows.  A burst longer than
+ *__USRP_BURST_SAMPS only requests its first __USRP_BURST_SAMPS samples;
+ *continueBurst queues the rest.  remaining drops by the samples requested.
+ *Returns the first recv timeout, or 0 when startTime has already passed.
+ */
+double startBurst( uhd::usrp::multi_usrp::sptr& usrp, size_t channelCount,
+                   double startTime, unsigned long long& remaining );
+
+/*continueBurst( uhd::usrp::multi_usrp::sptr&, unsigned long long& )
+ *
+ *Queues the next command of a burst started by startBurst, to follow the
+ *current one without a gap.  Call it once the current command is streaming;
+ *does nothing when remaining is 0.
+ */
+void continueBurst( uhd::usrp::multi_usrp::sptr& usrp,
+                    unsigned long long& remaining );
+
+/*openIndexFiles( const char*, const std::vector<size_t>& )
+ *
+ *Opens the time stamp index of every channel (see channelFileName).  Without
+ *an indexFileName every entry is NULL.  Returns NULL if a file cannot be
+ *opened.  Close with closeIndexFiles.
+ */
+FILE** openIndexFiles( const char* indexFileName,
+                       const std::vector<size_t>& channels );
+
+/*closeIndexFiles( FILE**, size_t )
+ *
+ *Closes the index files and frees the array
+ */
+void closeIndexFiles( FILE** indexFiles, size_t channelCount );
+
+/*writeFrameTime( FILE*, unsigned long long, const uhd::time_spec_t& )
+ *
+ *Appends the time stamp of one output frame to an index file: the stream
+ *sample number of the frame's first sample (uint64), then the device time
+ *of that sample as whole seconds (int64) and fractional seconds (double),
+ *__FRAME_TIME_SIZE bytes in host byte order.  The n-th record belongs to the
+ *n-th frame of the output file.  A NULL indexFile is ignored.  Returns 0 on a
+ *write error.
+ */
+int writeFrameTime( FILE* indexFile, unsigned long long sample,
+                    const uhd::time_spec_t& time );
+
+/*installStopHandler() / stopRequested()
+ *
+ *Catches SIGINT and SIGTERM so a run can end cleanly: the handler only raises
+ *a flag, which the receive loops poll with stopRequested before every buffer.
+ *A second signal kills the program the usual way.
+ */
+void installStopHandler();
+bool stopRequested();
+
+
+#endif // USRP_COMMON_H_INCLUDED
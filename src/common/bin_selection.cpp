@@ -0,0 +1,166 @@
+/*Copyright 2012-2016 Joseph "Mitch" Davis mitchd@vt.edu
+ *
+ *This file is part of usrp-utils.
+ *
+ *   usrp-utils is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   usrp-utils is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with usrp-utils.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ *
+ *
+ *This is the frequency-subset implementation.  Used in the usrp-sensor and
+ *fftcompute programs
+ */
+
+#include "bin_selection.h"
+
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+
+//Bins run through the Goertzel recursion together
+#define __GOERTZEL_GROUP  8
+
+
+int parseBinSelection( const char* list, int fftSize, bin_selection& selection )
+{
+    std::vector<int> outputs;
+
+    const char* entry = list;
+    while( *entry )
+    {
+        char* end;
+        long  first = strtol( entry, &end, 10 );
+        long  last  = first;
+        if( end == entry )
+            return 0;
+
+        if( *end == ':' )
+        {
+            const char* field = end + 1;
+            last = strtol( field, &end, 10 );
+            if( end == field )
+                return 0;
+        }
+        if( first < 0 || last < first || last >= fftSize )
+            return 0;
+        for( long j = first; j <= last; j++ )
+            outputs.push_back( static_cast<int>(j) );
+
+        if( *end == ',' )
+            end++;
+        else if( *end )
+            return 0;
+        entry = end;
+    }
+    if( outputs.empty() )
+        return 0;
+
+    //Output j holds FFT bin j + fftSize/2 (negative freqs first)
+    selection.count = outputs.size();
+    selection.bins  = new int[selection.count];
+    for( int i = 0; i < selection.count; i++ )
+        selection.bins[i] = ( outputs[i] + fftSize/2 ) % fftSize;
+
+    double fftCost      = __FFT_COST * fftSize * log2( static_cast<double>(fftSize) );
+    double goertzelCost = __GOERTZEL_COST * fftSize * selection.count;
+    selection.goertzel  = goertzelCost < fftCost;
+
+    selection.coeff = NULL;
+    selection.cosw  = NULL;
+    selection.sinw  = NULL;
+    if( selection.goertzel )
+    {
+        selection.coeff = new double[selection.count];
+        selection.cosw  = new double[selection.count];
+        selection.sinw  = new double[selection.count];
+        for( int i = 0; i < selection.count; i++ )
+        {
+            double w = 2.0 * M_PI * selection.bins[i] / fftSize;
+            selection.cosw[i]   = cos( w );
+            selection.sinw[i]   = sin( w );
+            selection.coeff[i]  = 2.0 * selection.cosw[i];
+        }
+    }
+    return 1;
+}
+
+
+void destroyBinSelection( bin_selection& selection )
+{
+    delete [] selection.bins;
+    delete [] selection.coeff;
+    delete [] selection.cosw;
+    delete [] selection.sinw;
+}
+
+
+void selectBins( const bin_selection& selection, const float* spectrum,
+                 float* magnitude )
+{
+    for( int i = 0; i < selection.count; i++ )
+    {
+        const float* bin = spectrum + 2*selection.bins[i];
+        magnitude[i] = sqrtf( bin[0]*bin[0] + bin[1]*bin[1] );
+    }
+}
+
+
+void goertzelBins( const bin_selection& selection, const float* iq,
+                   int fftSize, float* magnitude )
+{
+    //The recursion is real, so I and Q run through it separately:
+    //  s[n] = x[n] + 2 cos(w) s[n-1] - s[n-2]
+    //and |X| = |s[N-1] - e^-jw s[N-2]|
+    for( int first = 0; first < selection.count; first += __GOERTZEL_GROUP )
+    {
+        int     group = selection.count - first;
+        double  i1[__GOERTZEL_GROUP], i2[__GOERTZEL_GROUP];
+        double  q1[__GOERTZEL_GROUP], q2[__GOERTZEL_GROUP];
+        double  coeff[__GOERTZEL_GROUP];
+        if( group > __GOERTZEL_GROUP )
+            group = __GOERTZEL_GROUP;
+
+        for( int b = 0; b < group; b++ )
+        {
+            i1[b] = i2[b] = q1[b] = q2[b] = 0.0;
+            coeff[b] = selection.coeff[first + b];
+        }
+
+        for( int n = 0; n < fftSize; n++ )
+        {
+            double x = iq[2*n];
+            double y = iq[2*n+1];
+            for( int b = 0; b < group; b++ )
+            {
+                double i0 = x + coeff[b]*i1[b] - i2[b];
+                double q0 = y + coeff[b]*q1[b] - q2[b];
+                i2[b] = i1[b];
+                i1[b] = i0;
+                q2[b] = q1[b];
+                q1[b] = q0;
+            }
+        }
+
+        for( int b = 0; b < group; b++ )
+        {
+            //s[N-1] - e^-jw s[N-2] with the complex s = i + jq
+            double c  = selection.cosw[first + b];
+            double s  = selection.sinw[first + b];
+            double re = i1[b] - ( c*i2[b] + s*q2[b] );
+            double im = q1[b] - ( c*q2[b] - s*i2[b] );
+            magnitude[first + b] = static_cast<float>( sqrt( re*re + im*im ) );
+        }
+    }
+}
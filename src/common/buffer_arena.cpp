@@ -0,0 +1,119 @@
+/*Copyright 2012-2016 Joseph "Mitch" Davis mitchd@vt.edu
+ *
+ *This file is part of usrp-utils.
+ *
+ *   usrp-utils is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   usrp-utils is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with usrp-utils.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ *
+ *
+ *
+ *This is the buffer arena implementation.  Used in the usrp-sensor and
+ *usrp-recorder programs
+ */
+
+#include "buffer_arena.h"
+
+#include <cstring>
+#include <sys/mman.h>
+
+#ifndef MAP_HUGE_SHIFT
+  #define MAP_HUGE_SHIFT  26
+#endif
+
+//Huge page sizes tried in turn: 1 GB for arenas of at least a page, then 2 MB
+static const size_t hugePageSizes[] = { 1UL << 30, 1UL << 21 };
+static const int    hugePageShifts[] = { 30, 21 };
+
+
+size_t arenaBytes( size_t bytes )
+{
+    return ( bytes + __ARENA_ALIGNMENT - 1 ) &
+           ~static_cast<size_t>(__ARENA_ALIGNMENT - 1);
+}
+
+
+int openArena( buffer_arena& arena, size_t bytes )
+{
+    arena.base      = NULL;
+    arena.size      = 0;
+    arena.used      = 0;
+    arena.pageSize  = 0;
+    if( !bytes )
+        bytes = __ARENA_ALIGNMENT;
+
+    //Huge pages only exist if some are reserved, so each size may fail
+    for( int k = 0; k < 2; k++ )
+    {
+        const size_t page = hugePageSizes[k];
+        if( k == 0 && bytes < page )
+            continue;
+        const size_t size = ( bytes + page - 1 ) & ~( page - 1 );
+        void* map = mmap( NULL, size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB |
+                          ( hugePageShifts[k] << MAP_HUGE_SHIFT ), -1, 0 );
+        if( map != MAP_FAILED )
+        {
+            arena.base      = reinterpret_cast<char*>(map);
+            arena.size      = size;
+            arena.pageSize  = page;
+            return 1;
+        }
+    }
+
+    //Normal pages, which the kernel may still back with transparent huge
+    //pages
+    const size_t size = ( bytes + 4095 ) & ~static_cast<size_t>(4095);
+    void* map = mmap( NULL, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    if( map == MAP_FAILED )
+        return 0;
+#ifdef MADV_HUGEPAGE
+    madvise( map, size, MADV_HUGEPAGE );
+#endif
+    arena.base  = reinterpret_cast<char*>(map);
+    arena.size  = size;
+    return 1;
+}
+
+
+void* arenaAlloc( buffer_arena& arena, size_t bytes )
+{
+    const size_t room = arenaBytes( bytes );
+    if( !arena.base || room > arena.size - arena.used )
+        return NULL;
+
+    char* slice = arena.base + arena.used;
+    arena.used += room;
+    //Touching the slice here faults it in on the caller's node
+    memset( slice, 0, room );
+    return slice;
+}
+
+
+void closeArena( buffer_arena& arena )
+{
+    if( arena.base )
+        munmap( arena.base, arena.size );
+    arena.base  = NULL;
+    arena.size  = 0;
+    arena.used  = 0;
+}
+
+
+int lockMemory()
+{
+    return !mlockall( MCL_CURRENT | MCL_FUTURE );
+}
@@ -0,0 +1,146 @@
+/*Copyright 2012-2016 Joseph "Mitch" Davis mitchd@vt.edu
+ *
+ *This file is part of usrp-utils.
+ *
+ *   usrp-utils is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   usrp-utils is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with usrp-utils.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ *
+ *This is the burst detector implementation.  Used in the usrp-energy and
+ *energycalculator programs
+ */
+
+#include "burst_detector.h"
+
+#include <cmath>
+
+
+/*writeStop
+ *
+ *Writes the stop event of the current burst, which ended with output last
+ */
+static int writeStop( burst_detector& detector, unsigned long long int last )
+{
+    detector.in_burst = false;
+    detector.events++;
+    return fprintf( detector.eventsFile, "stop %llu %llu %.9g\n",
+                    detector.skipped + last*detector.stride +
+                    detector.span - 1,
+                    detector.skipped + detector.peak_output*detector.stride,
+                    detector.peak ) > 0;
+}
+
+
+int initializeBurstDetector( burst_detector& detector,
+                             const char*     eventsFileName,
+                             double          threshold,
+                             double          hysteresis,
+                             int             timeConstant,
+                             int             stride,
+                             int             span )
+{
+    detector.start_ratio    = pow( 10.0, threshold/10.0 );
+    detector.stop_ratio     = pow( 10.0, (threshold - hysteresis)/10.0 );
+    detector.time_constant  = timeConstant;
+    detector.stride         = stride;
+    detector.span           = span;
+    detector.floor          = 0;
+    detector.outputs        = 0;
+    detector.skipped        = 0;
+    detector.in_burst       = false;
+    detector.peak_output    = 0;
+    detector.peak           = 0;
+    detector.events         = 0;
+
+    detector.eventsFile = fopen( eventsFileName, "w" );
+    return detector.eventsFile != NULL;
+}
+
+
+int pushBurstDetector( burst_detector& detector, const double* energy,
+                       int count )
+{
+    unsigned long long int events = detector.events;
+
+    for( int i = 0; i < count; i++, detector.outputs++ )
+    {
+        double e = energy[i];
+
+        //Learn the initial floor before detecting anything
+        if( detector.outputs < static_cast<unsigned long long int>(detector.time_constant) )
+        {
+            detector.floor += (e - detector.floor) / (detector.outputs + 1);
+            continue;
+        }
+
+        //A zero floor (e.g. leading zero samples) would start a burst on any
+        //output and never let it stop, so wait for a floor first
+        if( !detector.in_burst )
+        {
+            if( detector.floor > 0 && e > detector.floor*detector.start_ratio )
+            {
+                detector.in_burst     = true;
+                detector.peak         = e;
+                detector.peak_output  = detector.outputs;
+                detector.events++;
+                if( fprintf( detector.eventsFile, "start %llu %.9g %.9g\n",
+                             detector.skipped +
+                             detector.outputs*detector.stride, e,
+                             detector.floor ) <= 0 )
+                    return 0;
+            }
+            else
+                detector.floor += (e - detector.floor) / detector.time_constant;
+            continue;
+        }
+
+        if( e > detector.peak )
+        {
+            detector.peak         = e;
+            detector.peak_output  = detector.outputs;
+        }
+        if( e < detector.floor*detector.stop_ratio &&
+            !writeStop( detector, detector.outputs - 1 ) )
+            return 0;
+    }
+
+    //Events are rare, so push them out right away for anyone tailing the file
+    if( detector.events != events && fflush( detector.eventsFile ) )
+        return 0;
+    return 1;
+}
+
+
+int skipBurstDetector( burst_detector& detector, unsigned long long samples )
+{
+    //A burst cannot be followed across samples that were never seen
+    if( detector.in_burst &&
+        ( !writeStop( detector, detector.outputs - 1 ) ||
+          fflush( detector.eventsFile ) ) )
+        return 0;
+
+    detector.skipped += samples;
+    return 1;
+}
+
+
+void closeBurstDetector( burst_detector& detector )
+{
+    if( detector.in_burst )
+        writeStop( detector, detector.outputs - 1 );
+
+    fclose( detector.eventsFile );
+    detector.eventsFile = NULL;
+}
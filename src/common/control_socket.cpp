@@ -0,0 +1,216 @@
+/*Copyright 2012-2016 Joseph "Mitch" Davis mitchd@vt.edu
+ *
+ *This file is part of usrp-utils.
+ *
+ *   usrp-utils is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   usrp-utils is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with usrp-utils.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ *
+ *
+ *This is the control socket implementation.  Used in the usrp-sensor program
+ */
+
+#include "control_socket.h"
+
+#include <cstring>
+#include <cstdio>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+
+/*answerCommand( control_socket&, const char*, char* )
+ *
+ *Hands line to the program and waits for its answer, which is copied to
+ *reply (__CONTROL_LINE_LENGTH bytes)
+ */
+static void answerCommand( control_socket& control, const char* line,
+                           char* reply )
+{
+    pthread_mutex_lock( &control.mutex );
+    strcpy( control.command, line );
+    control.pending = true;
+    while( control.pending && !control.stop )
+        pthread_cond_wait( &control.answered, &control.mutex );
+    if( control.pending )
+        strcpy( reply, "error shutting down" );
+    else
+        strcpy( reply, control.reply );
+    control.pending = false;
+    pthread_mutex_unlock( &control.mutex );
+}
+
+
+/*controlThread( void* )
+ *
+ *pthread starting function of the control thread.  Accepts one client at a
+ *time and answers its commands line by line.
+ */
+static void* controlThread( void* control_arg )
+{
+    control_socket& control = *reinterpret_cast<control_socket*>(control_arg);
+
+    char    line[__CONTROL_LINE_LENGTH];
+    char    reply[__CONTROL_LINE_LENGTH+1];
+    char    buffer[__CONTROL_LINE_LENGTH];
+    size_t  length    = 0;
+    bool    overlong  = false;
+    int     client    = -1;
+
+    while( !control.stop )
+    {
+        //Wake up now and then to notice the stop flag
+        struct pollfd ready;
+        ready.fd      = client >= 0 ? client : control.listener;
+        ready.events  = POLLIN;
+        if( poll( &ready, 1, __CONTROL_POLL_MS ) <= 0 )
+            continue;
+
+        if( client < 0 )
+        {
+            client    = accept( control.listener, NULL, NULL );
+            length    = 0;
+            overlong  = false;
+            continue;
+        }
+
+        ssize_t received = read( client, buffer, sizeof(buffer) );
+        if( received <= 0 )
+        {
+            if( received < 0 && errno == EINTR )
+                continue;
+            close( client );
+            client = -1;
+            continue;
+        }
+
+        for( ssize_t i = 0; i < received; i++ )
+        {
+            if( buffer[i] != '\n' )
+            {
+                //Keep the start of an overlong line, and refuse it at its end
+                if( length < sizeof(line) - 1 )
+                    line[length++] = buffer[i];
+                else
+                    overlong = true;
+                continue;
+            }
+
+            if( length && line[length-1] == '\r' )
+                length--;
+            line[length] = '\0';
+            if( overlong )
+                strcpy( reply, "error command too long" );
+            else if( length )
+                answerCommand( control, line, reply );
+            length    = 0;
+            overlong  = false;
+            if( !line[0] )
+                continue;
+
+            //A client that went away only loses its answer
+            strcat( reply, "\n" );
+            send( client, reply, strlen(reply), MSG_NOSIGNAL );
+        }
+    }
+
+    if( client >= 0 )
+        close( client );
+    return NULL;
+}
+
+
+int openControlSocket( control_socket& control, const char* path )
+{
+    struct sockaddr_un address;
+
+    if( strlen( path ) >= sizeof(address.sun_path) )
+        return 0;
+    memset( &address, 0, sizeof(address) );
+    address.sun_family = AF_UNIX;
+    strcpy( address.sun_path, path );
+
+    control.listener  = socket( AF_UNIX, SOCK_STREAM, 0 );
+    if( control.listener < 0 )
+        return 0;
+
+    //A socket file left behind by a killed sensor would block the bind
+    unlink( path );
+    if( bind( control.listener, reinterpret_cast<sockaddr*>(&address),
+              sizeof(address) ) || listen( control.listener, 4 ) )
+    {
+        close( control.listener );
+        return 0;
+    }
+
+    control.path      = new char[strlen(path)+1];
+    strcpy( control.path, path );
+    control.pending   = false;
+    control.stop      = false;
+    pthread_mutex_init( &control.mutex, NULL );
+    pthread_cond_init( &control.answered, NULL );
+
+    if( pthread_create( &control.thread, NULL, controlThread, &control ) )
+    {
+        pthread_cond_destroy( &control.answered );
+        pthread_mutex_destroy( &control.mutex );
+        close( control.listener );
+        unlink( control.path );
+        delete [] control.path;
+        return 0;
+    }
+    return 1;
+}
+
+
+const char* pendingControl( control_socket& control )
+{
+    if( !control.pending )
+        return NULL;
+
+    //The lock orders the read of the command after its write
+    pthread_mutex_lock( &control.mutex );
+    pthread_mutex_unlock( &control.mutex );
+    return control.command;
+}
+
+
+void replyControl( control_socket& control, const char* reply )
+{
+    pthread_mutex_lock( &control.mutex );
+    strncpy( control.reply, reply, sizeof(control.reply) - 1 );
+    control.reply[sizeof(control.reply) - 1] = '\0';
+    control.pending = false;
+    pthread_cond_signal( &control.answered );
+    pthread_mutex_unlock( &control.mutex );
+}
+
+
+void closeControlSocket( control_socket& control )
+{
+    pthread_mutex_lock( &control.mutex );
+    control.stop = true;
+    pthread_cond_signal( &control.answered );
+    pthread_mutex_unlock( &control.mutex );
+    pthread_join( control.thread, NULL );
+
+    pthread_cond_destroy( &control.answered );
+    pthread_mutex_destroy( &control.mutex );
+    close( control.listener );
+    unlink( control.path );
+    delete [] control.path;
+}
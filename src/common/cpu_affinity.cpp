@@ -0,0 +1,272 @@
+/*Copyright 2012-2016 Joseph "Mitch" Davis mitchd@vt.edu
+ *
+ *This file is part of usrp-utils.
+ *
+ *   usrp-utils is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   usrp-utils is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with usrp-utils.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ *
+ *
+ *This is the cpu placement implementation.  Used in the usrp-sensor program
+ */
+
+#include "cpu_affinity.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <iostream>
+
+using namespace std;
+
+
+/*readCpuFile( const char*, char*, size_t )
+ *
+ *Reads the first line of a sysfs file into line (without the newline).
+ *Returns 0 if the file cannot be read.
+ */
+static int readCpuFile( const char* path, char* line, size_t size )
+{
+    FILE* file = fopen( path, "r" );
+    if( !file )
+        return 0;
+    char* got = fgets( line, size, file );
+    fclose( file );
+    if( !got )
+        return 0;
+    line[strcspn( line, "\n" )] = '\0';
+    return 1;
+}
+
+
+void initializeCpuPlan( cpu_plan& plan )
+{
+    plan.recvCpu  = -1;
+    plan.workerCpus.clear();
+    plan.node     = -1;
+    plan.policy   = SCHED_OTHER;
+    plan.priority = 0;
+    CPU_ZERO( &plan.allowed );
+    if( sched_getaffinity( 0, sizeof(plan.allowed), &plan.allowed ) )
+        for( int cpu = 0; cpu < CPU_SETSIZE; cpu++ )
+            CPU_SET( cpu, &plan.allowed );
+}
+
+
+int parseCpuList( const char* list, vector<int>& cpus )
+{
+    cpus.clear();
+
+    const char* entry = list;
+    while( *entry )
+    {
+        char* end;
+        long  first = strtol( entry, &end, 10 );
+        long  last  = first;
+        if( end == entry || first < 0 )
+            return 0;
+        if( *end == '-' )
+        {
+            entry = end + 1;
+            last  = strtol( entry, &end, 10 );
+            if( end == entry || last < first )
+                return 0;
+        }
+        if( last >= CPU_SETSIZE )
+            return 0;
+        for( long cpu = first; cpu <= last; cpu++ )
+            cpus.push_back( static_cast<int>(cpu) );
+
+        if( *end == ',' )
+            end++;
+        else if( *end )
+            return 0;
+        entry = end;
+    }
+
+    return !cpus.empty();
+}
+
+
+int parseCpuPlan( const char* spec, cpu_plan& plan )
+{
+    vector<int> cpus;
+    vector<int> usable;
+    char        path[256];
+    char        line[1024];
+
+    plan.recvCpu  = -1;
+    plan.workerCpus.clear();
+    plan.node     = -1;
+
+    if( !strncmp( spec, "auto", 4 ) && ( !spec[4] || spec[4] == ':' ) )
+    {
+        //The node of the NIC (node 0 without an interface, or when the
+        //kernel does not know it)
+        plan.node = 0;
+        if( spec[4] == ':' )
+        {
+            snprintf( path, sizeof(path), "/sys/class/net/%s/device/numa_node",
+                      spec + 5 );
+            if( !readCpuFile( path, line, sizeof(line) ) )
+                return 0;
+            plan.node = atoi( line ) < 0 ? 0 : atoi( line );
+        }
+
+        //All of its cpus, or every cpu on a machine without NUMA in sysfs
+        snprintf( path, sizeof(path), "/sys/devices/system/node/node%d/cpulist",
+                  plan.node );
+        if( !readCpuFile( path, line, sizeof(line) ) ||
+            !parseCpuList( line, cpus ) )
+        {
+            plan.node = -1;
+            cpus.clear();
+            for( int cpu = 0; cpu < CPU_SETSIZE; cpu++ )
+                cpus.push_back( cpu );
+        }
+        for( size_t k = 0; k < cpus.size(); k++ )
+            if( CPU_ISSET( cpus[k], &plan.allowed ) )
+                usable.push_back( cpus[k] );
+        if( usable.empty() )
+            return 0;
+
+        //The receive thread gets the first cpu to itself when there are more
+        plan.recvCpu = usable[0];
+        plan.workerCpus.assign( usable.begin() + ( usable.size() > 1 ? 1 : 0 ),
+                                usable.end() );
+        return 1;
+    }
+
+    //An explicit plan
+    char* end;
+    long  recv = strtol( spec, &end, 10 );
+    if( end == spec || *end != ':' || recv < 0 || recv >= CPU_SETSIZE ||
+        !CPU_ISSET( recv, &plan.allowed ) || !parseCpuList( end + 1, cpus ) )
+        return 0;
+    for( size_t k = 0; k < cpus.size(); k++ )
+        if( !CPU_ISSET( cpus[k], &plan.allowed ) )
+            return 0;
+    plan.recvCpu    = static_cast<int>(recv);
+    plan.workerCpus = cpus;
+    return 1;
+}
+
+
+int parseSchedPolicy( const char* spec, cpu_plan& plan )
+{
+    int policy;
+
+    if( !strcmp( spec, "other" ) )
+    {
+        plan.policy   = SCHED_OTHER;
+        plan.priority = 0;
+        return 1;
+    }
+    if( !strncmp( spec, "fifo:", 5 ) )
+        policy = SCHED_FIFO;
+    else if( !strncmp( spec, "rr:", 3 ) )
+        policy = SCHED_RR;
+    else
+        return 0;
+
+    char* end;
+    long  priority = strtol( strchr( spec, ':' ) + 1, &end, 10 );
+    if( *end || priority < sched_get_priority_min( policy ) ||
+        priority > sched_get_priority_max( policy ) )
+        return 0;
+    plan.policy   = policy;
+    plan.priority = static_cast<int>(priority);
+    return 1;
+}
+
+
+int workerCpu( const cpu_plan& plan, int worker )
+{
+    if( plan.workerCpus.empty() )
+        return -1;
+    return plan.workerCpus[worker % plan.workerCpus.size()];
+}
+
+
+int realtimeFits( const cpu_plan& plan, int workers )
+{
+    if( plan.policy == SCHED_OTHER )
+        return 1;
+
+    //A spinning realtime worker would starve anything else on its cpu
+    for( int worker = 0; worker < workers; worker++ )
+    {
+        const int cpu = workerCpu( plan, worker );
+        if( cpu < 0 || cpu == plan.recvCpu )
+            return 0;
+        for( int other = 0; other < worker; other++ )
+            if( workerCpu( plan, other ) == cpu )
+                return 0;
+    }
+    return 1;
+}
+
+
+int placeThread( const cpu_plan& plan, int cpu )
+{
+    cpu_set_t set;
+
+    if( cpu < 0 )
+        set = plan.allowed;
+    else
+    {
+        CPU_ZERO( &set );
+        CPU_SET( cpu, &set );
+    }
+    return !pthread_setaffinity_np( pthread_self(), sizeof(set), &set );
+}
+
+
+int createWorker( pthread_t& thread, const cpu_plan& plan, int worker,
+                  void* (*start)( void* ), void* arg )
+{
+    pthread_attr_t      attr;
+    cpu_set_t           set;
+    struct sched_param  param;
+    const int           cpu = workerCpu( plan, worker );
+
+    pthread_attr_init( &attr );
+    if( cpu >= 0 )
+    {
+        CPU_ZERO( &set );
+        CPU_SET( cpu, &set );
+        pthread_attr_setaffinity_np( &attr, sizeof(set), &set );
+    }
+    if( plan.policy != SCHED_OTHER )
+    {
+        param.sched_priority = plan.priority;
+        pthread_attr_setinheritsched( &attr, PTHREAD_EXPLICIT_SCHED );
+        pthread_attr_setschedpolicy( &attr, plan.policy );
+        pthread_attr_setschedparam( &attr, &param );
+    }
+
+    int rc = pthread_create( &thread, &attr, start, arg );
+    if( rc == EPERM && plan.policy != SCHED_OTHER )
+    {
+        //Not allowed to run realtime, so run the worker normally
+        cout << "Cannot use the realtime policy for worker " << worker
+             << ", using the normal policy" << endl;
+        pthread_attr_setinheritsched( &attr, PTHREAD_INHERIT_SCHED );
+        rc = pthread_create( &thread, &attr, start, arg );
+    }
+    pthread_attr_destroy( &attr );
+    return rc;
+}
@@ -0,0 +1,489 @@
+/*Copyright 2012-2016 Joseph "Mitch" Davis mitchd@vt.edu
+ *
+ *This file is part of usrp-utils.
+ *
+ *   usrp-utils is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   usrp-utils is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with usrp-utils.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ *
+ *
+ *This is the digital down-converter and resampler implementation.  Used in
+ *the usrp-sensor and usrp-recorder programs
+ */
+
+#include "ddc.h"
+
+#include <cstring>
+#include <cmath>
+
+#ifdef __AVX__
+  #include <immintrin.h>
+#endif
+
+
+#ifdef __AVX__
+/*cmul( __m256, __m256 )
+ *
+ *Products of 4 pairs of interleaved complex floats
+ */
+static inline __m256 cmul( __m256 a, __m256 b )
+{
+    __m256 br = _mm256_moveldup_ps( b );
+    __m256 bi = _mm256_movehdup_ps( b );
+    __m256 as = _mm256_permute_ps( a, 0xB1 );
+    return _mm256_addsub_ps( _mm256_mul_ps( a, br ), _mm256_mul_ps( as, bi ) );
+}
+#endif
+
+
+/*firDot( const float*, const float*, int, float* )
+ *
+ *One complex output of a real FIR: the dot product of taps complex samples
+ *with the duplicated taps
+ */
+static inline void firDot( const float* x, const float* taps2, int taps,
+                           float* y )
+{
+    int   i   = 0;
+    float re  = 0;
+    float im  = 0;
+
+#ifdef __AVX__
+    __m256 acc = _mm256_setzero_ps();
+    for( ; i + 4 <= taps; i += 4 )
+        acc = _mm256_add_ps( acc, _mm256_mul_ps( _mm256_loadu_ps( x + 2*i ),
+                                                 _mm256_loadu_ps( taps2 + 2*i ) ) );
+    float lanes[8];
+    _mm256_storeu_ps( lanes, acc );
+    re = (lanes[0] + lanes[4]) + (lanes[2] + lanes[6]);
+    im = (lanes[1] + lanes[5]) + (lanes[3] + lanes[7]);
+#endif
+
+    for( ; i < taps; i++ )
+    {
+        re += x[2*i]*taps2[2*i];
+        im += x[2*i+1]*taps2[2*i+1];
+    }
+    y[0] = re;
+    y[1] = im;
+}
+
+
+/*blackman( int, int )
+ *
+ *Coefficient n of a length-point Blackman window
+ */
+static double blackman( int n, int length )
+{
+    const double x = 2*M_PI*n/(length - 1);
+    return 0.42 - 0.5*cos( x ) + 0.08*cos( 2*x );
+}
+
+
+/*initializeStage( ddc_stage&, int, int )
+ *
+ *Designs a stage that decimates by factor (a half-band stage for 2) and
+ *takes up to maxInput samples per call
+ */
+static void initializeStage( ddc_stage& stage, int factor, int maxInput )
+{
+    stage.factor  = factor;
+
+    if( factor == 2 )
+    {
+        //Half-band: sinc with zeros on every other tap, the center tap is
+        //0.5 and the even taps act on the even samples only
+        const int length  = 4*__DDC_HALFBAND_PAIRS - 1;
+        const int center  = length/2;
+        double*   even    = new double[2*__DDC_HALFBAND_PAIRS];
+        double    sum     = 0;
+        for( int j = 0; j < 2*__DDC_HALFBAND_PAIRS; j++ )
+        {
+            double x  = 0.5*(2*j - center);
+            even[j]   = sin( M_PI*x )/(M_PI*x) * blackman( 2*j, length );
+            sum      += even[j];
+        }
+
+        stage.taps    = 2*__DDC_HALFBAND_PAIRS;
+        stage.history = stage.taps - 1;
+        stage.taps2   = new float[2*stage.taps];
+        for( int j = 0; j < stage.taps; j++ )
+        {
+            //DC gain of 1 with the 0.5 center tap
+            float tap = static_cast<float>( 0.5*even[stage.taps - 1 - j]/sum );
+            stage.taps2[2*j]    = tap;
+            stage.taps2[2*j+1]  = tap;
+        }
+        delete [] even;
+
+        stage.buffer  = new float[2*(stage.history + maxInput/2)];
+        stage.odd     = new float[2*(__DDC_HALFBAND_PAIRS + maxInput/2)];
+        memset( stage.buffer, 0, 2*stage.history*sizeof(float) );
+        memset( stage.odd, 0, 2*__DDC_HALFBAND_PAIRS*sizeof(float) );
+    }
+    else
+    {
+        //Windowed sinc with its cutoff at the new Nyquist frequency
+        const int length  = __DDC_FIR_TAPS*factor;
+        const double center = 0.5*(length - 1);
+        double*   h       = new double[length];
+        double    sum     = 0;
+        for( int n = 0; n < length; n++ )
+        {
+            double x  = (n - center)/factor;
+            h[n]      = ( x == 0 ? 1.0 : sin( M_PI*x )/(M_PI*x) ) *
+                        blackman( n, length );
+            sum      += h[n];
+        }
+
+        stage.taps    = length;
+        stage.history = length - 1;
+        stage.taps2   = new float[2*length];
+        for( int n = 0; n < length; n++ )
+        {
+            float tap = static_cast<float>( h[length - 1 - n]/sum );
+            stage.taps2[2*n]    = tap;
+            stage.taps2[2*n+1]  = tap;
+        }
+        delete [] h;
+
+        stage.buffer  = new float[2*(stage.history + maxInput)];
+        stage.odd     = NULL;
+        memset( stage.buffer, 0, 2*stage.history*sizeof(float) );
+    }
+}
+
+
+/*runStage( ddc_stage&, const float*, int, float* )
+ *
+ *Decimates samples input samples into output (which may be the input) and
+ *returns the number of output samples
+ */
+static int runStage( ddc_stage& stage, const float* input, int samples,
+                     float* output )
+{
+    const int outputs = samples/stage.factor;
+
+    if( stage.factor == 2 )
+    {
+        //Split the input into its even and odd samples behind the history
+        float* even = stage.buffer + 2*stage.history;
+        float* odd  = stage.odd + 2*__DDC_HALFBAND_PAIRS;
+        for( int m = 0; m < outputs; m++ )
+        {
+            even[2*m]   = input[4*m];
+            even[2*m+1] = input[4*m+1];
+            odd[2*m]    = input[4*m+2];
+            odd[2*m+1]  = input[4*m+3];
+        }
+
+        for( int m = 0; m < outputs; m++ )
+        {
+            firDot( stage.buffer + 2*m, stage.taps2, stage.taps, output + 2*m );
+            output[2*m]   += 0.5f*stage.odd[2*m];
+            output[2*m+1] += 0.5f*stage.odd[2*m+1];
+        }
+
+        memmove( stage.odd, stage.odd + 2*outputs,
+                 2*__DDC_HALFBAND_PAIRS*sizeof(float) );
+    }
+    else
+    {
+        memcpy( stage.buffer + 2*stage.history, input, 2*samples*sizeof(float) );
+        for( int k = 0; k < outputs; k++ )
+            firDot( stage.buffer + 2*k*stage.factor, stage.taps2, stage.taps,
+                    output + 2*k );
+    }
+
+    //Keep the newest samples for the next call
+    const int consumed = stage.factor == 2 ? outputs : samples;
+    memmove( stage.buffer, stage.buffer + 2*consumed,
+             2*stage.history*sizeof(float) );
+
+    return outputs;
+}
+
+
+/*mix( ddc_channel&, const float*, int, float* )
+ *
+ *Multiplies samples samples with the NCO.  The phase is recomputed in double
+ *precision every __DDC_NCO_BLOCK samples, so it never drifts.
+ */
+static void mix( ddc_channel& ddc, const float* iq, int samples, float* output )
+{
+    for( int b = 0; b < samples; b += __DDC_NCO_BLOCK )
+    {
+        const int   n     = samples - b < __DDC_NCO_BLOCK ? samples - b
+                                                          : __DDC_NCO_BLOCK;
+        const float cr    = static_cast<float>( cos( ddc.phase ) );
+        const float ci    = static_cast<float>( -sin( ddc.phase ) );
+        const float* x    = iq + 2*b;
+        float*       y    = output + 2*b;
+        int          k    = 0;
+
+#ifdef __AVX__
+        const __m256 base = _mm256_setr_ps( cr, ci, cr, ci, cr, ci, cr, ci );
+        for( ; k + 4 <= n; k += 4 )
+        {
+            __m256 p = cmul( base, _mm256_loadu_ps( ddc.table + 2*k ) );
+            _mm256_storeu_ps( y + 2*k, cmul( _mm256_loadu_ps( x + 2*k ), p ) );
+        }
+#endif
+
+        for( ; k < n; k++ )
+        {
+            float pr  = cr*ddc.table[2*k] - ci*ddc.table[2*k+1];
+            float pi  = cr*ddc.table[2*k+1] + ci*ddc.table[2*k];
+            float xr  = x[2*k];
+            float xi  = x[2*k+1];
+            y[2*k]    = xr*pr - xi*pi;
+            y[2*k+1]  = xi*pr + xr*pi;
+        }
+
+        ddc.phase = fmod( ddc.phase + ddc.step*n, 2*M_PI );
+    }
+}
+
+
+int initializeDdc( ddc_channel& ddc, double offset, double rate,
+                   int decimation, int maxSamples )
+{
+    if( decimation < 1 || rate <= 0 || fabs( offset ) >= 0.5*rate )
+        return 0;
+
+    ddc.decimation  = decimation;
+    ddc.maxSamples  = maxSamples;
+    ddc.phase       = 0;
+    ddc.step        = 2*M_PI*offset/rate;
+
+    ddc.table       = new float[2*__DDC_NCO_BLOCK];
+    for( int k = 0; k < __DDC_NCO_BLOCK; k++ )
+    {
+        ddc.table[2*k]    = static_cast<float>( cos( ddc.step*k ) );
+        ddc.table[2*k+1]  = static_cast<float>( -sin( ddc.step*k ) );
+    }
+
+    //Half-band stages for every factor of 2, then the odd rest
+    int halfBands = 0;
+    int rest      = decimation;
+    while( rest % 2 == 0 )
+    {
+        halfBands++;
+        rest /= 2;
+    }
+
+    ddc.stageCount  = halfBands + ( rest > 1 ? 1 : 0 );
+    ddc.stages      = ddc.stageCount ? new ddc_stage[ddc.stageCount] : NULL;
+    int input       = maxSamples;
+    for( int s = 0; s < halfBands; s++ )
+    {
+        initializeStage( ddc.stages[s], 2, input );
+        input /= 2;
+    }
+    if( rest > 1 )
+        initializeStage( ddc.stages[halfBands], rest, input );
+
+    //Every stage is symmetric and delays by half its span, counted in the
+    //samples of its own input (a half-band output lines up with its newest
+    //even sample, 2*__DDC_HALFBAND_PAIRS - 1 samples past the center tap)
+    ddc.delay       = 0;
+    int spacing     = 1;
+    for( int s = 0; s < ddc.stageCount; s++ )
+    {
+        ddc.delay  += spacing*( ddc.stages[s].factor == 2 ?
+                                2*__DDC_HALFBAND_PAIRS - 1.0 :
+                                0.5*(ddc.stages[s].taps - 1) );
+        spacing    *= ddc.stages[s].factor;
+    }
+
+    ddc.work        = new float[2*maxSamples];
+    return 1;
+}
+
+
+void destroyDdc( ddc_channel& ddc )
+{
+    for( int s = 0; s < ddc.stageCount; s++ )
+    {
+        delete [] ddc.stages[s].taps2;
+        delete [] ddc.stages[s].buffer;
+        delete [] ddc.stages[s].odd;
+    }
+    delete [] ddc.stages;
+    delete [] ddc.table;
+    delete [] ddc.work;
+    ddc.stages  = NULL;
+    ddc.table   = NULL;
+    ddc.work    = NULL;
+}
+
+
+int ddcProcess( ddc_channel& ddc, const float* iq, int samples, float* output )
+{
+    if( !ddc.stageCount )
+    {
+        mix( ddc, iq, samples, output );
+        return samples;
+    }
+
+    mix( ddc, iq, samples, ddc.work );
+    for( int s = 0; s < ddc.stageCount; s++ )
+    {
+        float* to = s == ddc.stageCount - 1 ? output : ddc.work;
+        samples   = runStage( ddc.stages[s], ddc.work, samples, to );
+    }
+    return samples;
+}
+
+
+int rationalFactors( double inputRate, double outputRate, int& interpolation,
+                     int& decimation )
+{
+    if( inputRate <= 0 || outputRate <= 0 )
+        return 0;
+
+    //Convergents p/q of outputRate/inputRate until one is close enough
+    const double ratio  = outputRate/inputRate;
+    double       x      = ratio;
+    long long    p0     = 0;
+    long long    q0     = 1;
+    long long    p1     = 1;
+    long long    q1     = 0;
+    for( int k = 0; k < 64; k++ )
+    {
+        const long long a   = static_cast<long long>( floor( x ) );
+        const long long p2  = a*p1 + p0;
+        const long long q2  = a*q1 + q0;
+        if( p2 > __RESAMPLER_MAX_FACTOR || q2 > __RESAMPLER_MAX_FACTOR )
+            return 0;
+        p0 = p1;
+        q0 = q1;
+        p1 = p2;
+        q1 = q2;
+        if( fabs( static_cast<double>(p1)/q1 - ratio ) <= __RESAMPLER_TOLERANCE*ratio )
+        {
+            interpolation = static_cast<int>( p1 );
+            decimation    = static_cast<int>( q1 );
+            return 1;
+        }
+        if( x == a )
+            break;
+        x = 1/( x - a );
+    }
+    return 0;
+}
+
+
+int initializeResampler( resampler& rs, int interpolation, int decimation,
+                         int maxSamples )
+{
+    if( interpolation < 1 || decimation < 1 )
+        return 0;
+
+    int a = interpolation;
+    int b = decimation;
+    while( b )
+    {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    rs.interpolation  = interpolation/a;
+    rs.decimation     = decimation/a;
+    rs.taps           = __RESAMPLER_TAPS;
+    rs.history        = rs.taps - 1;
+    rs.maxSamples     = maxSamples;
+    rs.phase          = 0;
+    rs.position       = 0;
+    rs.delay          = ( rs.interpolation*rs.taps - 1 )/
+                        ( 2.0*rs.interpolation );
+
+    //Windowed sinc at the upsampled rate, cut off at the lower Nyquist
+    //frequency.  Every branch sums to about 1, so the gain is 1.
+    const int     L       = rs.interpolation;
+    const int     length  = L*rs.taps;
+    const double  center  = 0.5*(length - 1);
+    const int     widest  = L > rs.decimation ? L : rs.decimation;
+    double*       h       = new double[length];
+    double        sum     = 0;
+    for( int n = 0; n < length; n++ )
+    {
+        double x  = (n - center)/widest;
+        h[n]      = ( x == 0 ? 1.0 : sin( M_PI*x )/(M_PI*x) ) *
+                    blackman( n, length );
+        sum      += h[n];
+    }
+
+    //Branch p holds h[p + L k], in reverse order for firDot
+    rs.branches       = new float[2*length];
+    for( int p = 0; p < L; p++ )
+    {
+        float* taps2 = rs.branches + 2*p*rs.taps;
+        for( int m = 0; m < rs.taps; m++ )
+        {
+            float tap = static_cast<float>( L*h[p + L*(rs.taps - 1 - m)]/sum );
+            taps2[2*m]    = tap;
+            taps2[2*m+1]  = tap;
+        }
+    }
+    delete [] h;
+
+    rs.buffer         = new float[2*(rs.history + maxSamples)];
+    memset( rs.buffer, 0, 2*rs.history*sizeof(float) );
+    return 1;
+}
+
+
+void destroyResampler( resampler& rs )
+{
+    delete [] rs.branches;
+    delete [] rs.buffer;
+    rs.branches = NULL;
+    rs.buffer   = NULL;
+}
+
+
+int resamplerOutputs( const resampler& rs, int samples )
+{
+    return static_cast<int>( static_cast<long long>(samples)*rs.interpolation/
+                             rs.decimation ) + 1;
+}
+
+
+int resample( resampler& rs, const float* iq, int samples, float* output )
+{
+    const int L       = rs.interpolation;
+    int       outputs = 0;
+
+    memcpy( rs.buffer + 2*rs.history, iq, 2*samples*sizeof(float) );
+
+    //Output n sits at n M on the upsampled grid: its newest input is
+    //n M / L and its branch n M % L
+    while( rs.position < samples )
+    {
+        firDot( rs.buffer + 2*rs.position, rs.branches + 2*rs.phase*rs.taps,
+                rs.taps, output + 2*outputs );
+        outputs++;
+        rs.phase    += rs.decimation;
+        rs.position += rs.phase/L;
+        rs.phase    %= L;
+    }
+    rs.position -= samples;
+
+    //Keep the newest samples for the next call
+    memmove( rs.buffer, rs.buffer + 2*samples, 2*rs.history*sizeof(float) );
+
+    return outputs;
+}
@@ -0,0 +1,480 @@
+/*Copyright 2012-2016 Joseph "Mitch" Davis mitchd@vt.edu
+ *
+ *This file is part of usrp-utils.
+ *
+ *   usrp-utils is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   usrp-utils is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with usrp-utils.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ *
+ *This is the vectorized kernel implementation.  Used in the usrp-energy,
+ *energycalculator, fftcompute and usrp-sensor programs
+ */
+
+#include "dsp_kernels.h"
+
+#include <cstring>
+#include <cmath>
+
+#ifdef __AVX__
+  #include <immintrin.h>
+#endif
+
+//log2(1+t) on [0, 1) as t*(c1 + t*(c2 + ...)), least squares fit
+#define __LOG2_C1   1.44253478f
+#define __LOG2_C2  -0.71803359f
+#define __LOG2_C3   0.45715812f
+#define __LOG2_C4  -0.27734164f
+#define __LOG2_C5   0.12147294f
+#define __LOG2_C6  -0.02579234f
+
+//20 log10(2): dB per octave of magnitude
+#define __DB_PER_LOG2  6.02059991f
+
+
+int parseSampleFormat( const char* name, sample_format& format )
+{
+    if( !strcmp( name, "fc32" ) )
+        format = SAMPLE_FC32;
+    else if( !strcmp( name, "sc16" ) )
+        format = SAMPLE_SC16;
+    else if( !strcmp( name, "sc8" ) )
+        format = SAMPLE_SC8;
+    else
+        return 0;
+    return 1;
+}
+
+
+const char* sampleFormatName( sample_format format )
+{
+    switch( format )
+    {
+    case SAMPLE_SC16:
+        return "sc16";
+    case SAMPLE_SC8:
+        return "sc8";
+    default:
+        return "fc32";
+    }
+}
+
+
+int sampleFormatSize( sample_format format )
+{
+    switch( format )
+    {
+    case SAMPLE_SC16:
+        return 2*sizeof(int16_t);
+    case SAMPLE_SC8:
+        return 2*sizeof(int8_t);
+    default:
+        return 2*sizeof(float);
+    }
+}
+
+
+float sampleFormatScale( sample_format format )
+{
+    switch( format )
+    {
+    case SAMPLE_SC16:
+        return 1.0f/32767.0f;
+    case SAMPLE_SC8:
+        return 1.0f/127.0f;
+    default:
+        return 1.0f;
+    }
+}
+
+
+float* interleaveWindow( const float* window, int size, float scale )
+{
+    float* window2 = new float[2*size];
+    for( int i = 0; i < size; i++ )
+    {
+        window2[2*i]   = window[i] * scale;
+        window2[2*i+1] = window[i] * scale;
+    }
+    return window2;
+}
+
+
+void convertWindow( sample_format format, const void* input,
+                    const float* window2, float* output, int samples )
+{
+    int k = 0;
+    int n = 2*samples;
+
+    switch( format )
+    {
+    case SAMPLE_SC16:
+    {
+        const int16_t* in = reinterpret_cast<const int16_t*>(input);
+#ifdef __AVX2__
+        for( ; k + 8 <= n; k += 8 )
+        {
+            __m256i v = _mm256_cvtepi16_epi32(
+                _mm_loadu_si128( reinterpret_cast<const __m128i*>(in + k) ) );
+            _mm256_storeu_ps( output + k,
+                              _mm256_mul_ps( _mm256_cvtepi32_ps(v),
+                                             _mm256_loadu_ps( window2 + k ) ) );
+        }
+#endif
+        for( ; k < n; k++ )
+            output[k] = static_cast<float>(in[k]) * window2[k];
+        break;
+    }
+    case SAMPLE_SC8:
+    {
+        const int8_t* in = reinterpret_cast<const int8_t*>(input);
+#ifdef __AVX2__
+        for( ; k + 8 <= n; k += 8 )
+        {
+            __m256i v = _mm256_cvtepi8_epi32(
+                _mm_loadl_epi64( reinterpret_cast<const __m128i*>(in + k) ) );
+            _mm256_storeu_ps( output + k,
+                              _mm256_mul_ps( _mm256_cvtepi32_ps(v),
+                                             _mm256_loadu_ps( window2 + k ) ) );
+        }
+#endif
+        for( ; k < n; k++ )
+            output[k] = static_cast<float>(in[k]) * window2[k];
+        break;
+    }
+    default:
+    {
+        const float* in = reinterpret_cast<const float*>(input);
+#ifdef __AVX__
+        for( ; k + 8 <= n; k += 8 )
+            _mm256_storeu_ps( output + k,
+                              _mm256_mul_ps( _mm256_loadu_ps( in + k ),
+                                             _mm256_loadu_ps( window2 + k ) ) );
+#endif
+        for( ; k < n; k++ )
+            output[k] = in[k] * window2[k];
+        break;
+    }
+    }
+}
+
+
+void convertSamples( sample_format format, const void* input, float* output,
+                     int samples )
+{
+    int         k     = 0;
+    int         n     = 2*samples;
+    const float scale = sampleFormatScale( format );
+
+    switch( format )
+    {
+    case SAMPLE_SC16:
+    {
+        const int16_t* in = reinterpret_cast<const int16_t*>(input);
+#ifdef __AVX2__
+        const __m256 s = _mm256_set1_ps( scale );
+        for( ; k + 8 <= n; k += 8 )
+        {
+            __m256i v = _mm256_cvtepi16_epi32(
+                _mm_loadu_si128( reinterpret_cast<const __m128i*>(in + k) ) );
+            _mm256_storeu_ps( output + k,
+                              _mm256_mul_ps( _mm256_cvtepi32_ps(v), s ) );
+        }
+#endif
+        for( ; k < n; k++ )
+            output[k] = static_cast<float>(in[k]) * scale;
+        break;
+    }
+    case SAMPLE_SC8:
+    {
+        const int8_t* in = reinterpret_cast<const int8_t*>(input);
+#ifdef __AVX2__
+        const __m256 s = _mm256_set1_ps( scale );
+        for( ; k + 8 <= n; k += 8 )
+        {
+            __m256i v = _mm256_cvtepi8_epi32(
+                _mm_loadl_epi64( reinterpret_cast<const __m128i*>(in + k) ) );
+            _mm256_storeu_ps( output + k,
+                              _mm256_mul_ps( _mm256_cvtepi32_ps(v), s ) );
+        }
+#endif
+        for( ; k < n; k++ )
+            output[k] = static_cast<float>(in[k]) * scale;
+        break;
+    }
+    default:
+        memmove( output, input, n*sizeof(float) );
+        break;
+    }
+}
+
+
+double energy_fc32( const float* iq, int samples )
+{
+    double mag = 0;
+    int    n   = 0;
+
+#ifdef __AVX__
+    //Four samples per pass.  The squares and I^2 + Q^2 sums are exact in
+    //double precision, so only the accumulation order matters.  That stays
+    //sequential to match the original scalar output bit-for-bit.
+    double power[4];
+    for( ; n + 4 <= samples; n += 4 )
+    {
+        __m256  v  = _mm256_loadu_ps( iq + 2*n );
+        __m256d lo = _mm256_cvtps_pd( _mm256_castps256_ps128(v) );
+        __m256d hi = _mm256_cvtps_pd( _mm256_extractf128_ps(v, 1) );
+        lo = _mm256_mul_pd( lo, lo );
+        hi = _mm256_mul_pd( hi, hi );
+
+        //hadd leaves the samples in the order 0, 2, 1, 3
+        _mm256_storeu_pd( power, _mm256_hadd_pd( lo, hi ) );
+        mag += power[0];
+        mag += power[2];
+        mag += power[1];
+        mag += power[3];
+    }
+#endif
+
+    for( ; n < samples; n++ )
+    {
+        double i = iq[2*n];
+        double q = iq[2*n+1];
+        mag += i*i + q*q;
+    }
+
+    return mag;
+}
+
+
+double energy_sc16( const int16_t* iq, int samples )
+{
+    //I^2 + Q^2 of a full-scale sc16 sample is 2^31, so the per-sample sums
+    //are treated as unsigned 32-bit values before widening
+    uint64_t sum = 0;
+    int      n   = 0;
+
+#ifdef __AVX2__
+    __m256i acc = _mm256_setzero_si256();
+    for( ; n + 8 <= samples; n += 8 )
+    {
+        __m256i v = _mm256_loadu_si256( reinterpret_cast<const __m256i*>(iq + 2*n) );
+        __m256i p = _mm256_madd_epi16( v, v );
+        acc = _mm256_add_epi64( acc,
+                  _mm256_cvtepu32_epi64( _mm256_castsi256_si128(p) ) );
+        acc = _mm256_add_epi64( acc,
+                  _mm256_cvtepu32_epi64( _mm256_extracti128_si256(p, 1) ) );
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256( reinterpret_cast<__m256i*>(lanes), acc );
+    sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+
+    for( ; n < samples; n++ )
+    {
+        int32_t i = iq[2*n];
+        int32_t q = iq[2*n+1];
+        sum += static_cast<uint32_t>(i*i) + static_cast<uint32_t>(q*q);
+    }
+
+    double scale = sampleFormatScale( SAMPLE_SC16 );
+    return static_cast<double>(sum) * scale * scale;
+}
+
+
+double energy_sc8( const int8_t* iq, int samples )
+{
+    uint64_t sum = 0;
+    int      n   = 0;
+
+#ifdef __AVX2__
+    __m256i acc = _mm256_setzero_si256();
+    for( ; n + 8 <= samples; n += 8 )
+    {
+        __m256i v = _mm256_cvtepi8_epi16(
+            _mm_loadu_si128( reinterpret_cast<const __m128i*>(iq + 2*n) ) );
+        __m256i p = _mm256_madd_epi16( v, v );
+        acc = _mm256_add_epi64( acc,
+                  _mm256_cvtepu32_epi64( _mm256_castsi256_si128(p) ) );
+        acc = _mm256_add_epi64( acc,
+                  _mm256_cvtepu32_epi64( _mm256_extracti128_si256(p, 1) ) );
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256( reinterpret_cast<__m256i*>(lanes), acc );
+    sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+
+    for( ; n < samples; n++ )
+    {
+        int32_t i = iq[2*n];
+        int32_t q = iq[2*n+1];
+        sum += i*i + q*q;
+    }
+
+    double scale = sampleFormatScale( SAMPLE_SC8 );
+    return static_cast<double>(sum) * scale * scale;
+}
+
+
+double energy( sample_format format, const void* iq, int samples )
+{
+    switch( format )
+    {
+    case SAMPLE_SC16:
+        return energy_sc16( reinterpret_cast<const int16_t*>(iq), samples );
+    case SAMPLE_SC8:
+        return energy_sc8( reinterpret_cast<const int8_t*>(iq), samples );
+    default:
+        return energy_fc32( reinterpret_cast<const float*>(iq), samples );
+    }
+}
+
+
+void samplePower( sample_format format, const void* iq, double* power,
+                  int samples )
+{
+    int n = 0;
+
+    switch( format )
+    {
+    case SAMPLE_SC16:
+    {
+        const int16_t* in = reinterpret_cast<const int16_t*>(iq);
+        double scale = sampleFormatScale( format );
+        scale *= scale;
+        for( ; n < samples; n++ )
+        {
+            int32_t i = in[2*n];
+            int32_t q = in[2*n+1];
+            power[n] = ( static_cast<double>(i*i) + static_cast<double>(q*q) ) * scale;
+        }
+        break;
+    }
+    case SAMPLE_SC8:
+    {
+        const int8_t* in = reinterpret_cast<const int8_t*>(iq);
+        double scale = sampleFormatScale( format );
+        scale *= scale;
+        for( ; n < samples; n++ )
+        {
+            int32_t i = in[2*n];
+            int32_t q = in[2*n+1];
+            power[n] = static_cast<double>(i*i + q*q) * scale;
+        }
+        break;
+    }
+    default:
+    {
+        const float* in = reinterpret_cast<const float*>(iq);
+#ifdef __AVX2__
+        for( ; n + 4 <= samples; n += 4 )
+        {
+            __m256  v  = _mm256_loadu_ps( in + 2*n );
+            __m256d lo = _mm256_cvtps_pd( _mm256_castps256_ps128(v) );
+            __m256d hi = _mm256_cvtps_pd( _mm256_extractf128_ps(v, 1) );
+            lo = _mm256_mul_pd( lo, lo );
+            hi = _mm256_mul_pd( hi, hi );
+
+            //hadd gives samples 0, 2, 1, 3; swap the middle lanes back
+            __m256d p = _mm256_hadd_pd( lo, hi );
+            _mm256_storeu_pd( power + n, _mm256_permute4x64_pd( p, 0xD8 ) );
+        }
+#endif
+        for( ; n < samples; n++ )
+        {
+            double i = in[2*n];
+            double q = in[2*n+1];
+            power[n] = i*i + q*q;
+        }
+        break;
+    }
+    }
+}
+
+
+void quantizeDb( const float* magnitude, void* codes, int count, int bits,
+                 float reference, float step )
+{
+    //code = a*log2(magnitude) + b, rounded half up
+    const float a       = __DB_PER_LOG2 / step;
+    const float b       = 0.5f - reference / step;
+    const float top     = static_cast<float>( (1 << bits) - 1 );
+    uint8_t*    codes8  = reinterpret_cast<uint8_t*>(codes);
+    uint16_t*   codes16 = reinterpret_cast<uint16_t*>(codes);
+    int         k       = 0;
+
+#ifdef __AVX2__
+    const __m256i expMask   = _mm256_set1_epi32( 0xff );
+    const __m256i expBias   = _mm256_set1_epi32( 127 );
+    const __m256i mantMask  = _mm256_set1_epi32( 0x007fffff );
+    const __m256i one       = _mm256_set1_epi32( 0x3f800000 );
+    for( ; k + 8 <= count; k += 8 )
+    {
+        __m256i x = _mm256_castps_si256( _mm256_loadu_ps( magnitude + k ) );
+        __m256  e = _mm256_cvtepi32_ps( _mm256_sub_epi32(
+                      _mm256_and_si256( _mm256_srli_epi32( x, 23 ), expMask ), expBias ) );
+        __m256  t = _mm256_sub_ps( _mm256_castsi256_ps( _mm256_or_si256(
+                      _mm256_and_si256( x, mantMask ), one ) ), _mm256_set1_ps( 1.0f ) );
+
+        __m256  p = _mm256_set1_ps( __LOG2_C6 );
+        p = _mm256_add_ps( _mm256_mul_ps( p, t ), _mm256_set1_ps( __LOG2_C5 ) );
+        p = _mm256_add_ps( _mm256_mul_ps( p, t ), _mm256_set1_ps( __LOG2_C4 ) );
+        p = _mm256_add_ps( _mm256_mul_ps( p, t ), _mm256_set1_ps( __LOG2_C3 ) );
+        p = _mm256_add_ps( _mm256_mul_ps( p, t ), _mm256_set1_ps( __LOG2_C2 ) );
+        p = _mm256_add_ps( _mm256_mul_ps( p, t ), _mm256_set1_ps( __LOG2_C1 ) );
+        p = _mm256_add_ps( _mm256_mul_ps( p, t ), e );
+
+        __m256  q = _mm256_floor_ps( _mm256_add_ps( _mm256_mul_ps( p, _mm256_set1_ps( a ) ),
+                                                    _mm256_set1_ps( b ) ) );
+        q = _mm256_min_ps( _mm256_max_ps( q, _mm256_setzero_ps() ),
+                           _mm256_set1_ps( top ) );
+
+        //Pack the 8 codes down to 16 bits (packus works per 128-bit lane,
+        //so gather the low halves of both lanes) and then to 8 bits
+        __m256i v   = _mm256_cvttps_epi32( q );
+        __m128i v16 = _mm256_castsi256_si128( _mm256_permute4x64_epi64(
+                        _mm256_packus_epi32( v, v ), 0x08 ) );
+        if( bits == 16 )
+            _mm_storeu_si128( reinterpret_cast<__m128i*>(codes16 + k), v16 );
+        else
+            _mm_storel_epi64( reinterpret_cast<__m128i*>(codes8 + k),
+                              _mm_packus_epi16( v16, v16 ) );
+    }
+#endif
+    for( ; k < count; k++ )
+    {
+        uint32_t x;
+        memcpy( &x, magnitude + k, sizeof(x) );
+        float    e = static_cast<float>( static_cast<int32_t>( (x >> 23) & 0xff ) - 127 );
+        uint32_t m = (x & 0x007fffff) | 0x3f800000;
+        float    t;
+        memcpy( &t, &m, sizeof(t) );
+        t -= 1.0f;
+
+        float p = __LOG2_C6;
+        p = p*t + __LOG2_C5;
+        p = p*t + __LOG2_C4;
+        p = p*t + __LOG2_C3;
+        p = p*t + __LOG2_C2;
+        p = p*t + __LOG2_C1;
+        p = p*t + e;
+
+        float q = floorf( p*a + b );
+        q = q < 0.0f ? 0.0f : ( q > top ? top : q );
+        if( bits == 16 )
+            codes16[k] = static_cast<uint16_t>(q);
+        else
+            codes8[k]  = static_cast<uint8_t>(q);
+    }
+}
@@ -0,0 +1,149 @@
+/*Copyright 2012-2016 Joseph "Mitch" Davis mitchd@vt.edu
+ *
+ *This file is part of usrp-utils.
+ *
+ *   usrp-utils is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   usrp-utils is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with usrp-utils.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ *
+ *This is the energy pyramid implementation.  Used in the usrp-energy and
+ *energycalculator programs
+ */
+
+#include "energy_pyramid.h"
+#include "stream_io.h"
+
+#include <cstring>
+
+
+/*writeBin
+ *
+ *Writes one bin in the precision selected for the pyramid
+ */
+static int writeBin( energy_pyramid& pyramid, int level, double energy )
+{
+    if( pyramid.write_double )
+        return fwrite( &energy, sizeof(double), 1, pyramid.outputFiles[level] ) == 1;
+
+    float value = static_cast<float>(energy);
+    return fwrite( &value, sizeof(float), 1, pyramid.outputFiles[level] ) == 1;
+}
+
+
+int initializePyramid( energy_pyramid& pyramid,
+                       const char*     outputFileName,
+                       int             levels,
+                       int             factor,
+                       bool            write_double )
+{
+    pyramid.levels        = levels;
+    pyramid.factor        = factor;
+    pyramid.write_double  = write_double;
+
+    if( !outputFileName )
+    {
+        pyramid.levels      = 0;
+        pyramid.outputFiles = NULL;
+        pyramid.sums        = NULL;
+        pyramid.counts      = NULL;
+        return 1;
+    }
+
+    pyramid.outputFiles   = new FILE*[levels];
+    pyramid.sums          = new double[levels];
+    pyramid.counts        = new int[levels];
+
+    char* levelFileName = new char[strlen(outputFileName)+16];
+
+    for( int i = 0; i < levels; i++ )
+    {
+        pyramid.sums[i]   = 0;
+        pyramid.counts[i] = 0;
+
+        if( i == 0 )
+            strcpy( levelFileName, outputFileName );
+        else
+            sprintf( levelFileName, "%s.L%i", outputFileName, i );
+
+        pyramid.outputFiles[i] = openOutputStream( levelFileName );
+        if( !pyramid.outputFiles[i] )
+        {
+            pyramid.levels = i;
+            delete [] levelFileName;
+            closePyramid( pyramid );
+            return 0;
+        }
+    }
+
+    delete [] levelFileName;
+    return 1;
+}
+
+
+int pushPyramid( energy_pyramid& pyramid, const double* energy, int count )
+{
+    if( pyramid.levels == 0 )
+        return 1;
+
+    if( pyramid.write_double )
+    {
+        //Level 0 goes out in one write
+        if( fwrite( energy, sizeof(double), count, pyramid.outputFiles[0] )
+            != static_cast<size_t>(count) )
+            return 0;
+    }
+    else
+    {
+        for( int i = 0; i < count; i++ )
+            if( !writeBin( pyramid, 0, energy[i] ) )
+                return 0;
+    }
+
+    //Cascade each bin up through the coarser levels.  A level only receives a
+    //bin when the level below it completes one, so the work per level shrinks
+    //by factor each step.
+    for( int i = 0; i < count; i++ )
+    {
+        double carry = energy[i];
+        for( int level = 1; level < pyramid.levels; level++ )
+        {
+            pyramid.sums[level] += carry;
+            if( ++pyramid.counts[level] < pyramid.factor )
+                break;
+
+            carry                 = pyramid.sums[level];
+            pyramid.sums[level]   = 0;
+            pyramid.counts[level] = 0;
+            if( !writeBin( pyramid, level, carry ) )
+                return 0;
+        }
+    }
+    return 1;
+}
+
+
+void closePyramid( energy_pyramid& pyramid )
+{
+    for( int i = 0; i < pyramid.levels; i++ )
+        closeStream( pyramid.outputFiles[i] );
+
+    delete [] pyramid.outputFiles;
+    delete [] pyramid.sums;
+    delete [] pyramid.counts;
+    pyramid.outputFiles = NULL;
+    pyramid.sums        = NULL;
+    pyramid.counts      = NULL;
+    pyramid.levels      = 0;
+}
@@ -22,6 +22,9 @@
  */
 
 #include "fft_thread.h"
+#include "dsp_kernels.h"
+
+#include <cstring>
 
 
 void* fft_thread_start( void* fft_thread_arg )
@@ -34,7 +37,21 @@ void* fft_thread_start( void* fft_thread_arg )
 
     my_thread_data = reinterpret_cast<fft_thread_data*>(fft_thread_arg);
 
-    float *magnitude  = new float[my_thread_data->fft_size];
+    //The parent may switch to another pre-planned FFT size between frames,
+    //so the buffers grow with it (unless the parent hands us buffers that
+    //already fit every size)
+    const bool ownScratch = !my_thread_data->magnitude;
+    int   capacity    = my_thread_data->fft_size;
+    float *magnitude  = ownScratch ? new float[capacity]
+                                   : my_thread_data->magnitude;
+
+    //Quantized output is encoded into codes outside the output lock
+    const int      bin_size = my_thread_data->format.bits/8;
+    unsigned char *codes    = ownScratch ? new unsigned char[capacity*2]
+                                         : my_thread_data->codes;
+
+    //A bin selection is computed and written in output order
+    const bin_selection* selection  = my_thread_data->bins;
 
     //increment is used for adavancing the thread_control to the next thread
     //in line
@@ -65,23 +82,80 @@ void* fft_thread_start( void* fft_thread_arg )
         else if( my_msg[0] == static_cast<char>(__FFT_THREAD_START) )
         {
             //Got a message to signal an FFT computation
+            //(the parent already set is_running when it sent the frame)
+            const int half        = my_thread_data->fft_size/2;
+            const int frame_bins  = selection ? selection->count
+                                              : my_thread_data->fft_size;
+            if( ownScratch && my_thread_data->fft_size > capacity )
+            {
+                capacity  = my_thread_data->fft_size;
+                delete [] magnitude;
+                delete [] codes;
+                magnitude = new float[capacity];
+                codes     = new unsigned char[capacity*2];
+            }
 
-            //Signal that the thread is running
-            my_thread_data->is_running = true;
-
-            //Apply the window function
-            for(int i = 0; i < my_thread_data->fft_size; i++ )
+            //Fold a PFB frame into the fft input, or apply the window
+            //function (unless the parent already applied it while assembling
+            //the frame)
+            if( my_thread_data->taps > 1 )
+            {
+                pfbFold( reinterpret_cast<float*>(my_thread_data->frameData),
+                         my_thread_data->window, my_thread_data->fft_size,
+                         my_thread_data->taps,
+                         reinterpret_cast<float*>(my_thread_data->inputData) );
+            }
+            else if( my_thread_data->window )
             {
-                my_thread_data->inputData[i] *= my_thread_data->window[i];
+                for(int i = 0; i < my_thread_data->fft_size; i++ )
+                {
+                    my_thread_data->inputData[i] *= my_thread_data->window[i];
+                }
             }
 
-            //Compute fft
-            fftwf_execute( my_thread_data->plan );
+            //Compute magnitude (we don't want to store phase information).
+            //A small bin selection skips the fft for Goertzel filters.
+            if( selection && selection->goertzel )
+            {
+                goertzelBins( *selection,
+                              reinterpret_cast<float*>(my_thread_data->inputData),
+                              my_thread_data->fft_size, magnitude );
+            }
+            else
+            {
+                //Compute fft
+                fftwf_execute( my_thread_data->plan );
+
+                if( selection )
+                    selectBins( *selection,
+                                reinterpret_cast<float*>(my_thread_data->outputData),
+                                magnitude );
+                else
+                    for(int i = 0; i < my_thread_data->fft_size; i++ )
+                    {
+                        magnitude[i] = cabsf( my_thread_data->outputData[i] );
+                    }
+            }
 
-            //Compute magnitude (we don't want to store phase information)
-            for(int i = 0; i < my_thread_data->fft_size; i++ )
+            //Quantize the frame, negative freqs first
+            if( !my_thread_data->accumulator && bin_size != FLOAT_SIZE &&
+                selection )
+            {
+                quantizeDb( magnitude, codes, frame_bins,
+                            my_thread_data->format.bits,
+                            my_thread_data->format.reference,
+                            my_thread_data->format.step );
+            }
+            else if( !my_thread_data->accumulator && bin_size != FLOAT_SIZE )
             {
-                magnitude[i] = cabsf( my_thread_data->outputData[i] );
+                quantizeDb( magnitude+half, codes, half,
+                            my_thread_data->format.bits,
+                            my_thread_data->format.reference,
+                            my_thread_data->format.step );
+                quantizeDb( magnitude, codes+half*bin_size, half,
+                            my_thread_data->format.bits,
+                            my_thread_data->format.reference,
+                            my_thread_data->format.step );
             }
 
             //Ensure that we're writing data to the output file in order
@@ -94,14 +168,64 @@ void* fft_thread_start( void* fft_thread_arg )
             //this is a normal mutex, so this will block until we can grab it
             pthread_mutex_lock( my_thread_data->output_mutex );
 
-            //Write to file
+            if( my_thread_data->accumulator )
+            {
+                //Sum into the sweep step, negative freqs first
+                float* sum  = my_thread_data->accumulator;
+                if( selection )
+                    for(int i = 0; i < frame_bins; i++ )
+                        sum[i] += magnitude[i];
+                else
+                    for(int i = 0; i < half; i++ )
+                    {
+                        sum[i]      += magnitude[half+i];
+                        sum[half+i] += magnitude[i];
+                    }
+                *(my_thread_data->pending) -= 1;
+            }
+            else if( !my_thread_data->outputFile )
+            {
+                //Output stopped, the frame only goes to the live feed
+            }
+            else if( bin_size != FLOAT_SIZE )
+            {
+                //Write the quantized frame
+                fwrite(codes, bin_size, frame_bins, my_thread_data->outputFile);
+            }
+            else if( selection )
+            {
+                //Write the selected bins
+                fwrite(magnitude, FLOAT_SIZE, frame_bins,
+                       my_thread_data->outputFile);
+            }
+            else
+            {
+                //Write to file
+
+                //Negative freqs first
+                fwrite(magnitude+(my_thread_data->fft_size/2), FLOAT_SIZE,
+                       my_thread_data->fft_size/2, my_thread_data->outputFile);
+                //Positive freqs next
+                fwrite(magnitude, FLOAT_SIZE,
+                       my_thread_data->fft_size/2, my_thread_data->outputFile);
+            }
 
-            //Negative freqs first
-            fwrite(magnitude+(my_thread_data->fft_size/2), FLOAT_SIZE,
-                   my_thread_data->fft_size/2, my_thread_data->outputFile);
-            //Positive freqs next
-            fwrite(magnitude, FLOAT_SIZE,
-                   my_thread_data->fft_size/2, my_thread_data->outputFile);
+            //Publish the same frame to the live feed
+            if( !my_thread_data->accumulator && my_thread_data->shm )
+            {
+                unsigned char* frame = static_cast<unsigned char*>(
+                    beginSpectrumFrame( *(my_thread_data->shm) ) );
+                if( bin_size != FLOAT_SIZE )
+                    memcpy( frame, codes, frame_bins*bin_size );
+                else if( selection )
+                    memcpy( frame, magnitude, frame_bins*FLOAT_SIZE );
+                else
+                {
+                    memcpy( frame, magnitude+half, half*FLOAT_SIZE );
+                    memcpy( frame+half*FLOAT_SIZE, magnitude, half*FLOAT_SIZE );
+                }
+                endSpectrumFrame( *(my_thread_data->shm) );
+            }
 
             //Advance the next_thread
             *(my_thread_data->next_thread) += increment;
@@ -119,7 +243,11 @@ void* fft_thread_start( void* fft_thread_arg )
     mq_close( my_queue );
     //Free memory
     delete [] my_msg;
-    delete [] magnitude;
+    if( ownScratch )
+    {
+        delete [] magnitude;
+        delete [] codes;
+    }
     //Kill thread
     pthread_exit(NULL);
 }
@@ -0,0 +1,112 @@
+/*Copyright 2012-2016 Joseph "Mitch" Davis mitchd@vt.edu
+ *
+ *This file is part of usrp-utils.
+ *
+ *   usrp-utils is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   usrp-utils is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with usrp-utils.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ *
+ *
+ *
+ *This is the overload policy implementation.  Used in the usrp-sensor program
+ */
+
+#include "overload_policy.h"
+
+#include <cstdlib>
+#include <cstring>
+
+
+int parseOverloadPolicy( const char* spec, overload_policy& policy )
+{
+    policy.limit = 1;
+    if( !strcmp( spec, "block" ) )
+        policy.mode = OVERLOAD_BLOCK;
+    else if( !strcmp( spec, "drop" ) )
+        policy.mode = OVERLOAD_DROP;
+    else if( !strcmp( spec, "overlap" ) )
+        policy.mode = OVERLOAD_OVERLAP;
+    else if( !strncmp( spec, "decimate:", 9 ) )
+    {
+        char* end;
+        long  limit = strtol( spec+9, &end, 10 );
+        if( end == spec+9 || *end || limit < 2 || limit > 1 << 20 )
+            return 0;
+        policy.mode   = OVERLOAD_DECIMATE;
+        policy.limit  = static_cast<int>(limit);
+    }
+    else
+        return 0;
+    return 1;
+}
+
+
+void resetOverload( overload_policy& policy, int overlap )
+{
+    switch( policy.mode )
+    {
+      case OVERLOAD_OVERLAP:
+        policy.maxFactor = overlap;
+        break;
+      case OVERLOAD_DECIMATE:
+        policy.maxFactor = policy.limit;
+        break;
+      default:
+        policy.maxFactor = 1;
+    }
+    policy.factor     = 1;
+    policy.phase      = 0;
+    policy.peakFactor = 1;
+    policy.shed       = 0;
+    policy.dropped    = 0;
+}
+
+
+int frameDue( overload_policy& policy, int busy, int workers )
+{
+    if( ++policy.phase < policy.factor )
+    {
+        policy.shed++;
+        return 0;
+    }
+    policy.phase = 0;
+
+    if( 4*busy >= 3*workers && policy.factor < policy.maxFactor )
+    {
+        policy.factor = 2*policy.factor < policy.maxFactor ?
+                        2*policy.factor : policy.maxFactor;
+        if( policy.factor > policy.peakFactor )
+            policy.peakFactor = policy.factor;
+    }
+    else if( 4*busy <= workers && policy.factor > 1 )
+        policy.factor /= 2;
+    return 1;
+}
+
+
+const char* overloadName( const overload_policy& policy )
+{
+    switch( policy.mode )
+    {
+      case OVERLOAD_DROP:
+        return "drop";
+      case OVERLOAD_OVERLAP:
+        return "overlap";
+      case OVERLOAD_DECIMATE:
+        return "decimate";
+      default:
+        return "block";
+    }
+}
@@ -0,0 +1,103 @@
+/*Copyright 2012-2016 Joseph "Mitch" Davis mitchd@vt.edu
+ *
+ *This file is part of usrp-utils.
+ *
+ *   usrp-utils is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   usrp-utils is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with usrp-utils.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ *
+ *
+ *This is the polyphase filter bank implementation.  Used in the usrp-sensor
+ *and fftcompute programs
+ */
+
+#include "polyphase.h"
+
+#include <cmath>
+
+#ifdef __AVX__
+  #include <immintrin.h>
+#endif
+
+
+float* pfbPrototype( int channels, int taps )
+{
+    const int     length  = channels*taps;
+    const double  center  = 0.5*(length - 1);
+    const double  span    = length > 1 ? length - 1 : 1;
+    float*        h       = new float[length];
+    double        sum     = 0;
+
+    for( int k = 0; k < length; k++ )
+    {
+        double x      = (k - center)/channels;
+        double sinc   = x == 0 ? 1.0 : sin( M_PI*x )/(M_PI*x);
+        double window = 0.54 - 0.46*cos( 2*M_PI*k/span );
+        h[k]  = static_cast<float>( sinc*window );
+        sum  += h[k];
+    }
+
+    //DC gain of N
+    const float scale = static_cast<float>( channels/sum );
+    for( int k = 0; k < length; k++ )
+        h[k] *= scale;
+
+    return h;
+}
+
+
+void pfbFold( const float* iq, const float* prototype, int channels,
+              int taps, float* output )
+{
+    int n = 0;
+
+#ifdef __AVX__
+    //4 complex samples per vector, every prototype tap duplicated for I and Q
+    for( ; n + 4 <= channels; n += 4 )
+    {
+        __m256 acc = _mm256_setzero_ps();
+        for( int t = 0; t < taps; t++ )
+        {
+            const int k = t*channels + n;
+            __m256    x = _mm256_loadu_ps( iq + 2*k );
+            if( prototype )
+            {
+                __m128 h4 = _mm_loadu_ps( prototype + k );
+                __m256 h  = _mm256_insertf128_ps(
+                                _mm256_castps128_ps256( _mm_unpacklo_ps( h4, h4 ) ),
+                                _mm_unpackhi_ps( h4, h4 ), 1 );
+                x = _mm256_mul_ps( x, h );
+            }
+            acc = _mm256_add_ps( acc, x );
+        }
+        _mm256_storeu_ps( output + 2*n, acc );
+    }
+#endif
+
+    for( ; n < channels; n++ )
+    {
+        float re = 0;
+        float im = 0;
+        for( int t = 0; t < taps; t++ )
+        {
+            const int   k = t*channels + n;
+            const float h = prototype ? prototype[k] : 1.0f;
+            re += iq[2*k]*h;
+            im += iq[2*k+1]*h;
+        }
+        output[2*n]   = re;
+        output[2*n+1] = im;
+    }
+}
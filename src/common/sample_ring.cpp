@@ -0,0 +1,159 @@
+/*Copyright 2012-2016 Joseph "Mitch" Davis mitchd@vt.edu
+ *
+ *This file is part of usrp-utils.
+ *
+ *   usrp-utils is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   usrp-utils is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with usrp-utils.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ *
+ *
+ *
+ *This is the sample ring implementation.  Used in the usrp-sensor and
+ *usrp-recorder programs
+ */
+
+#include "sample_ring.h"
+
+#include <cmath>
+#include <ctime>
+#include <errno.h>
+
+
+int createSampleRing( sample_ring& ring, size_t slots, size_t channels,
+                      size_t dataBytes, size_t derivedChannels,
+                      size_t derivedBytes, buffer_arena& arena )
+{
+    ring.blocks           = new sample_block[slots];
+    ring.slots            = slots;
+    ring.channels         = channels;
+    ring.derivedChannels  = derivedChannels;
+    ring.written          = 0;
+    ring.released         = 0;
+    ring.peak             = 0;
+    ring.lost             = 0;
+    ring.gapPending       = false;
+    sem_init( &ring.filled, 0, 0 );
+
+    int ok = 1;
+    for( size_t n = 0; n < slots; n++ )
+    {
+        sample_block& block = ring.blocks[n];
+        block.data      = new char*[channels];
+        block.derived   = derivedChannels ? new char*[derivedChannels] : NULL;
+        block.samples   = 0;
+        block.tick      = 0;
+        block.error     = 0;
+        block.gap       = false;
+        for( size_t c = 0; c < channels; c++ )
+        {
+            block.data[c] = reinterpret_cast<char*>(arenaAlloc( arena, dataBytes ));
+            ok = ok && block.data[c];
+        }
+        for( size_t c = 0; c < derivedChannels; c++ )
+        {
+            block.derived[c] = reinterpret_cast<char*>(arenaAlloc( arena, derivedBytes ));
+            ok = ok && block.derived[c];
+        }
+    }
+    return ok;
+}
+
+
+sample_block* freeBlock( sample_ring& ring )
+{
+    const unsigned long long released = __atomic_load_n( &ring.released,
+                                                         __ATOMIC_ACQUIRE );
+    if( ring.written - released >= ring.slots )
+        return NULL;
+    return &ring.blocks[ring.written % ring.slots];
+}
+
+
+void publishBlock( sample_ring& ring )
+{
+    sample_block& block = ring.blocks[ring.written % ring.slots];
+    block.gap       = ring.gapPending;
+    ring.gapPending = false;
+
+    const unsigned long long written  = ring.written + 1;
+    const unsigned long long inRing   = written -
+        __atomic_load_n( &ring.released, __ATOMIC_ACQUIRE );
+    if( inRing > ring.peak )
+        ring.peak = inRing;
+    __atomic_store_n( &ring.written, written, __ATOMIC_RELEASE );
+    sem_post( &ring.filled );
+}
+
+
+void loseBlock( sample_ring& ring )
+{
+    ring.lost++;
+    ring.gapPending = true;
+}
+
+
+sample_block* waitBlock( sample_ring& ring, unsigned long long n,
+                         double timeout )
+{
+    struct timespec until;
+    clock_gettime( CLOCK_REALTIME, &until );
+    double whole;
+    until.tv_nsec += static_cast<long>( modf( timeout, &whole )*1e9 );
+    until.tv_sec  += static_cast<time_t>( whole ) + until.tv_nsec/1000000000;
+    until.tv_nsec %= 1000000000;
+
+    //One post per block, so every block is waited for exactly once.  The
+    //post also orders the writes into the block before our reads.
+    while( sem_timedwait( &ring.filled, &until ) )
+        if( errno != EINTR )
+            return NULL;
+    return &ring.blocks[n % ring.slots];
+}
+
+
+sample_block* ringBlock( sample_ring& ring, unsigned long long n )
+{
+    return &ring.blocks[n % ring.slots];
+}
+
+
+const sample_block* latestBlock( sample_ring& ring )
+{
+    const unsigned long long written = __atomic_load_n( &ring.written,
+                                                        __ATOMIC_ACQUIRE );
+    if( !written )
+        return NULL;
+    return &ring.blocks[(written - 1) % ring.slots];
+}
+
+
+void releaseBlocks( sample_ring& ring, unsigned long long n )
+{
+    if( n > ring.released )
+        __atomic_store_n( &ring.released, n, __ATOMIC_RELEASE );
+}
+
+
+void destroySampleRing( sample_ring& ring )
+{
+    for( size_t n = 0; n < ring.slots; n++ )
+    {
+        delete [] ring.blocks[n].data;
+        delete [] ring.blocks[n].derived;
+    }
+    delete [] ring.blocks;
+    ring.blocks = NULL;
+    sem_destroy( &ring.filled );
+}
@@ -0,0 +1,121 @@
+/*Copyright 2012-2016 Joseph "Mitch" Davis mitchd@vt.edu
+ *
+ *This file is part of usrp-utils.
+ *
+ *   usrp-utils is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   usrp-utils is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with usrp-utils.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ *
+ *This is the sliding-window energy implementation.  Used in the usrp-energy
+ *and energycalculator programs
+ */
+
+#include "sliding_energy.h"
+
+#include <cstddef>
+
+//Minimum number of samples between rebases of the prefix sums.  A rebase
+//touches all window+1 stored sums, so it is also never done more often than
+//once per window.
+#define __SLIDING_REBASE_SAMPLES  65536
+
+
+void initializeSlidingEnergy( sliding_energy& slider, int window, int hop )
+{
+    slider.window       = window;
+    slider.hop          = hop;
+    slider.prefix       = new double[window+1];
+    slider.total        = 0;
+    slider.samples      = 0;
+    slider.next_output  = window;
+    slider.since_rebase = 0;
+    slider.power        = NULL;
+    slider.power_size   = 0;
+
+    for( int i = 0; i <= window; i++ )
+        slider.prefix[i] = 0;
+}
+
+
+int slidingEnergyOutputs( const sliding_energy& slider, int samples )
+{
+    return samples / slider.hop + 1;
+}
+
+
+int pushSlidingEnergy( sliding_energy& slider,
+                       sample_format   format,
+                       const void*     iq,
+                       int             samples,
+                       double*         output )
+{
+    const int ring = slider.window + 1;
+
+    if( slider.power_size < samples )
+    {
+        delete [] slider.power;
+        slider.power      = new double[samples];
+        slider.power_size = samples;
+    }
+    samplePower( format, iq, slider.power, samples );
+
+    int outputs = 0;
+    int slot    = static_cast<int>(slider.samples % ring);
+
+    for( int n = 0; n < samples; n++ )
+    {
+        slider.total += slider.power[n];
+        slider.samples++;
+        if( ++slot == ring )
+            slot = 0;
+        slider.prefix[slot] = slider.total;
+
+        if( slider.samples == slider.next_output )
+        {
+            //The slot after the newest one holds the prefix sum from window
+            //samples ago
+            int oldest = slot + 1 == ring ? 0 : slot + 1;
+            output[outputs++]   = slider.total - slider.prefix[oldest];
+            slider.next_output += slider.hop;
+        }
+    }
+
+    //Rebase the prefix sums on the oldest one we still need, which keeps
+    //their magnitude (and the rounding error of the differences) bounded by
+    //the energy of a few windows
+    slider.since_rebase += samples;
+    if( slider.since_rebase >= __SLIDING_REBASE_SAMPLES &&
+        slider.since_rebase >= slider.window )
+    {
+        int    oldest = slot + 1 == ring ? 0 : slot + 1;
+        double base   = slider.prefix[oldest];
+        for( int i = 0; i < ring; i++ )
+            slider.prefix[i] -= base;
+        slider.total       -= base;
+        slider.since_rebase = 0;
+    }
+
+    return outputs;
+}
+
+
+void destroySlidingEnergy( sliding_energy& slider )
+{
+    delete [] slider.prefix;
+    delete [] slider.power;
+    slider.prefix     = NULL;
+    slider.power      = NULL;
+    slider.power_size = 0;
+}
@@ -0,0 +1,78 @@
+/*Copyright 2012-2016 Joseph "Mitch" Davis mitchd@vt.edu
+ *
+ *This file is part of usrp-utils.
+ *
+ *   usrp-utils is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   usrp-utils is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with usrp-utils.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ *
+ *
+ *This is the implementation of the spectrum output formats.  Used in the
+ *usrp-sensor and fftcompute programs
+ */
+
+#include "spectrum_format.h"
+#include "dsp_kernels.h"
+
+#include <cstring>
+#include <stdint.h>
+
+
+int initializeSpectrumFormat( spectrum_format& format, int bits,
+                              float reference, float step )
+{
+    if( bits != 8 && bits != 16 && bits != 32 )
+        return 0;
+
+    format.bits       = bits;
+    format.reference  = reference;
+    format.step       = step;
+    if( step <= 0 )
+        format.step   = bits == 8 ? __SPECTRUM_STEP_8 : __SPECTRUM_STEP_16;
+    return 1;
+}
+
+
+int writeSpectrumHeader( FILE* outputFile, const spectrum_format& format,
+                         int bins )
+{
+    if( format.bits == 32 )
+        return 1;
+
+    unsigned char header[__SPECTRUM_HEADER_SIZE];
+    uint32_t      bits        = format.bits;
+    uint32_t      frameBins   = bins;
+
+    memcpy( header,      __SPECTRUM_MAGIC,  4 );
+    memcpy( header + 4,  &bits,             4 );
+    memcpy( header + 8,  &format.reference, 4 );
+    memcpy( header + 12, &format.step,      4 );
+    memcpy( header + 16, &frameBins,        4 );
+    return fwrite( header, __SPECTRUM_HEADER_SIZE, 1, outputFile ) == 1;
+}
+
+
+int writeSpectrum( FILE* outputFile, const float* magnitude, int count,
+                   const spectrum_format& format, void* scratch )
+{
+    if( format.bits == 32 )
+        return fwrite( magnitude, sizeof(float), count, outputFile )
+               == static_cast<size_t>(count);
+
+    quantizeDb( magnitude, scratch, count, format.bits, format.reference,
+                format.step );
+    return fwrite( scratch, format.bits/8, count, outputFile )
+           == static_cast<size_t>(count);
+}
@@ -0,0 +1,195 @@
+/*Copyright 2012-2016 Joseph "Mitch" Davis mitchd@vt.edu
+ *
+ *This file is part of usrp-utils.
+ *
+ *   usrp-utils is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   usrp-utils is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with usrp-utils.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ *
+ *
+ *This is the shared-memory spectrum feed implementation.  Used in the
+ *usrp-sensor program
+ */
+
+#include "spectrum_shm.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+/*slot( const spectrum_shm&, uint64_t )
+ *
+ *Sequence word of the slot that holds frame
+ */
+static uint64_t* slot( const spectrum_shm& shm, uint64_t frame )
+{
+    return reinterpret_cast<uint64_t*>(
+        shm.slots + (frame % shm.header->slots)*shm.header->slotSize );
+}
+
+
+int createSpectrumShm( spectrum_shm& shm, const char* name,
+                       const spectrum_format& format, int bins, int slots )
+{
+    const size_t frameBytes = static_cast<size_t>(bins)*(format.bits/8);
+    const size_t slotSize   = sizeof(uint64_t) + (frameBytes + 7)/8*8;
+    const size_t size       = sizeof(spectrum_shm_header) + slots*slotSize;
+
+    if( bins < 1 || slots < 1 )
+        return 0;
+
+    //Start from a fresh object, so readers of an old ring see it go away
+    shm_unlink( name );
+    int fd = shm_open( name, O_RDWR | O_CREAT | O_EXCL, 0644 );
+    if( fd == -1 )
+        return 0;
+    if( ftruncate( fd, size ) )
+    {
+        close( fd );
+        shm_unlink( name );
+        return 0;
+    }
+    void* map = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    close( fd );
+    if( map == MAP_FAILED )
+    {
+        shm_unlink( name );
+        return 0;
+    }
+
+    //ftruncate zero-fills, so every slot starts out empty (sequence 0)
+    shm.name        = new char[strlen(name)+1];
+    strcpy( shm.name, name );
+    shm.owner       = true;
+    shm.size        = size;
+    shm.header      = reinterpret_cast<spectrum_shm_header*>(map);
+    shm.slots       = reinterpret_cast<unsigned char*>(map) +
+                      sizeof(spectrum_shm_header);
+    shm.frameBytes  = frameBytes;
+    shm.next        = 0;
+
+    shm.header->bits      = format.bits;
+    shm.header->reference = format.reference;
+    shm.header->step      = format.step;
+    shm.header->bins      = bins;
+    shm.header->slots     = slots;
+    shm.header->slotSize  = slotSize;
+    shm.header->frames    = 0;
+    //The magic goes in last: a reader that finds it finds a complete header
+    __atomic_thread_fence( __ATOMIC_RELEASE );
+    memcpy( shm.header->magic, __SPECTRUM_SHM_MAGIC, 4 );
+    return 1;
+}
+
+
+int attachSpectrumShm( spectrum_shm& shm, const char* name )
+{
+    int fd = shm_open( name, O_RDONLY, 0 );
+    if( fd == -1 )
+        return 0;
+
+    struct stat info;
+    if( fstat( fd, &info ) ||
+        static_cast<size_t>(info.st_size) < sizeof(spectrum_shm_header) )
+    {
+        close( fd );
+        return 0;
+    }
+    void* map = mmap( NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    close( fd );
+    if( map == MAP_FAILED )
+        return 0;
+
+    spectrum_shm_header* header = reinterpret_cast<spectrum_shm_header*>(map);
+    if( memcmp( header->magic, __SPECTRUM_SHM_MAGIC, 4 ) ||
+        sizeof(spectrum_shm_header) + header->slots*header->slotSize >
+        static_cast<size_t>(info.st_size) )
+    {
+        munmap( map, info.st_size );
+        return 0;
+    }
+    __atomic_thread_fence( __ATOMIC_ACQUIRE );
+
+    shm.name        = new char[strlen(name)+1];
+    strcpy( shm.name, name );
+    shm.owner       = false;
+    shm.size        = info.st_size;
+    shm.header      = header;
+    shm.slots       = reinterpret_cast<unsigned char*>(map) +
+                      sizeof(spectrum_shm_header);
+    shm.frameBytes  = static_cast<size_t>(header->bins)*(header->bits/8);
+    shm.next        = 0;
+    return 1;
+}
+
+
+void destroySpectrumShm( spectrum_shm& shm )
+{
+    munmap( shm.header, shm.size );
+    if( shm.owner )
+        shm_unlink( shm.name );
+    delete [] shm.name;
+    shm.name    = NULL;
+    shm.header  = NULL;
+    shm.slots   = NULL;
+}
+
+
+void* beginSpectrumFrame( spectrum_shm& shm )
+{
+    uint64_t* sequence = slot( shm, shm.next );
+    __atomic_store_n( sequence, 2*shm.next + 1, __ATOMIC_RELAXED );
+    //The odd sequence is visible before any byte of the new frame
+    __atomic_thread_fence( __ATOMIC_RELEASE );
+    return sequence + 1;
+}
+
+
+void endSpectrumFrame( spectrum_shm& shm )
+{
+    __atomic_store_n( slot( shm, shm.next ), 2*shm.next + 2, __ATOMIC_RELEASE );
+    shm.next++;
+    __atomic_store_n( &shm.header->frames, shm.next, __ATOMIC_RELEASE );
+}
+
+
+void publishSpectrum( spectrum_shm& shm, const void* frame )
+{
+    memcpy( beginSpectrumFrame( shm ), frame, shm.frameBytes );
+    endSpectrumFrame( shm );
+}
+
+
+uint64_t publishedFrames( const spectrum_shm& shm )
+{
+    return __atomic_load_n( &shm.header->frames, __ATOMIC_ACQUIRE );
+}
+
+
+int readSpectrumFrame( const spectrum_shm& shm, uint64_t frame, void* data )
+{
+    const uint64_t* sequence  = slot( shm, frame );
+    const uint64_t  complete  = 2*frame + 2;
+
+    if( __atomic_load_n( sequence, __ATOMIC_ACQUIRE ) != complete )
+        return 0;
+    memcpy( data, sequence + 1, shm.frameBytes );
+    //The copy is done before the sequence is checked again
+    __atomic_thread_fence( __ATOMIC_ACQUIRE );
+    return __atomic_load_n( sequence, __ATOMIC_RELAXED ) == complete;
+}
@@ -0,0 +1,69 @@
+/*Copyright 2012-2016 Joseph "Mitch" Davis mitchd@vt.edu
+ *
+ *This file is part of usrp-utils.
+ *
+ *   usrp-utils is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   usrp-utils is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with usrp-utils.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ *
+ *
+ *This is the stream helper implementation.  Used in the fftcompute,
+ *energycalculator and usrp-energy programs
+ */
+
+#include "stream_io.h"
+
+#include <cstring>
+
+
+/*bufferStream( FILE* )
+ *
+ *Gives stream a __STREAM_BUFFER_SIZE buffer.  Must run before the first read
+ *or write.
+ */
+static FILE* bufferStream( FILE* stream )
+{
+    if( stream )
+        setvbuf( stream, NULL, _IOFBF, __STREAM_BUFFER_SIZE );
+    return stream;
+}
+
+
+bool isStandardStream( const char* name )
+{
+    return name && !strcmp( name, "-" );
+}
+
+
+FILE* openInputStream( const char* name )
+{
+    return bufferStream( isStandardStream( name ) ? stdin : fopen( name, "r" ) );
+}
+
+
+FILE* openOutputStream( const char* name )
+{
+    return bufferStream( isStandardStream( name ) ? stdout : fopen( name, "w" ) );
+}
+
+
+int closeStream( FILE* stream )
+{
+    if( stream == stdin )
+        return 1;
+    if( stream == stdout )
+        return !fflush( stream );
+    return !fclose( stream );
+}
@@ -0,0 +1,332 @@
+/*Copyright 2012-2016 Joseph "Mitch" Davis mitchd@vt.edu
+ *
+ *This file is part of usrp-utils.
+ *
+ *   usrp-utils is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   usrp-utils is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with usrp-utils.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ *
+ *This is the implementation of the USRP helpers.  Used in the usrp-sensor,
+ *usrp-energy and usrp-recorder programs
+ */
+
+#include "usrp_common.h"
+
+#include <uhd/exception.hpp>
+#include <iostream>
+#include <algorithm>
+#include <string>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <stdint.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+
+//Raised by the SIGINT/SIGTERM handler
+static volatile sig_atomic_t stopSignal = 0;
+
+
+/*waitForPPS( uhd::usrp::multi_usrp::sptr& )
+ *
+ *Blocks until the time of the last PPS edge changes.  Returns 0 if no edge
+ *shows up within __USRP_PPS_TIMEOUT seconds.
+ */
+static int waitForPPS( uhd::usrp::multi_usrp::sptr& usrp )
+{
+    uhd::time_spec_t lastPPS = usrp->get_time_last_pps();
+
+    for( int waited = 0; waited < __USRP_PPS_TIMEOUT*1000; waited += 10 )
+    {
+        usleep( 10000 );
+        if( usrp->get_time_last_pps() > lastPPS )
+            return 1;
+    }
+    return 0;
+}
+
+
+/*stopHandler( int )
+ *
+ *Signal handler of installStopHandler
+ */
+static void stopHandler( int )
+{
+    stopSignal = 1;
+}
+
+
+/*hasSensor( uhd::usrp::multi_usrp::sptr&, const char* )
+ *
+ *Whether the first motherboard reports the named sensor
+ */
+static bool hasSensor( uhd::usrp::multi_usrp::sptr& usrp, const char* name )
+{
+    std::vector<std::string> names = usrp->get_mboard_sensor_names( 0 );
+    return std::find( names.begin(), names.end(), name ) != names.end();
+}
+
+
+int parseChannels( const char* list, std::vector<size_t>& channels )
+{
+    channels.clear();
+
+    const char* entry = list;
+    while( *entry )
+    {
+        char* end;
+        long  channel = strtol( entry, &end, 10 );
+        if( end == entry || channel < 0 )
+            return 0;
+        channels.push_back( static_cast<size_t>(channel) );
+
+        if( *end == ',' )
+            end++;
+        else if( *end )
+            return 0;
+        entry = end;
+    }
+
+    return !channels.empty();
+}
+
+
+int parseWireFormat( const char* name, sample_format& format )
+{
+    sample_format wire;
+
+    if( !parseSampleFormat( name, wire ) || wire == SAMPLE_FC32 )
+        return 0;
+    format = wire;
+    return 1;
+}
+
+
+char* channelFileName( const char* fileName, size_t channel,
+                       size_t channelCount )
+{
+    char* name = new char[strlen(fileName)+32];
+
+    if( channelCount == 1 )
+        strcpy( name, fileName );
+    else
+        sprintf( name, "%s.ch%lu", fileName,
+                 static_cast<unsigned long>(channel) );
+    return name;
+}
+
+
+int syncTime( uhd::usrp::multi_usrp::sptr& usrp, const char* timeSource )
+{
+    bool gpsdo    = strcmp( timeSource, "gpsdo" ) == 0;
+    bool external = strcmp( timeSource, "external" ) == 0;
+
+    if( gpsdo || external )
+    {
+        try
+        {
+            if( gpsdo && !( hasSensor( usrp, "gps_time" ) &&
+                            hasSensor( usrp, "gps_locked" ) &&
+                            usrp->get_mboard_sensor( "gps_locked" ).to_bool() ) )
+                throw uhd::runtime_error( "GPSDO missing or not locked" );
+
+            usrp->set_time_source( timeSource );
+
+            //Load the time right after an edge, so the next edge is a whole
+            //second away, then wait for that edge to take the time
+            if( !waitForPPS( usrp ) )
+                throw uhd::runtime_error( "no PPS edge" );
+            time_t seconds = gpsdo ? usrp->get_mboard_sensor( "gps_time" ).to_int()
+                                   : time( NULL );
+            usrp->set_time_next_pps( uhd::time_spec_t( seconds + 1 ) );
+            if( !waitForPPS( usrp ) )
+                throw uhd::runtime_error( "no PPS edge" );
+
+            std::cout << "Device time set from the " << timeSource
+                      << " PPS" << std::endl;
+            return 1;
+        }
+        catch( uhd::exception& e )
+        {
+            std::cout << "WARNING! Cannot use time source " << timeSource
+                      << " (" << e.what() << "), using host time" << std::endl;
+        }
+    }
+    else if( strcmp( timeSource, "host" ) )
+        std::cout << "WARNING! Unknown time source " << timeSource
+                  << ", using host time" << std::endl;
+
+    timeval now;
+    gettimeofday( &now, 0 );
+    usrp->set_time_now( uhd::time_spec_t( now.tv_sec, now.tv_usec/1e6 ) );
+    return strcmp( timeSource, "host" ) == 0;
+}
+
+
+/*burstCommand( unsigned long long& )
+ *
+ *The finite stream command for the next part of a burst of remaining samples.
+ *Parts before the last chain into the next command (NUM_SAMPS_AND_MORE).
+ */
+static uhd::stream_cmd_t burstCommand( unsigned long long& remaining )
+{
+    unsigned long long samples = std::min( remaining, __USRP_BURST_SAMPS );
+
+    remaining -= samples;
+    uhd::stream_cmd_t stream_command( remaining ?
+                            uhd::stream_cmd_t::STREAM_MODE_NUM_SAMPS_AND_MORE :
+                            uhd::stream_cmd_t::STREAM_MODE_NUM_SAMPS_AND_DONE );
+    stream_command.num_samps  = static_cast<size_t>( samples );
+    stream_command.stream_now = true;
+    return stream_command;
+}
+
+
+/*issueStart( uhd::usrp::multi_usrp::sptr&, uhd::stream_cmd_t&, size_t, double )
+ *
+ *Times and issues the first stream command, see startStream
+ */
+static double issueStart( uhd::usrp::multi_usrp::sptr& usrp,
+                          uhd::stream_cmd_t& stream_command,
+                          size_t channelCount, double startTime )
+{
+    double            timeout = __USRP_FIRST_TIMEOUT;
+
+    stream_command.stream_now = channelCount == 1 && startTime <= 0;
+    stream_command.time_spec  = uhd::time_spec_t();
+    if( startTime > 0 )
+    {
+        //Split off the whole seconds so large UNIX times keep their precision
+        time_t seconds  = static_cast<time_t>( startTime );
+        double wait     = startTime - usrp->get_time_now().get_real_secs();
+        if( wait < __USRP_START_DELAY )
+            return 0;
+
+        stream_command.time_spec = uhd::time_spec_t( seconds, startTime - seconds );
+        timeout = wait + 0.1;
+    }
+    else if( !stream_command.stream_now )
+        stream_command.time_spec = usrp->get_time_now() +
+                                   uhd::time_spec_t(__USRP_START_DELAY);
+
+    usrp->issue_stream_cmd( stream_command );
+    return timeout;
+}
+
+
+double startStream( uhd::usrp::multi_usrp::sptr& usrp, size_t channelCount,
+                    double startTime )
+{
+    uhd::stream_cmd_t stream_command(uhd::stream_cmd_t::STREAM_MODE_START_CONTINUOUS);
+
+    return issueStart( usrp, stream_command, channelCount, startTime );
+}
+
+
+double startBurst( uhd::usrp::multi_usrp::sptr& usrp, size_t channelCount,
+                   double startTime, unsigned long long& remaining )
+{
+    unsigned long long  requested       = remaining;
+    uhd::stream_cmd_t   stream_command  = burstCommand( remaining );
+    double              timeout         = issueStart( usrp, stream_command,
+                                                      channelCount, startTime );
+
+    //Nothing was issued, so nothing was requested
+    if( !timeout )
+        remaining = requested;
+    return timeout;
+}
+
+
+void continueBurst( uhd::usrp::multi_usrp::sptr& usrp,
+                    unsigned long long& remaining )
+{
+    if( remaining )
+        usrp->issue_stream_cmd( burstCommand( remaining ) );
+}
+
+
+FILE** openIndexFiles( const char* indexFileName,
+                       const std::vector<size_t>& channels )
+{
+    FILE** indexFiles = new FILE*[channels.size()];
+
+    for( size_t c = 0; c < channels.size(); c++ )
+    {
+        indexFiles[c] = NULL;
+        if( !indexFileName )
+            continue;
+
+        char* name    = channelFileName( indexFileName, channels[c],
+                                         channels.size() );
+        indexFiles[c] = fopen( name, "wb" );
+        delete [] name;
+        if( !indexFiles[c] )
+        {
+            closeIndexFiles( indexFiles, c );
+            return NULL;
+        }
+    }
+    return indexFiles;
+}
+
+
+void closeIndexFiles( FILE** indexFiles, size_t channelCount )
+{
+    for( size_t c = 0; c < channelCount; c++ )
+        if( indexFiles[c] )
+            fclose( indexFiles[c] );
+    delete [] indexFiles;
+}
+
+
+int writeFrameTime( FILE* indexFile, unsigned long long sample,
+                    const uhd::time_spec_t& time )
+{
+    if( !indexFile )
+        return 1;
+
+    unsigned char record[__FRAME_TIME_SIZE];
+    uint64_t      sampleNumber  = sample;
+    int64_t       fullSecs      = time.get_full_secs();
+    double        fracSecs      = time.get_frac_secs();
+
+    memcpy( record,      &sampleNumber, 8 );
+    memcpy( record + 8,  &fullSecs,     8 );
+    memcpy( record + 16, &fracSecs,     8 );
+    return fwrite( record, __FRAME_TIME_SIZE, 1, indexFile ) == 1;
+}
+
+
+void installStopHandler()
+{
+    struct sigaction action;
+
+    memset( &action, 0, sizeof(action) );
+    action.sa_handler = stopHandler;
+    action.sa_flags   = SA_RESETHAND;
+    sigemptyset( &action.sa_mask );
+    sigaction( SIGINT, &action, NULL );
+    sigaction( SIGTERM, &action, NULL );
+}
+
+
+bool stopRequested()
+{
+    return stopSignal != 0;
+}
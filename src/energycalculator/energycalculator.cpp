@@ -19,24 +19,79 @@
  *This program takes I-Q data from a specified file, and computes a stream of energy bins.
  *
  *The I-Q Data is assumed to be stored in 'binary' complex<float> format.  (2 floats per 
- *sample). The energy bin size is defined as the number of samples summed to compute energy.
+ *sample) unless another format is selected with -F.  The energy bin size is defined as the
+ *number of samples summed to compute energy.
  *
  *This is the post-processing equivalent of usrp-energy.  This program can be run with data 
- *from usrp-record if usrp-record is configured to store fc32 data.
+ *from usrp-record in any of its host formats.
  *
  *The commandline options are:
  *
- * -o [file]       Output File  -The output file contains raw float data
- *                               representing the computed energy in each bin
+ * -o [file]       Output File  -The output file contains raw double data
+ *                               representing the computed energy in each bin.
+ *                               Optional when -E is given.  "-" writes to
+ *                               standard output (single pyramid level only);
+ *                               messages then go to standard error.
  *
- * -b [size]       Bin Size     -Energy bin size in samples
+ * -b [size]       Bin Size     -Energy bin size in samples (-s is accepted as
+ *                               an alias)
  *
- * -i [file]	   Input File	-The input file contains raw float data
+ * -i [file]	   Input File	-The input file contains raw float data.  "-"
+ *                               reads standard input, e.g. a decompressed or
+ *                               network-relayed capture in a pipeline.
+ *
+ * -F [format]     Input Format -Sample format of the input file: fc32
+ *                               (default), sc16 or sc8.  Integer samples are
+ *                               summed exactly and scaled to fc32 units.
+ *
+ * -p [levels]     Pyramid      -Number of energy resolutions to compute in
+ *                               one pass (default 1).  Level n has a bin size
+ *                               of (Bin Size)*factor^n and is written to
+ *                               "[Output File].L[n]".
+ *
+ * -m [factor]     Pyramid Step -Number of level n bins summed into one level
+ *                               n+1 bin (default 4)
+ *
+ * -W [size]       Window       -Sliding-window mode: each output is the energy
+ *                               of the last [size] samples.  Replaces -b.
+ *
+ * -H [size]       Hop          -Samples between sliding-window outputs.
+ *                               Windows overlap when the hop is smaller than
+ *                               the window.  Each output costs O(1) thanks to
+ *                               running prefix sums.  The sliding-window mode
+ *                               runs on one thread and cannot be combined with
+ *                               -p.
+ *
+ * -c [children]   Child Threads-Number of worker threads used to compute
+ *                               energy bins.  The input is read in large
+ *                               blocks and the bins of each block are split
+ *                               across the workers.  Defaults to 1.
+ *
+ * -E [file]       Events File  -Run the burst detector on the energy bins (or
+ *                               sliding windows) and write start/stop events
+ *                               to this text file.  See burst_detector.h for
+ *                               the format.
+ *
+ * -T [dB]         Threshold    -Burst start level above the noise floor
+ *                               (default 10)
+ *
+ * -Y [dB]         Hysteresis   -A burst stops once its energy drops this far
+ *                               below the start threshold (default 3)
+ *
+ * -N [outputs]    Floor Time   -Time constant of the adaptive noise floor in
+ *                               energy outputs (default 1000).  No bursts are
+ *                               reported during the first [outputs] outputs.
  *
  * Changelog
  *
  * 0.1 - Initial release 2012
  * 0.3 - Change to cmake and upload to github 20130701
+ * 0.4 - Block reads, vectorized energy kernel and multithreaded bins
+ *       sc16 and sc8 input formats
+ *       Multi-resolution energy pyramid
+ *       Sliding-window energy
+ *       Burst detector with sparse event output
+ *       Standard input and output streaming
  *
  *
  */
@@ -47,11 +102,37 @@
 #include <cstdlib>
 #include <cstdio>
 #include <cmath>
+#include <pthread.h>
 #include <unistd.h>
+
+#include "dsp_kernels.h"
+#include "energy_pyramid.h"
+#include "sliding_energy.h"
+#include "burst_detector.h"
+#include "stream_io.h"
+
 //Uncomment this to get gratuitous debug information
 //#define DEBUG 1
+
+//Approximate number of input bytes read per block
+#define __ENERGY_BLOCK_BYTES  (16*1024*1024)
+
 using namespace std;
 
+/*energy_thread_data
+ *
+ *Work description for one energy worker: bins consecutive bins of binSize
+ *samples starting at inputData are summed into results
+ */
+struct energy_thread_data
+{
+    const char*   inputData;      //interleaved I-Q input for the first bin
+    double*       results;        //one energy value per bin
+    int           bins;           //number of bins to compute
+    int           binSize;        //samples per bin
+    sample_format format;         //sample format of inputData
+};
+
 /*useage()
  *
  *Display program useage information
@@ -65,42 +146,68 @@ void useage();
  *data file, and we must have write permission for outputFileName.
  *
  *energyBinSize defines the number of samples summed for computing the energy
+ *max_children defines the number of threads the bins are spread across
+ *pyramidLevels/pyramidFactor describe the coarser outputs (see energy_pyramid.h)
+ *slidingWindow/slidingHop select the sliding-window mode when slidingWindow > 0
+ *eventsFileName enables the burst detector (see burst_detector.h) when not
+ *NULL, and outputFileName may then be NULL
  */
-int calculateTask( char* inputFileName, char* outputFileName, int energyBinSize );
+int calculateTask( char* inputFileName, char* outputFileName, int energyBinSize,
+                   int max_children, sample_format inputFormat,
+                   int pyramidLevels, int pyramidFactor,
+                   int slidingWindow, int slidingHop,
+                   char* eventsFileName, double threshold, double hysteresis,
+                   int floorTimeConstant );
 
-
-/*wrideData
+/*slidingTask
  *
- *Writes 4 bytes to the specified ofstream object
+ *Sliding-window version of the computation (see sliding_energy.h).  Runs on
+ *the calling thread.  detector may be NULL.
+ */
+int slidingTask( FILE* inputFile, energy_pyramid& outputFiles,
+                 burst_detector* detector,
+                 int slidingWindow, int slidingHop, sample_format inputFormat );
+
+/*energy_thread_start
  *
+ *pthread starting function for an energy worker.  See energy_thread_data
  */
-int writeData( FILE* outputFile, double data );
+void* energy_thread_start( void* energy_thread_arg );
 
+/*readBlock
+ *
+ *Reads up to samples complex samples of sampleSize bytes from inputFile.
+ *Returns the number of whole samples read.
+ */
+int readBlock( FILE* inputFile, char* buffer, int samples, int sampleSize );
 
 
 int main( int argc, char* argv[])
 {
-  //Ensure the correct number of arguments were passed
-  if( argc != 7){
-    cout << "Only " << argc << " parameters entered" << endl;
-    useage();
-    return -1;
-  }
-
   char* inputFileName = NULL;
   char* outputFileName = NULL;
+  char* eventsFileName = NULL;
   int   energyBinSize = 0;
+  int   max_children = 1;
+  int   pyramidLevels = 1;
+  int   pyramidFactor = 4;
+  int   slidingWindow = 0;
+  int   slidingHop = 0;
+  int   floorTimeConstant = 1000;
+  double threshold = 10;
+  double hysteresis = 3;
   int   arg = 0;
+  sample_format inputFormat = SAMPLE_FC32;
 
   //argument parsing
-  while( (arg = getopt( argc, argv, "i:o:s:")) != -1 ){
+  while( (arg = getopt( argc, argv, "i:o:s:b:c:F:p:m:W:H:E:T:Y:N:")) != -1 ){
 #ifdef DEBUG
     cout << "Arg: " << optarg << endl;
 #endif
     switch (arg){
 
     case 'i':
-      inputFileName = new char[sizeof(optarg)];
+      inputFileName = new char[strlen(optarg)+1];
       strcpy(inputFileName,optarg);
 #ifdef DEBUG
       cout << "Input Filename: " << inputFileName << endl;
@@ -108,7 +215,7 @@ int main( int argc, char* argv[])
       break;
 
     case 'o':
-      outputFileName = new char[sizeof(optarg)];
+      outputFileName = new char[strlen(optarg)+1];
       strcpy(outputFileName,optarg);
 #ifdef DEBUG
       cout << "Output Filename: " << outputFileName << endl;
@@ -116,31 +223,138 @@ int main( int argc, char* argv[])
       break;
 
     case 's':
+    case 'b':
       energyBinSize = atoi(optarg);
 #ifdef DEBUG
       cout << "Energy Bin Size: " << energyBinSize << endl;
 #endif
       break;
 
+    case 'c':
+      max_children = atoi(optarg);
+      break;
+
+    case 'p':
+      pyramidLevels = atoi(optarg);
+      break;
+
+    case 'm':
+      pyramidFactor = atoi(optarg);
+      break;
+
+    case 'W':
+      slidingWindow = atoi(optarg);
+      break;
+
+    case 'H':
+      slidingHop = atoi(optarg);
+      break;
+
+    case 'E':
+      eventsFileName = new char[strlen(optarg)+1];
+      strcpy(eventsFileName,optarg);
+      break;
+
+    case 'T':
+      threshold = atof(optarg);
+      break;
+
+    case 'Y':
+      hysteresis = atof(optarg);
+      break;
+
+    case 'N':
+      floorTimeConstant = atoi(optarg);
+      break;
+
+    case 'F':
+      if( parseSampleFormat( optarg, inputFormat ) )
+        break;
+      cout << "Unknown input format " << optarg << endl;
+      //fall through
     case '?':
       useage();
       if( inputFileName )
         delete [] inputFileName;
       if( outputFileName )
         delete [] outputFileName;
+      if( eventsFileName )
+        delete [] eventsFileName;
       return -1;
     }
   }
 
-  if( !calculateTask( inputFileName, outputFileName, energyBinSize ) ){
+  //Ensure the required arguments were passed
+  if( !inputFileName || ( !outputFileName && !eventsFileName ) ||
+      ( energyBinSize < 1 && slidingWindow < 1 ) ){
+    useage();
+    if( inputFileName )
+      delete [] inputFileName;
+    if( outputFileName )
+      delete [] outputFileName;
+    if( eventsFileName )
+      delete [] eventsFileName;
+    return -1;
+  }
+
+  //Data on standard output leaves the messages standard error
+  if( isStandardStream( outputFileName ) )
+    cout.rdbuf( cerr.rdbuf() );
+
+  //Check multithreading options
+  if( max_children < 1 ){
+    cout << "Need at least one child thread" << endl;
+    delete [] inputFileName;
+    delete [] outputFileName;
+    delete [] eventsFileName;
+    return -1;
+  }
+
+  //Check the pyramid options
+  if( pyramidLevels < 1 || pyramidFactor < 2 ||
+      ( pyramidLevels > 1 && isStandardStream( outputFileName ) ) ){
+    cout << "Need at least one pyramid level and a pyramid factor of 2 or more" << endl
+         << "(and a single level on standard output)" << endl;
+    delete [] inputFileName;
+    delete [] outputFileName;
+    delete [] eventsFileName;
+    return -1;
+  }
+
+  //Check the sliding-window options
+  if( slidingWindow > 0 && ( slidingHop < 1 || pyramidLevels > 1 ) ){
+    cout << "Sliding window needs a positive hop and cannot be combined with a pyramid" << endl;
+    delete [] inputFileName;
+    delete [] outputFileName;
+    delete [] eventsFileName;
+    return -1;
+  }
+
+  //Check the burst detector options
+  if( eventsFileName && ( floorTimeConstant < 1 || hysteresis < 0 ) ){
+    cout << "Need a positive noise floor time constant and a non-negative hysteresis" << endl;
+    delete [] inputFileName;
+    delete [] outputFileName;
+    delete [] eventsFileName;
+    return -1;
+  }
+
+  if( !calculateTask( inputFileName, outputFileName, energyBinSize,
+                      max_children, inputFormat,
+                      pyramidLevels, pyramidFactor,
+                      slidingWindow, slidingHop,
+                      eventsFileName, threshold, hysteresis,
+                      floorTimeConstant ) ){
     cout << "Error performing calculations" << endl;
     delete [] inputFileName;
     delete [] outputFileName;
+    delete [] eventsFileName;
     return 1;
   }
 
   delete [] inputFileName;
   delete [] outputFileName;
+  delete [] eventsFileName;
   return 0;
 }
 
@@ -150,22 +364,41 @@ void useage( )
   cout  << "Useage:\t " << endl
         << "-i <file>\t Input File" << endl
         << "-o <file>\t Output File" << endl
-        << "-s <size>\t Energy Bin Size" << endl;
+        << "-b <size>\t Energy Bin Size" << endl
+        << "-c <number>\t Number of Child Threads (default 1)" << endl
+        << "-F <format>\t Input Format (fc32, sc16 or sc8)" << endl
+        << "-p <levels>\t Energy Pyramid Levels (default 1)" << endl
+        << "-m <factor>\t Energy Pyramid Factor (default 4)" << endl
+        << "-W <size>\t Sliding Window Size" << endl
+        << "-H <size>\t Sliding Window Hop" << endl
+        << "-E <file>\t Burst Events File" << endl
+        << "-T <dB>\t Burst Threshold (default 10)" << endl
+        << "-Y <dB>\t Burst Hysteresis (default 3)" << endl
+        << "-N <outputs>\t Noise Floor Time Constant (default 1000)" << endl;
 }
 
 
-int calculateTask( char* inputFileName, char* outputFileName, int energyBinSize )
+int calculateTask( char* inputFileName, char* outputFileName, int energyBinSize,
+                   int max_children, sample_format inputFormat,
+                   int pyramidLevels, int pyramidFactor,
+                   int slidingWindow, int slidingHop,
+                   char* eventsFileName, double threshold, double hysteresis,
+                   int floorTimeConstant )
 {
-  const int FLOAT_SIZE = 4; //Number of bytes in a single-precision float
+  const int SAMPLE_SIZE = sampleFormatSize( inputFormat );
 
   FILE* inputFile;
-  FILE* outputFile;
+  energy_pyramid outputFiles;
+  int   outputFile;
+  burst_detector  events;
+  burst_detector* detector = NULL;
 
-  inputFile = fopen( inputFileName, "r");
+  inputFile = openInputStream( inputFileName );
 #ifdef DEBUG
   cout << "Input file open attempt." << endl;
 #endif
-  outputFile = fopen( outputFileName, "w" );
+  outputFile = initializePyramid( outputFiles, outputFileName, pyramidLevels,
+                                  pyramidFactor, true );
 #ifdef DEBUG
   cout << "Output file open attempt." << endl;
 #endif
@@ -175,62 +408,187 @@ int calculateTask( char* inputFileName, char* outputFileName, int energyBinSize
    *If not... gracefully exit.
    *We should really be throwing exceptions... but I'm feeling lazy
    */
+  if( eventsFileName && inputFile && outputFile ){
+    //Every output is one bin, or one window advancing by the hop
+    if( slidingWindow > 0 )
+      outputFile = initializeBurstDetector( events, eventsFileName, threshold,
+                                            hysteresis, floorTimeConstant,
+                                            slidingHop, slidingWindow );
+    else
+      outputFile = initializeBurstDetector( events, eventsFileName, threshold,
+                                            hysteresis, floorTimeConstant,
+                                            energyBinSize, energyBinSize );
+    if( outputFile )
+      detector = &events;
+    else
+      closePyramid( outputFiles );
+  }
+
   if( !inputFile || !outputFile){
 #ifdef DEBUG
     cout << "Input File " << inputFileName << " Open? " << (inputFile ? "True" : "False") << endl;
-    cout << "Output File " << outputFileName << " Open? " << (outputFile ? "True" : "False") << endl;
+    cout << "Output File " << (outputFileName ? outputFileName : eventsFileName) << " Open? " << (outputFile ? "True" : "False") << endl;
 #endif
     if( inputFile )
-      fclose( inputFile );
+      closeStream( inputFile );
     if( outputFile )
-      fclose( outputFile );
+      closePyramid( outputFiles );
     return 0;
   }
 #ifdef DEBUG
   cout << "Input/Output files opened successfully." << endl;
 #endif
 
-  float i = 0;
-  float q = 0;
-
-  double mag = 0;
-  int    iterator = 0;
-
-  while( !feof(inputFile) ){
-      //Read in the I-Q of one sample... FLOAT_SIZE bytes per float
-      fread( &i, FLOAT_SIZE, 1, inputFile );
-      fread( &q, FLOAT_SIZE, 1, inputFile );
-
-      //Ensure we're calling the double version of pow, otherwise data is lost
-      mag += pow(static_cast<double>(i),2.) + pow(static_cast<double>(q),2.);
-
-      //Reached the end of the bin?
-      if( ++iterator == energyBinSize){
-        iterator = 0;
-        //If so, write 4 bytes
-        if( !writeData( outputFile, mag ) ){
-          fclose(inputFile);
-          fclose(outputFile);
-          return 0;
-        }
-        mag = 0;
+  if( slidingWindow > 0 ){
+    int return_code = slidingTask( inputFile, outputFiles, detector,
+                                   slidingWindow, slidingHop, inputFormat );
+    closeStream( inputFile );
+    closePyramid( outputFiles );
+    if( detector )
+      closeBurstDetector( *detector );
+    return return_code;
+  }
+
+  //Size the blocks as a whole number of bins within __ENERGY_BLOCK_BYTES,
+  //unless a single bin needs more.  Bins this large leave some workers idle.
+  const size_t binBytes     = static_cast<size_t>(SAMPLE_SIZE) * energyBinSize;
+  int          binsPerBlock = static_cast<int>(__ENERGY_BLOCK_BYTES / binBytes);
+  if( binsPerBlock < 1 )
+    binsPerBlock = 1;
+  int          blockSamples = binsPerBlock * energyBinSize;
+
+  //Two input blocks so the next read overlaps the current computation
+  char*   inputData[2];
+  int     samplesRead[2];
+  double* results       = new double[binsPerBlock];
+  inputData[0]          = new char[binsPerBlock*binBytes];
+  inputData[1]          = new char[binsPerBlock*binBytes];
+
+  pthread_t*                  energy_children = new pthread_t[max_children];
+  struct energy_thread_data*  energy_args     = new energy_thread_data[max_children];
+  int                         return_code     = 1;
+  int                         current         = 0;
+
+  samplesRead[current] = readBlock( inputFile, inputData[current], blockSamples,
+                                    SAMPLE_SIZE );
+
+  while( samplesRead[current] >= energyBinSize && return_code ){
+    //Toss out any leftovers (incomplete energy bin)
+    int bins      = samplesRead[current] / energyBinSize;
+    int children  = bins < max_children ? bins : max_children;
+    int first     = 0;
+
+    //Spread the bins of this block evenly across the workers
+    for( int i = 0; i < children; i++ ){
+      int count = bins / children + ( i < bins % children ? 1 : 0 );
+      energy_args[i].inputData  = inputData[current] + first*binBytes;
+      energy_args[i].results    = results + first;
+      energy_args[i].bins       = count;
+      energy_args[i].binSize    = energyBinSize;
+      energy_args[i].format     = inputFormat;
+      first += count;
+
+      int rc = pthread_create( &energy_children[i], NULL, energy_thread_start,
+                               reinterpret_cast<void *>(&(energy_args[i])) );
+      if( rc ){
+        cout << "ERROR; return code from pthread_create() is " << rc << endl;
+        children    = i;
+        return_code = 0;
+        break;
       }
+    }
+
+    //Read the next block while the workers run.  A short block means we hit
+    //EOF, so there is nothing left to read afterwards.
+    int next = 1 - current;
+    samplesRead[next] = 0;
+    if( return_code && samplesRead[current] == blockSamples )
+      samplesRead[next] = readBlock( inputFile, inputData[next], blockSamples,
+                                     SAMPLE_SIZE );
+
+    for( int i = 0; i < children; i++ )
+      pthread_join( energy_children[i], NULL );
+
+    if( return_code && !pushPyramid( outputFiles, results, bins ) )
+      return_code = 0;
+    if( return_code && detector && !pushBurstDetector( *detector, results, bins ) )
+      return_code = 0;
+#ifdef DEBUG
+    cout << ".";
+#endif
+    current = next;
   }
-  //Toss out any leftovers (incomplete energy bin)
-  fclose(inputFile);
-  fclose(outputFile);
+
+  closeStream( inputFile );
+  closePyramid( outputFiles );
+  if( detector )
+    closeBurstDetector( *detector );
 #ifdef DEBUG
   cout << endl << "Files Closed." << endl;
 #endif
-  return 1;
+
+  delete [] inputData[0];
+  delete [] inputData[1];
+  delete [] results;
+  delete [] energy_children;
+  delete [] energy_args;
+  return return_code;
 }
 
-int writeData( FILE* outputFile, double data )
+int slidingTask( FILE* inputFile, energy_pyramid& outputFiles,
+                 burst_detector* detector,
+                 int slidingWindow, int slidingHop, sample_format inputFormat )
 {
-  const int DOUBLE_SIZE = 8; //Number of bytes in a single-precision float
-  fwrite(&data, DOUBLE_SIZE, 1, outputFile);
-#ifdef DEBUG
-  cout << ".";
-#endif
-  return 1;
+  const int SAMPLE_SIZE = sampleFormatSize( inputFormat );
+
+  //Same block size as the binned mode
+  int blockSamples = __ENERGY_BLOCK_BYTES / SAMPLE_SIZE;
+
+  sliding_energy slider;
+  initializeSlidingEnergy( slider, slidingWindow, slidingHop );
+
+  char*   inputData   = new char[blockSamples*SAMPLE_SIZE];
+  double* results     = new double[slidingEnergyOutputs( slider, blockSamples )];
+  int     samplesRead = 0;
+  int     return_code = 1;
+
+  while( return_code &&
+         (samplesRead = readBlock( inputFile, inputData, blockSamples, SAMPLE_SIZE )) > 0 ){
+    int outputs = pushSlidingEnergy( slider, inputFormat, inputData,
+                                     samplesRead, results );
+    if( outputs && !pushPyramid( outputFiles, results, outputs ) )
+      return_code = 0;
+    if( outputs && detector && !pushBurstDetector( *detector, results, outputs ) )
+      return_code = 0;
+  }
+
+  destroySlidingEnergy( slider );
+  delete [] inputData;
+  delete [] results;
+  return return_code;
+}
+
+void* energy_thread_start( void* energy_thread_arg )
+{
+  struct energy_thread_data* my_data;
+  my_data = reinterpret_cast<energy_thread_data*>(energy_thread_arg);
+
+  const int SAMPLE_SIZE = sampleFormatSize( my_data->format );
+
+  for( int i = 0; i < my_data->bins; i++ )
+    my_data->results[i] = energy( my_data->format,
+                                  my_data->inputData +
+                                    static_cast<size_t>(i)*my_data->binSize*SAMPLE_SIZE,
+                                  my_data->binSize );
+
+  pthread_exit(NULL);
+}
+
+int readBlock( FILE* inputFile, char* buffer, int samples, int sampleSize )
+{
+  //fread only comes up short at EOF (or on error), so one call per block is
+  //enough.  Any trailing partial sample is dropped.
+  size_t bytes_read = fread( buffer, 1, static_cast<size_t>(samples)*sampleSize,
+                             inputFile );
+  return static_cast<int>(bytes_read / sampleSize);
 }
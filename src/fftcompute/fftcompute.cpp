@@ -23,12 +23,22 @@
  *
  * -i [file]       Input File   -This input file is expected to contain
  *                               raw complex float data representing recorded
- *                               samples (from MATLAB, GNU Radio, etc.)
+ *                               samples (from MATLAB, GNU Radio, etc.)  "-"
+ *                               reads standard input, e.g. a decompressed or
+ *                               network-relayed capture in a pipeline.
+ *
+ * -F [format]     Input Format -Sample format of the input file: fc32
+ *                               (default), sc16 or sc8.  Integer samples are
+ *                               converted to float and windowed in the same
+ *                               pass, so usrp-record sc16 captures can be used
+ *                               directly.
  *
  * -o [file]       Output File  -The output file contains raw float data
  *                               representing the computed spectral periodigram
  *                               of the recorded signal.  The peridigram is
- *                               computed with fftw3f's 1D DFT.
+ *                               computed with fftw3f's 1D DFT.  "-" writes to
+ *                               standard output; messages then go to standard
+ *                               error.
  *
  * -s [size]       FFT Size     -Size of the FFT to compute
  *
@@ -47,6 +57,16 @@
  *                               input array to fftw3f, and zero-pads the
  *                               remaining values.
  *
+ * -P [taps]       PFB Taps     -Run a critically sampled polyphase filter
+ *                               bank channelizer with this many taps per
+ *                               channel instead of the windowed FFT (default
+ *                               1, off).  Every frame then spans
+ *                               (FFT Size)*taps samples, consecutive frames
+ *                               are (FFT Size)/Overlap samples apart (use -l 1
+ *                               for critical sampling), and the prototype
+ *                               filter replaces the window file.  See
+ *                               polyphase.h.
+ *
  * -c [children]   Child Threads-This specifies the number of child worker
  *                               threads to spawn for FFTCompute.  If your
  *                               processor has N cores (including hyperthreading
@@ -55,6 +75,25 @@
  *                               to process the input data for a total of N
  *                               threads.
  *
+ * -q [bits]       Quantize     -Write every bin as an 8 or 16-bit dB code
+ *                               instead of a 32-bit float magnitude (default
+ *                               32, no quantization).  The output file then
+ *                               starts with a header holding the scale, see
+ *                               spectrum_format.h.
+ *
+ * -B [dB]         Reference    -dB of code 0 (default -100)
+ *
+ * -U [dB]         Step         -dB per code (default 0.5 for 8 bits, 0.005
+ *                               for 16 bits)
+ *
+ * -k [list]       Bins         -Only compute and write these bins of every
+ *                               frame: a comma separated list of output bin
+ *                               numbers and first:last ranges, where 0 is the
+ *                               most negative frequency and (FFT Size)/2 is
+ *                               DC.  A handful of bins is computed with
+ *                               Goertzel filters instead of the FFT, see
+ *                               bin_selection.h.
+ *
  *
  *
  *Description of error messages:
@@ -63,6 +102,12 @@
  *  Worker threads spawn from the parent process.  You must specify at least
  *  one child thread to do the FFT calculations.
  *
+ *Quantization must be 8, 16 or 32 bits
+ *  -q only accepts those widths.
+ *
+ *Cannot parse bin selection
+ *  The -k list is malformed or names a bin outside the frame.
+ *
  *Cannot open window file
  *  There was a problem opening the window file.
  *
@@ -111,7 +156,7 @@
  *compute about 120,000 FFTs of size 1024 per second with 7 worker threads.
  *
  *This program is the post-processing equivalent of usrp-sensor.  usrp-record
- *data may be used if configured to record fc32 data
+ *data may be used directly in any of its host formats (see -F)
  *
  */
 
@@ -126,6 +171,11 @@
 #include <unistd.h>
 
 #include "fft_thread.h"
+#include "dsp_kernels.h"
+#include "spectrum_format.h"
+#include "bin_selection.h"
+#include "polyphase.h"
+#include "stream_io.h"
 
 #ifdef BENCHMARK
 #include <ctime>
@@ -170,16 +220,22 @@ int initializeThreads( pthread_mutex_t& mutex, pthread_mutex_t& attr,
                        struct fft_thread_data*& fft_child_args,
                        FILE*& outputFile, fftwf_plan*& plans,
                        _Complex float**& inputData, _Complex float**& outputData,
-                       float*& window, int FFTSize, int*& thread_control );
+                       float*& window, int FFTSize, int*& thread_control,
+                       const spectrum_format& format,
+                       const bin_selection* bins, int taps );
 
 /*calculateTask(...)
  *
  *This is the main work of the program, performing the specified overlapped
- *FFT transforms
+ *FFT transforms and writing them in the given output format.  A non-NULL
+ *bins writes only the selected bins.  With pfbTaps > 1 window is the
+ *(FFTSize*pfbTaps)-point prototype of a polyphase filter bank.
  */
 int calculateTask(  char* inputFileName, char* outputFileName,
                     int FFTSize, int FFTOverlap, int max_children,
-                    float* window );
+                    float* window, sample_format inputFormat,
+                    const spectrum_format& outputFormat,
+                    const bin_selection* bins, int pfbTaps );
 
 
 
@@ -199,35 +255,33 @@ int main( int argc, char* argv[])
     const int FLOAT_SIZE = sizeof(float); //Size of single-precision float
     //in bytes
 
-    //Ensure the correct number of arguments were passed
-    if( argc != 11)
-    {
-        cout << "Only " << argc << " parameters entered" << endl;
-        useage();
-        return -1;
-    }
-
     char  *inputFileName  = NULL;
     char  *outputFileName = NULL;
     char  *windowFileName = NULL;
+    char  *binList        = NULL;
     int   FFTSize         = 0;
     int   FFTOverlap      = 0;
+    int   pfbTaps         = 1;
     int   arg             = 0;
     int   max_children    = 0;
+    sample_format inputFormat = SAMPLE_FC32;
+    int   quantizeBits    = 32;
+    float dbReference     = __SPECTRUM_REFERENCE;
+    float dbStep          = 0;
 
     //argument parsing
-    while( (arg = getopt( argc, argv, "i:o:s:l:c:w:")) != -1 )
+    while( (arg = getopt( argc, argv, "i:o:s:l:c:w:F:q:B:U:k:P:")) != -1 )
     {
         switch (arg)
         {
 
         case 'i':
-            inputFileName = new char[strlen(optarg)];
+            inputFileName = new char[strlen(optarg)+1];
             strcpy(inputFileName,optarg);
             break;
 
         case 'o':
-            outputFileName = new char[strlen(optarg)];
+            outputFileName = new char[strlen(optarg)+1];
             strcpy(outputFileName,optarg);
             break;
 
@@ -239,25 +293,75 @@ int main( int argc, char* argv[])
             FFTOverlap = atoi(optarg);
             break;
 
+        case 'P':
+            pfbTaps = atoi(optarg);
+            break;
+
         case 'c':
             max_children = atoi(optarg);
             break;
 
         case 'w':
-            windowFileName = new char[strlen(optarg)];
+            windowFileName = new char[strlen(optarg)+1];
             strcpy(windowFileName,optarg);
             break;
 
+        case 'q':
+            quantizeBits = atoi(optarg);
+            break;
+
+        case 'B':
+            dbReference = atof(optarg);
+            break;
+
+        case 'U':
+            dbStep = atof(optarg);
+            break;
+
+        case 'k':
+            binList = new char[strlen(optarg)+1];
+            strcpy(binList,optarg);
+            break;
+
+        case 'F':
+            if( parseSampleFormat( optarg, inputFormat ) )
+                break;
+            cout << "Unknown input format " << optarg << endl;
+            //fall through
         case '?':
             useage();
             if( inputFileName )
                 delete [] inputFileName;
             if( outputFileName )
                 delete [] outputFileName;
+            if( windowFileName )
+                delete [] windowFileName;
+            if( binList )
+                delete [] binList;
             return -1;
         }
     }
 
+    //Data on standard output leaves the messages standard error
+    if( isStandardStream( outputFileName ) )
+        cout.rdbuf( cerr.rdbuf() );
+
+    //Ensure the required arguments were passed
+    if( !inputFileName || !outputFileName || FFTSize < 1 || FFTOverlap < 1 ||
+        pfbTaps < 1 )
+    {
+        useage();
+        if( inputFileName )
+            delete [] inputFileName;
+        if( outputFileName )
+            delete [] outputFileName;
+        if( windowFileName )
+            delete [] windowFileName;
+        if( binList )
+            delete [] binList;
+        return -1;
+    }
+
     //Check FFT and Overlap compatibility
     if( FFTSize % FFTOverlap )
     {
@@ -276,10 +380,42 @@ int main( int argc, char* argv[])
         return -1;
     }
 
-    float* window = new float[FFTSize];
+    //Check the output format
+    spectrum_format outputFormat;
+    if( !initializeSpectrumFormat( outputFormat, quantizeBits, dbReference,
+                                   dbStep ) )
+    {
+        cout  << "Quantization must be 8, 16 or 32 bits" << endl;
+        return -1;
+    }
+
+    //Check the bin selection
+    bin_selection  selection;
+    bin_selection* bins = NULL;
+    if( binList )
+    {
+        if( !parseBinSelection( binList, FFTSize, selection ) )
+        {
+            cout  << "Cannot parse bin selection " << binList << endl;
+            return -1;
+        }
+        bins = &selection;
+        cout  << "Computing " << selection.count << " bins with "
+              << ( selection.goertzel ? "Goertzel filters" : "the FFT" ) << endl;
+    }
+
+    //A filter bank replaces the window with its prototype filter
+    float* window = pfbTaps > 1 ? pfbPrototype( FFTSize, pfbTaps )
+                                : new float[FFTSize];
     FILE* window_file;
-    window_file = fopen( windowFileName, "r" );
-    if( !window_file )
+    window_file = windowFileName && pfbTaps == 1 ? fopen( windowFileName, "r" )
+                                                 : NULL;
+    if( pfbTaps > 1 )
+    {
+        cout << "Polyphase filter bank with " << pfbTaps
+             << " taps per channel" << endl;
+    }
+    else if( !window_file )
     {
         cout << "Cannot open window file" << endl
              << "Assuming Uniform Window" << endl;
@@ -307,6 +443,8 @@ int main( int argc, char* argv[])
           delete [] outputFileName;
           delete [] windowFileName;
           delete [] window;
+          if( bins )
+              destroyBinSelection( selection );
           fclose( window_file );
           return 1;
       }
@@ -329,13 +467,16 @@ int main( int argc, char* argv[])
 
 
     if( !calculateTask( inputFileName, outputFileName, FFTSize, FFTOverlap,
-                        max_children, window ) )
+                        max_children, window, inputFormat, outputFormat,
+                        bins, pfbTaps ) )
     {
         cout << "Error performing calculations" << endl;
         delete [] inputFileName;
         delete [] outputFileName;
         delete [] windowFileName;
         delete [] window;
+        if( bins )
+            destroyBinSelection( selection );
         return 1;
     }
 
@@ -343,6 +484,9 @@ int main( int argc, char* argv[])
     delete [] outputFileName;
     delete [] windowFileName;
     delete [] window;
+    if( bins )
+        destroyBinSelection( selection );
+    delete [] binList;
     return 0;
 }
 
@@ -366,7 +510,13 @@ void useage( )
           << "-s <size>\t FFT Size" << endl
           << "-l <number>\t FFT Overlap" << endl
           << "-c <number>\t Number of Child Processes" << endl
-          << "-w <file>\t Window File" << endl;
+          << "-w <file>\t Window File" << endl
+          << "-P <taps>\t PFB Taps per Channel (default 1, off)" << endl
+          << "-F <format>\t Input Format (fc32, sc16 or sc8)" << endl
+          << "-q <bits>\t Output Bits per Bin (8, 16 or 32)" << endl
+          << "-B <dB>\t Quantization Reference (default -100)" << endl
+          << "-U <dB>\t Quantization Step" << endl
+          << "-k <list>\t Output Bins (b1,b2,first:last,...)" << endl;
 }
 
 
@@ -382,8 +532,8 @@ void useage( )
 int openFiles( char* inputFileName, FILE*& inputFile,
                char* outputFileName, FILE*& outputFile )
 {
-    inputFile = fopen( inputFileName, "r");
-    outputFile = fopen( outputFileName, "w" );
+    inputFile = openInputStream( inputFileName );
+    outputFile = openOutputStream( outputFileName );
 
     /*Make sure the files actually opened.
      *
@@ -393,9 +543,9 @@ int openFiles( char* inputFileName, FILE*& inputFile,
     if( !inputFile || !outputFile)
     {
         if( inputFile )
-            fclose( inputFile );
+            closeStream( inputFile );
         if( outputFile )
-            fclose( outputFile );
+            closeStream( outputFile );
         return 0;
     }
     return 1;
@@ -453,7 +603,9 @@ int initializeThreads( pthread_mutex_t& mutex, pthread_mutexattr_t& attr,
                        struct fft_thread_data*& fft_child_args,
                        FILE*& outputFile, fftwf_plan*& plans,
                        _Complex float**& inputData, _Complex float**& outputData,
-                       float*& window, int FFTSize, int*& thread_control )
+                       float*& window, int FFTSize, int*& thread_control,
+                       const spectrum_format& format,
+                       const bin_selection* bins, int taps )
 {
     //mutex attribute -> PTHREAD_MUTEX_NORMAL
     pthread_mutexattr_init( &attr );
@@ -489,6 +641,17 @@ int initializeThreads( pthread_mutex_t& mutex, pthread_mutexattr_t& attr,
             return 0;
         fft_child_args[i].my_id         = i;
         fft_child_args[i].window        = window;
+        fft_child_args[i].taps          = taps;
+        fft_child_args[i].frameData     = taps > 1 ?
+                                          new _Complex float[FFTSize*taps] :
+                                          inputData[i];
+        fft_child_args[i].accumulator   = NULL;
+        fft_child_args[i].pending       = NULL;
+        fft_child_args[i].format        = format;
+        fft_child_args[i].shm           = NULL;
+        fft_child_args[i].bins          = bins;
+        fft_child_args[i].magnitude     = NULL;
+        fft_child_args[i].codes         = NULL;
         fft_child_args[i].next_thread   = thread_control;
         fft_child_args[i].max_children  = max_children;
         sprintf(fft_child_args[i].mq_name,"/fft_thread_%i",i);
@@ -538,15 +701,17 @@ int initializeThreads( pthread_mutex_t& mutex, pthread_mutexattr_t& attr,
 *******************************************************************************/
 int calculateTask(  char* inputFileName, char* outputFileName, int FFTSize,
                     int FFTOverlap, int max_children,
-                    float* window )
+                    float* window, sample_format inputFormat,
+                    const spectrum_format& outputFormat,
+                    const bin_selection* bins, int pfbTaps )
 {
     ///////////////////////////////////////////////////////////
     //
     //Initialization Section
     ///////////////////////////////////////////////////////////
 
-    //Number of bytes in a single-precision float
-    const int   FLOAT_COMPLEX_SIZE  = sizeof(_Complex float);
+    //Number of bytes in one input sample
+    const int   SAMPLE_SIZE         = sampleFormatSize( inputFormat );
     const char  msg_thread_start    = static_cast<char>(__FFT_THREAD_START);
     const char  msg_thread_kill     = static_cast<char>(__FFT_THREAD_KILL);
 
@@ -556,6 +721,13 @@ int calculateTask(  char* inputFileName, char* outputFileName, int FFTSize,
 
     if(!openFiles( inputFileName, inputFile, outputFileName, outputFile ))
         return 0;
+    if( !writeSpectrumHeader( outputFile, outputFormat,
+                              bins ? bins->count : FFTSize ) )
+    {
+        closeStream( inputFile );
+        closeStream( outputFile );
+        return 0;
+    }
 
     //Create some FFT Plans
     fftwf_plan     *plans       = NULL;
@@ -574,9 +746,17 @@ int calculateTask(  char* inputFileName, char* outputFileName, int FFTSize,
     struct fft_thread_data  *fft_child_args = NULL;
     int                     *thread_control = NULL;
 
+    //The window or PFB prototype (and the integer scaling) is applied while
+    //the frame is assembled, so the workers get a NULL window
+    const int frameLength = FFTSize*pfbTaps;
+    float* noWindow = NULL;
+    float* window2  = interleaveWindow( window, frameLength,
+                                        sampleFormatScale( inputFormat ) );
+
     if( !initializeThreads( output_mutex, output_mutex_attr, fft_children, fft_mq,
                             ma, max_children, fft_child_args, outputFile, plans,
-                            inputData, outputData, window, FFTSize, thread_control ))
+                            inputData, outputData, noWindow, FFTSize, thread_control,
+                            outputFormat, bins, pfbTaps ))
     {
         //Cleanup for a graceful exit
         //We have to check to see if things exist before deleting them because
@@ -626,9 +806,12 @@ int calculateTask(  char* inputFileName, char* outputFileName, int FFTSize,
             {
                 if( fft_child_args[i].mq_name )
                     delete [] fft_child_args[i].mq_name;
+                if( pfbTaps > 1 && fft_child_args[i].frameData )
+                    delete [] fft_child_args[i].frameData;
             }
             delete [] fft_child_args;
         }
+        delete [] window2;
         return 0;
     }
 
@@ -636,7 +819,7 @@ int calculateTask(  char* inputFileName, char* outputFileName, int FFTSize,
 
     //Setup the input buffer and tracking variables
     int             fft_interval_size = FFTSize / FFTOverlap;
-    _Complex float*  input_buffer      = new _Complex float[FFTSize];
+    char*           input_buffer      = new char[frameLength*SAMPLE_SIZE];
     int             head              = 0;
     int             child_tracker     = 0;
     bool            isFirst           = true;
@@ -662,8 +845,8 @@ int calculateTask(  char* inputFileName, char* outputFileName, int FFTSize,
     while( !feof(inputFile) && return_code )
     {
         //Read in the I-Q of fft_interval_size samples...
-        //FLOAT_COMPLEX_SIZE bytes per float
-        bytes_read = fread( &input_buffer[head], FLOAT_COMPLEX_SIZE,
+        //SAMPLE_SIZE bytes per sample
+        bytes_read = fread( input_buffer+head*SAMPLE_SIZE, SAMPLE_SIZE,
                             fft_interval_size, inputFile );
 
         if( bytes_read != static_cast<unsigned int>(fft_interval_size))
@@ -675,7 +858,7 @@ int calculateTask(  char* inputFileName, char* outputFileName, int FFTSize,
         //Time to take an FFT yet?
         if( !isFull )
         {
-            if( head == (FFTSize - fft_interval_size) )
+            if( head == (frameLength - fft_interval_size) )
                 isFull = true;
             else
                 head += fft_interval_size;
@@ -687,7 +870,7 @@ int calculateTask(  char* inputFileName, char* outputFileName, int FFTSize,
             {
                 //rotate the buffer
                 head += fft_interval_size;
-                if( head == FFTSize )
+                if( head == frameLength )
                     head = 0;
             }
             else
@@ -703,12 +886,17 @@ int calculateTask(  char* inputFileName, char* outputFileName, int FFTSize,
                 //terminate until we generate a _THREAD_KILL command
                 //So instead we wait for the running flag to go false
             }
-            //Copy the buffer into the FFT input data
-            memmove( fft_child_args[child_tracker].inputData,
-                     input_buffer+head, FLOAT_COMPLEX_SIZE * (FFTSize-head) );
-
-            memmove( fft_child_args[child_tracker].inputData+FFTSize-head,
-                     input_buffer, FLOAT_COMPLEX_SIZE * head );
+            //Convert and window the buffer into the FFT input data
+            //(oldest samples first, so this is a 2-part copy)
+            float* frame = reinterpret_cast<float*>(fft_child_args[child_tracker].frameData);
+            convertWindow( inputFormat, input_buffer+head*SAMPLE_SIZE,
+                           window2, frame, frameLength-head );
+            convertWindow( inputFormat, input_buffer,
+                           window2+2*(frameLength-head), frame+2*(frameLength-head),
+                           head );
+            //Mark the worker busy before handing it the frame, so we never
+            //overwrite a frame the worker has not picked up yet
+            fft_child_args[child_tracker].is_running = true;
             //Send a message to the worker to compute the FFT
             mq_send( fft_mq[child_tracker], &msg_thread_start,
                      __FFT_THREAD_MSG_LENGTH, __FFT_THREAD_MSG_PRIO );
@@ -721,7 +909,7 @@ int calculateTask(  char* inputFileName, char* outputFileName, int FFTSize,
 
     float seconds = b.tv_sec - a.tv_sec;
     seconds += b.tv_usec/1000000.0f - a.tv_usec/1000000.0f;
-    printf("ET: %.6f s\n",seconds);
+    fprintf(outputFile == stdout ? stderr : stdout, "ET: %.6f s\n",seconds);
 #endif
     ///////////////////////////////////////////////////////////
     //
@@ -740,15 +928,21 @@ int calculateTask(  char* inputFileName, char* outputFileName, int FFTSize,
         }
     }
 
+    //Stop the workers before their buffers go away
+    for(int i = 0; i < max_children; i++)
+    {
+        mq_send( fft_mq[i], &msg_thread_kill,
+                 __FFT_THREAD_MSG_LENGTH, __FFT_THREAD_MSG_PRIO );
+        pthread_join( fft_children[i], NULL );
+    }
+
     //Toss out any leftovers and cleanup
-    fclose(inputFile);
-    fclose(outputFile);
+    closeStream( inputFile );
+    closeStream( outputFile );
 
     //Destroy plans
     for(int i = 0; i < max_children; i++)
     {
-        mq_send( fft_mq[i], &msg_thread_kill,
-                 __FFT_THREAD_MSG_LENGTH, __FFT_THREAD_MSG_PRIO );
         fftwf_destroy_plan(plans[i]);
         delete [] inputData[i];
         delete [] outputData[i];
@@ -767,6 +961,8 @@ int calculateTask(  char* inputFileName, char* outputFileName, int FFTSize,
     for( int i = 0; i < max_children; i++ )
     {
         delete [] fft_child_args[i].mq_name;
+        if( pfbTaps > 1 )
+            delete [] fft_child_args[i].frameData;
     }
 
     delete [] plans;
@@ -775,7 +971,10 @@ int calculateTask(  char* inputFileName, char* outputFileName, int FFTSize,
     delete [] ma;
     delete [] fft_mq;
     delete [] fft_child_args;
+    delete [] fft_children;
+    delete thread_control;
     delete [] input_buffer;
+    delete [] window2;
 
     return 1;
 }
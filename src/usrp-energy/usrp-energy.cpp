@@ -23,8 +23,11 @@
  *
  * -o [file]       Output File  -The output file contains raw float data
  *                               representing the computed energy in each bin.
+ *                               Optional when -E is given.
  *
- * -b [size]       Bin Size     -Energy bin size in samples
+ * -b [size]       Bin Size     -Energy bin size in samples.  A buffer that
+ *                               comes up short (e.g. after an overflow) makes
+ *                               no bin and no index record.
  *
  * -a [args]       USRP Args    -Specify the address for the input USRP. See
  *               http://files.ettus.com/uhd_docs/manual/html/identification.html
@@ -43,21 +46,82 @@
  *
  * -g [gain]       RX Gain      -Gain in DB of the rx chain
  *
+ * -p [levels]     Pyramid      -Number of energy resolutions to compute in
+ *                               one pass (default 1).  Level n has a bin size
+ *                               of (Bin Size)*factor^n and is written to
+ *                               "[Output File].L[n]".
+ *
+ * -m [factor]     Pyramid Step -Number of level n bins summed into one level
+ *                               n+1 bin (default 4)
+ *
+ * -W [size]       Window       -Sliding-window mode: each output is the energy
+ *                               of the last [size] samples.  Replaces -b.
+ *
+ * -H [size]       Hop          -Samples between sliding-window outputs.
+ *                               Windows overlap when the hop is smaller than
+ *                               the window.  Each output costs O(1) thanks to
+ *                               running prefix sums.  Cannot be combined with
+ *                               -p.
+ *
+ * -E [file]       Events File  -Run the burst detector on the energy bins (or
+ *                               sliding windows) and write start/stop events
+ *                               with sample timestamps to this text file.  See
+ *                               burst_detector.h for the format.
+ *
+ * -T [dB]         Threshold    -Burst start level above the noise floor
+ *                               (default 10)
+ *
+ * -Y [dB]         Hysteresis   -A burst stops once its energy drops this far
+ *                               below the start threshold (default 3)
+ *
+ * -N [outputs]    Floor Time   -Time constant of the adaptive noise floor in
+ *                               energy outputs (default 1000).  No bursts are
+ *                               reported during the first [outputs] outputs.
+ *
+ * -C [list]       Channels     -Comma separated list of the channels to
+ *                               process (default 0).  All channels are tuned
+ *                               to the same frequency and gain and start on the
+ *                               same sample.  With more than one channel, the
+ *                               outputs of channel N go to "[Output File].chN"
+ *                               and "[Events File].chN".
+ *
+ * -R [source]     Time Source  -Set the device time to UNIX time before
+ *                               streaming: "gpsdo", "external" (PPS input) or
+ *                               "host".  Falls back to "host" when the source
+ *                               is not available.
+ *
+ * -Z [time]       Start Time   -Start streaming at this device time (UNIX
+ *                               seconds).  Implies -R host unless -R is given.
+ *
+ * -I [file]       Index File   -Write the time stamp of every energy bin (or
+ *                               sliding window) to this file (see
+ *                               usrp_common.h for the 24-byte record).  Only
+ *                               the finest pyramid level is indexed: bin k of
+ *                               level n starts with bin k*factor^n of level 0.
+ *                               Channel N uses "[Index File].chN".
+ *
+ * -O [format]     Wire Format  -Sample format between the device and the host:
+ *                               sc16 (default) or sc8.  sc8 halves the link
+ *                               load, so about twice the sample rate fits.
+ *
+ * -F [format]     Host Format  -Sample format UHD hands to the program: fc32
+ *                               (default), sc16 or sc8.  The energy kernels
+ *                               work on the integer formats directly, which
+ *                               skips UHD's float conversion altogether.
+ *
  * Changelog
  *
  * 0.1 - Initial release 2012
  * 0.3 - Change to cmake and upload to github 20130701
+ * 0.4 - Multi-resolution energy pyramid
+ *       Sliding-window energy
+ *       Burst detector with sparse event output
+ *       Multi-channel receive
+ *       Timed stream start and per-bin time stamps
+ *       Wire and host formats selected at runtime
  */
 
 //Define some of the values we use to setup the USRP and FFT process
-#define __USRP_CPU_FMT  "fc32"
-
-#ifdef WIRE_SC8
-  #define __USRP_WIRE_FMT "sc8"
-#else
-  #define __USRP_WIRE_FMT "sc16"
-#endif
-
 #define __USRP_CLK_SRC  "internal"
 
 //USRP Headers
@@ -75,8 +139,24 @@
 #include <cstdlib>
 #include <unistd.h>
 
+#include "energy_pyramid.h"
+#include "sliding_energy.h"
+#include "burst_detector.h"
+#include "usrp_common.h"
+
 using namespace std;
 
+/*energy_channel
+ *
+ *Energy pipeline of one receive channel
+ */
+struct energy_channel
+{
+  energy_pyramid  outputFiles;    //energy bins (and coarser levels)
+  burst_detector  detector;       //only used with an events file
+  sliding_energy  slider;         //only used in sliding-window mode
+};
+
 /*useage()
  *
  *Display program useage information
@@ -84,33 +164,56 @@ using namespace std;
  */
 void useage();
 
-/*openFiles( char*, FILE*&, char*, FILE*& )
- *
- *Open the input and output files, and perform error handling if there is a
- *catastrophic failure
- */
-int openFiles( const char*  outputFileName,
-               FILE*&       outputFile );
-
-
 /*setupUSRP(...)
  *
- *Setup the USRP for receiving at the specified freq and rate
+ *Setup the USRP for receiving at the specified freq and rate on every channel
  */
 int setupUSRP(  uhd::usrp::multi_usrp::sptr&  usrp,
                 const float                   center_freq,
                 const float                   sample_rate,
                 const int                     rx_gain,
+                const vector<size_t>&         channels,
                 const char*                   dev_addr);
 
 
 
 
+/*calculateTask(...)
+ *
+ *This is the main work of the program, computing binSize-sample energy bins
+ *and the coarser pyramid levels from the USRP stream.  A slidingWindow > 0
+ *selects sliding-window energy instead of bins.  A non-NULL eventsFileName
+ *runs the burst detector on the energy outputs, and outputFileName may then
+ *be NULL.  Every channel runs its own pipeline into its own files.  A
+ *positive startTime starts the stream at that device time, and a non-NULL
+ *indexFileName records the time stamp of every energy output.  The samples
+ *cross the wire in wireFormat and arrive in hostFormat.
+ */
 int calculateTask(  const char*                   outputFileName,
                     const int                     binSize,
+                    const int                     pyramidLevels,
+                    const int                     pyramidFactor,
+                    const int                     slidingWindow,
+                    const int                     slidingHop,
+                    const char*                   eventsFileName,
+                    const double                  threshold,
+                    const double                  hysteresis,
+                    const int                     floorTimeConstant,
+                    const vector<size_t>&         channels,
+                    const double                  startTime,
+                    const char*                   indexFileName,
+                    const sample_format           wireFormat,
+                    const sample_format           hostFormat,
                     const unsigned long long	    maximum_samples,
                     uhd::usrp::multi_usrp::sptr&  usrp );
 
+/*closeChannels(...)
+ *
+ *Closes the first count channel pipelines and frees the pipeline array
+ */
+void closeChannels( energy_channel* pipelines, size_t count, bool events,
+                    bool sliding );
+
 
 
 /*******************************************************************************
@@ -122,31 +225,106 @@ int main( int argc, char* argv[])
   //First things first, try to set realtime priority for the parent thread
   uhd::set_thread_priority_safe();
 
-  //Ensure the correct number of arguments were passed
-  if( argc != 15)
-  {
-    cout << "Only " << argc << " parameters entered" << endl;
-    useage();
-    return -1;
-  }
-
   char  *outputFileName = NULL;
+  char  *eventsFileName = NULL;
   char  *usrpArgs       = NULL;
+  char  *timeSource     = NULL;
+  char  *indexFileName  = NULL;
+  double startTime      = 0;
   int   usrpGain        = 0;
   int   arg             = 0;
   int   binSize         = 0;
+  int   pyramidLevels   = 1;
+  int   pyramidFactor   = 4;
+  int   slidingWindow   = 0;
+  int   slidingHop      = 0;
+  int   floorTimeConstant = 1000;
+  double threshold      = 10;
+  double hysteresis     = 3;
+  vector<size_t> channels( 1, 0 );
+  sample_format wireFormat = __USRP_WIRE_FMT;
+  sample_format hostFormat = SAMPLE_FC32;
   float usrpCenterFreq  = 0.0f;
   float usrpSampleRate  = 0.0f;
   float usrpRecordTime  = 0.0f;
 
   //argument parsing
-  while( (arg = getopt( argc, argv, ":g:o:a:f:r:t:b:")) != -1 )
+  while( (arg = getopt( argc, argv, ":g:o:a:f:r:t:b:p:m:W:H:E:T:Y:N:C:R:Z:I:O:F:")) != -1 )
   {
     switch (arg)
     {
       case 'b':
         binSize = atoi(optarg);
         break;
+      case 'p':
+        pyramidLevels = atoi(optarg);
+        break;
+      case 'm':
+        pyramidFactor = atoi(optarg);
+        break;
+      case 'W':
+        slidingWindow = atoi(optarg);
+        break;
+      case 'H':
+        slidingHop = atoi(optarg);
+        break;
+      case 'E':
+        eventsFileName = new char[strlen(optarg)+1];
+        strcpy(eventsFileName,optarg);
+        break;
+      case 'T':
+        threshold = atof(optarg);
+        break;
+      case 'Y':
+        hysteresis = atof(optarg);
+        break;
+      case 'N':
+        floorTimeConstant = atoi(optarg);
+        break;
+      case 'R':
+        timeSource = new char[strlen(optarg)+1];
+        strcpy(timeSource,optarg);
+        break;
+      case 'Z':
+        startTime = atof(optarg);
+        break;
+      case 'I':
+        indexFileName = new char[strlen(optarg)+1];
+        strcpy(indexFileName,optarg);
+        break;
+      case 'O':
+        if( parseWireFormat( optarg, wireFormat ) )
+          break;
+        cout << "Unknown wire format " << optarg << endl;
+        useage();
+        delete [] outputFileName;
+        delete [] eventsFileName;
+        delete [] usrpArgs;
+        delete [] timeSource;
+        delete [] indexFileName;
+        return -1;
+      case 'F':
+        if( parseSampleFormat( optarg, hostFormat ) )
+          break;
+        cout << "Unknown host format " << optarg << endl;
+        useage();
+        delete [] outputFileName;
+        delete [] eventsFileName;
+        delete [] usrpArgs;
+        delete [] timeSource;
+        delete [] indexFileName;
+        return -1;
+      case 'C':
+        if( parseChannels( optarg, channels ) )
+          break;
+        cout << "Cannot parse channel list " << optarg << endl;
+        useage();
+        delete [] outputFileName;
+        delete [] eventsFileName;
+        delete [] usrpArgs;
+        delete [] timeSource;
+        delete [] indexFileName;
+        return -1;
       case 'o':
         outputFileName = new char[strlen(optarg)+1];
         strcpy(outputFileName,optarg);
@@ -171,12 +349,67 @@ int main( int argc, char* argv[])
         useage();
         if( outputFileName )
           delete [] outputFileName;
+        if( eventsFileName )
+          delete [] eventsFileName;
         if( usrpArgs )
           delete [] usrpArgs;
+        if( timeSource )
+          delete [] timeSource;
+        if( indexFileName )
+          delete [] indexFileName;
         return -1;
       }
   }
 
+  //Ensure the required arguments were passed
+  if( !usrpArgs || ( !outputFileName && !eventsFileName ) ||
+      usrpSampleRate <= 0.0f || usrpRecordTime <= 0.0f )
+  {
+    useage();
+    delete [] outputFileName;
+    delete [] eventsFileName;
+    delete [] usrpArgs;
+    delete [] timeSource;
+    delete [] indexFileName;
+    return -1;
+  }
+
+  //Check the energy options
+  if( ( binSize < 1 && slidingWindow < 1 ) || pyramidLevels < 1 || pyramidFactor < 2 )
+  {
+    cout  << "Need a positive bin size, at least one pyramid level and a "
+          << "pyramid factor of 2 or more" << endl;
+    delete [] outputFileName;
+    delete [] eventsFileName;
+    delete [] usrpArgs;
+    delete [] timeSource;
+    delete [] indexFileName;
+    return -1;
+  }
+  if( slidingWindow > 0 && ( slidingHop < 1 || pyramidLevels > 1 ) )
+  {
+    cout  << "Sliding window needs a positive hop and cannot be combined with "
+          << "a pyramid" << endl;
+    delete [] outputFileName;
+    delete [] eventsFileName;
+    delete [] usrpArgs;
+    delete [] timeSource;
+    delete [] indexFileName;
+    return -1;
+  }
+
+  if( eventsFileName && ( floorTimeConstant < 1 || hysteresis < 0 ) )
+  {
+    cout  << "Need a positive noise floor time constant and a non-negative "
+          << "hysteresis" << endl;
+    delete [] outputFileName;
+    delete [] eventsFileName;
+    delete [] usrpArgs;
+    delete [] timeSource;
+    delete [] indexFileName;
+    return -1;
+  }
+
   cout << "Initializing USRP device" << endl;
   //Initialize the USRP hardware
   uhd::usrp::multi_usrp::sptr the_usrp;
@@ -184,23 +417,47 @@ int main( int argc, char* argv[])
                   usrpCenterFreq,
                   usrpSampleRate,
                   usrpGain,
+                  channels,
                   usrpArgs ))
   {
     cout << "Error initializing the USRP device." << endl;
     delete [] outputFileName;
+    delete [] eventsFileName;
     delete [] usrpArgs;
+    delete [] timeSource;
+    delete [] indexFileName;
     return 1;
   }
 
+  //A start time only makes sense on a known clock
+  if( timeSource || startTime > 0 )
+    syncTime( the_usrp, timeSource ? timeSource : "host" );
+
   //Perform the actual work
   if( !calculateTask( outputFileName,
                       binSize,
+                      pyramidLevels,
+                      pyramidFactor,
+                      slidingWindow,
+                      slidingHop,
+                      eventsFileName,
+                      threshold,
+                      hysteresis,
+                      floorTimeConstant,
+                      channels,
+                      startTime,
+                      indexFileName,
+                      wireFormat,
+                      hostFormat,
                       static_cast<unsigned long long int>(usrpSampleRate*usrpRecordTime),
                       the_usrp ) )
   {
     cout << "Error performing calculations" << endl;
     delete [] outputFileName;
+    delete [] eventsFileName;
     delete [] usrpArgs;
+    delete [] timeSource;
+    delete [] indexFileName;
     return 1;
   }
 
@@ -209,7 +466,10 @@ int main( int argc, char* argv[])
   usrp_stream_stop.time_spec = uhd::time_spec_t();
   the_usrp->issue_stream_cmd( usrp_stream_stop );
   delete [] outputFileName;
+  delete [] eventsFileName;
   delete [] usrpArgs;
+  delete [] timeSource;
+  delete [] indexFileName;
   return 0;
 }
 
@@ -228,6 +488,7 @@ int setupUSRP(  uhd::usrp::multi_usrp::sptr&  usrp,
                 const float                   center_freq,
                 const float                   sample_rate,
                 const int                     rx_gain,
+                const vector<size_t>&         channels,
                 const char*                   dev_addr)
 {
   //Initialize the USRP to the specified address
@@ -254,42 +515,53 @@ int setupUSRP(  uhd::usrp::multi_usrp::sptr&  usrp,
     cout.setf(originalFlags);
   }
 
-  //Try setting the center frequency.  Like above, if we get a different
-  //frequency than the one we're requesting, we will spit out a warning for the
-  //user
-  usrp->set_rx_freq( center_freq );
-
-  if( usrp->get_rx_freq() != center_freq )
+  for( size_t i = 0; i < channels.size(); i++ )
   {
-    ios_base::fmtflags originalFlags = cout.flags();
-    cout.setf(ios_base::left,ios_base::floatfield);
-    cout.precision(15);
-    cout  << "WARNING! Requested frequency = " << center_freq << endl
-          << "WARNING! Actual frequency = " << usrp->get_rx_freq() << endl;
-    cout.setf(originalFlags);
-  }
+    size_t chan = channels[i];
+    if( chan >= usrp->get_rx_num_channels() )
+    {
+      cout  << "Channel " << chan << " does not exist, the device has "
+            << usrp->get_rx_num_channels() << " channels" << endl;
+      return 0;
+    }
 
-  //Set the RX gain.  There really shouldn't be any problems here, but the user
-  //might request something silly like 50dB of gain when the module can't
-  //accomodate.  So we'll perform a similar check here.
-  usrp->set_rx_gain( rx_gain );
+    //Try setting the center frequency.  Like above, if we get a different
+    //frequency than the one we're requesting, we will spit out a warning for
+    //the user
+    usrp->set_rx_freq( center_freq, chan );
 
-  if( usrp->get_rx_gain() != rx_gain )
-  {
-    cout  << "WARNING! Requested gain = " << rx_gain << endl
-          << "WARNING! Actual gain = " << usrp->get_rx_gain() << endl;
-  }
+    if( usrp->get_rx_freq( chan ) != center_freq )
+    {
+      ios_base::fmtflags originalFlags = cout.flags();
+      cout.setf(ios_base::left,ios_base::floatfield);
+      cout.precision(15);
+      cout  << "WARNING! Requested frequency = " << center_freq << endl
+            << "WARNING! Actual frequency = " << usrp->get_rx_freq( chan ) << endl;
+      cout.setf(originalFlags);
+    }
 
-  //Ensure the LO locked
-  vector<string> sensor_names;
-  sensor_names = usrp->get_rx_sensor_names(0);
-  if( find(sensor_names.begin(), sensor_names.end(), "lo_locked")
-      != sensor_names.end() )
-  {
-    uhd::sensor_value_t lo_locked = usrp->get_rx_sensor("lo_locked",0);
-    cout  << "Checking RX: " << endl
-          << lo_locked.to_pp_string() << endl;
-    UHD_ASSERT_THROW(lo_locked.to_bool());      //We should probably catch this
+    //Set the RX gain.  There really shouldn't be any problems here, but the
+    //user might request something silly like 50dB of gain when the module
+    //can't accomodate.  So we'll perform a similar check here.
+    usrp->set_rx_gain( rx_gain, chan );
+
+    if( usrp->get_rx_gain( chan ) != rx_gain )
+    {
+      cout  << "WARNING! Requested gain = " << rx_gain << endl
+            << "WARNING! Actual gain = " << usrp->get_rx_gain( chan ) << endl;
+    }
+
+    //Ensure the LO locked
+    vector<string> sensor_names;
+    sensor_names = usrp->get_rx_sensor_names( chan );
+    if( find(sensor_names.begin(), sensor_names.end(), "lo_locked")
+        != sensor_names.end() )
+    {
+      uhd::sensor_value_t lo_locked = usrp->get_rx_sensor("lo_locked", chan);
+      cout  << "Checking RX " << chan << ": " << endl
+            << lo_locked.to_pp_string() << endl;
+      UHD_ASSERT_THROW(lo_locked.to_bool());    //We should probably catch this
+    }
   }
 
   return 1;
@@ -315,7 +587,21 @@ void useage( )
         << "-f <freq>\t USRP Center Frequency" << endl
         << "-r <rate>\t USRP Sample Rate" << endl
         << "-g <gain>\t USRP Rx Gain" << endl
-        << "-t <time>\t Time to record" << endl;
+        << "-t <time>\t Time to record" << endl
+        << "-p <levels>\t Energy Pyramid Levels (default 1)" << endl
+        << "-m <factor>\t Energy Pyramid Factor (default 4)" << endl
+        << "-W <size>\t Sliding Window Size" << endl
+        << "-H <size>\t Sliding Window Hop" << endl
+        << "-E <file>\t Burst Events File" << endl
+        << "-T <dB>\t Burst Threshold (default 10)" << endl
+        << "-Y <dB>\t Burst Hysteresis (default 3)" << endl
+        << "-N <outputs>\t Noise Floor Time Constant (default 1000)" << endl
+        << "-C <list>\t Channels (default 0)" << endl
+        << "-R <source>\t Time Source (gpsdo, external or host)" << endl
+        << "-Z <time>\t Start Time (device UNIX seconds)" << endl
+        << "-I <file>\t Time Stamp Index File" << endl
+        << "-O <format>\t Wire Format (sc16 or sc8)" << endl
+        << "-F <format>\t Host Format (fc32, sc16 or sc8)" << endl;
 }
 
 
@@ -324,39 +610,25 @@ void useage( )
 
 
 
-/*******************************************************************************
-
-
-*******************************************************************************/
-int openFiles( const char*  outputFileName,
-               FILE*&       outputFile )
-{
-  outputFile = fopen( outputFileName, "w" );
-
-  /*Make sure the files actually opened.
-   *
-   *If not... gracefully exit.
-   *We should really be throwing exceptions...
-   */
-  if( !outputFile)
-    return 0;
-  return 1;
-}
-
-
-
-
-
-
-
-
-
 /*******************************************************************************
 
 
 *******************************************************************************/
 int calculateTask(  const char*                   outputFileName,
                     const int                     binSize,
+                    const int                     pyramidLevels,
+                    const int                     pyramidFactor,
+                    const int                     slidingWindow,
+                    const int                     slidingHop,
+                    const char*                   eventsFileName,
+                    const double                  threshold,
+                    const double                  hysteresis,
+                    const int                     floorTimeConstant,
+                    const vector<size_t>&         channels,
+                    const double                  startTime,
+                    const char*                   indexFileName,
+                    const sample_format           wireFormat,
+                    const sample_format           hostFormat,
                     const unsigned long long	    maximum_samples,
                     uhd::usrp::multi_usrp::sptr&  usrp )
 {
@@ -365,29 +637,73 @@ int calculateTask(  const char*                   outputFileName,
   //Initialization Section
   ///////////////////////////////////////////////////////////
 
-  //Number of bytes in a single-precision float
-  const int   FLOAT_SIZE = sizeof(float);
-  //Initialize and open the input/output files
-  FILE *outputFile;
+  const size_t channelCount = channels.size();
+  int          return_code  = 1;
 
-  if(!openFiles( outputFileName, outputFile ))
-    return 0;
+  //Every channel gets its own pipeline.  Without an output file the pyramid
+  //just discards the bins.  Every energy output is one bin, or one window
+  //advancing by the hop.
+  energy_channel* pipelines = new energy_channel[channelCount];
+  size_t          opened    = 0;
+
+  for( ; opened < channelCount; opened++ )
+  {
+    energy_channel& pipeline = pipelines[opened];
+    char* channelOutputName = outputFileName ?
+      channelFileName( outputFileName, channels[opened], channelCount ) : NULL;
+    char* channelEventsName = eventsFileName ?
+      channelFileName( eventsFileName, channels[opened], channelCount ) : NULL;
+
+    int ok = initializePyramid( pipeline.outputFiles, channelOutputName,
+                                pyramidLevels, pyramidFactor, false );
+    if( ok && channelEventsName &&
+        !initializeBurstDetector( pipeline.detector, channelEventsName,
+                                  threshold, hysteresis, floorTimeConstant,
+                                  slidingWindow > 0 ? slidingHop : binSize,
+                                  slidingWindow > 0 ? slidingWindow : binSize ) )
+    {
+      closePyramid( pipeline.outputFiles );
+      ok = 0;
+    }
+    delete [] channelOutputName;
+    delete [] channelEventsName;
+    if( !ok )
+      break;
 
-  //Setup the input buffer and tracking variables
-  int                   return_code       = 1;
+    if( slidingWindow > 0 )
+      initializeSlidingEnergy( pipeline.slider, slidingWindow, slidingHop );
+  }
+  //The time stamps of the energy outputs, one index file per channel
+  FILE** indexFile = opened < channelCount ? NULL :
+                     openIndexFiles( indexFileName, channels );
+  if( !indexFile )
+  {
+    closeChannels( pipelines, opened, eventsFileName != NULL, slidingWindow > 0 );
+    return 0;
+  }
 
-  //Setup the USRP for streaming
-  vector<_Complex float >   usrpBuffer( binSize );
-  float                   energy;
-  uhd::stream_args_t      stream_args(__USRP_CPU_FMT, __USRP_WIRE_FMT );
+  //In sliding-window mode we receive one hop at a time, and each hop yields
+  //at most one output
+  double                slidingOutput[2];
+  int                   bufferSize        = slidingWindow > 0 ? slidingHop : binSize;
+
+  //Setup the USRP for streaming, one buffer of hostFormat samples per channel
+  const int               hostSize          = sampleFormatSize( hostFormat );
+  vector< vector<char> >  usrpBuffer( channelCount,
+                                      vector<char>( bufferSize * hostSize ) );
+  vector<void*>           usrpBuffers( channelCount );
+  for( size_t c = 0; c < channelCount; c++ )
+    usrpBuffers[c] = &usrpBuffer[c].front();
+
+  uhd::stream_args_t      stream_args( sampleFormatName( hostFormat ),
+                                       sampleFormatName( wireFormat ) );
+  stream_args.channels    = channels;
   uhd::rx_streamer::sptr  usrp_rx_stream = usrp->get_rx_stream(stream_args);
   uhd::rx_metadata_t      rx_md;
   unsigned long long int  samples_recorded = 0;
   unsigned long long int  buffer_samples_recorded = 0;
-  uhd::stream_cmd_t       usrp_stream_command(uhd::stream_cmd_t::STREAM_MODE_START_CONTINUOUS);
-
-  usrp_stream_command.stream_now  = true;
-  usrp_stream_command.time_spec   = uhd::time_spec_t();
+  double                  timeout = 0;
+  const double            rate    = usrp->get_rx_rate();
 
   ///////////////////////////////////////////////////////////
   //
@@ -395,15 +711,21 @@ int calculateTask(  const char*                   outputFileName,
   ///////////////////////////////////////////////////////////
   cout << "Begin Data Collection" << endl;
   //Start streaming!
-  usrp->issue_stream_cmd( usrp_stream_command );
+  timeout = startStream( usrp, channelCount, startTime );
+  if( !timeout )
+  {
+    cout << "Start time has already passed" << endl;
+    return_code = 0;
+  }
 
   while( (samples_recorded < maximum_samples) and return_code )
   {
-    energy = 0.0f;
-    //Read in the I-Q of fft_interval_size samples...
-    buffer_samples_recorded = usrp_rx_stream->recv( &usrpBuffer.front(),
-                                                    usrpBuffer.size(),
-                                                    rx_md );
+    //Read in the I-Q of bufferSize samples on every channel...
+    buffer_samples_recorded = usrp_rx_stream->recv( usrpBuffers,
+                                                    bufferSize,
+                                                    rx_md,
+                                                    timeout );
+    timeout = 0.1;
 
     //Check the USRP for errors (including Overflow indication)
     if( rx_md.error_code != uhd::rx_metadata_t::ERROR_CODE_NONE )
@@ -422,13 +744,61 @@ int calculateTask(  const char*                   outputFileName,
           return_code = 0;
       }
     }
-    samples_recorded += buffer_samples_recorded;
-    //Compute magnitude (we don't want to store phase information)
-    for(int i = 0; i < binSize; i++ )
-      energy += pow(cabsf( usrpBuffer[i] ), 2);
+    //Outputs are time stamped relative to the first sample of this buffer
+    long long bufferTick = rx_md.time_spec.to_ticks( rate );
+
+    for( size_t c = 0; c < channelCount && return_code; c++ )
+    {
+      energy_channel& pipeline = pipelines[c];
+
+      if( slidingWindow > 0 )
+      {
+        int outputs = pushSlidingEnergy( pipeline.slider, hostFormat,
+                                         usrpBuffers[c],
+                                         buffer_samples_recorded, slidingOutput );
+        if( outputs && !pushPyramid( pipeline.outputFiles, slidingOutput, outputs ) )
+          return_code = 0;
+        if( outputs && eventsFileName &&
+            !pushBurstDetector( pipeline.detector, slidingOutput, outputs ) )
+          return_code = 0;
+
+        //Output k covers the window that ended (outputs - k) hops before the
+        //next output
+        for( int k = 0; k < outputs && indexFile[c]; k++ )
+        {
+          unsigned long long start = pipeline.slider.next_output -
+                                     (unsigned long long)slidingHop*(outputs - k) -
+                                     slidingWindow;
+          long long tick = bufferTick + (long long)(start - samples_recorded);
+          if( !writeFrameTime( indexFile[c], start,
+                               uhd::time_spec_t::from_ticks( tick, rate ) ) )
+            return_code = 0;
+        }
+        continue;
+      }
+
+      //A short buffer (e.g. after an overflow) makes no bin, but the
+      //detector has to know the samples went by
+      if( buffer_samples_recorded != static_cast<unsigned long long>(binSize) )
+      {
+        if( eventsFileName &&
+            !skipBurstDetector( pipeline.detector, buffer_samples_recorded ) )
+          return_code = 0;
+        continue;
+      }
 
-    //Write results to the output file
-    fwrite(&energy, FLOAT_SIZE, 1, outputFile );
+      //Compute magnitude (we don't want to store phase information)
+      double bin = energy( hostFormat, usrpBuffers[c], binSize );
+
+      //Write results to the output files
+      if( !pushPyramid( pipeline.outputFiles, &bin, 1 ) )
+        return_code = 0;
+      if( eventsFileName && !pushBurstDetector( pipeline.detector, &bin, 1 ) )
+        return_code = 0;
+      if( !writeFrameTime( indexFile[c], samples_recorded, rx_md.time_spec ) )
+        return_code = 0;
+    }
+    samples_recorded += buffer_samples_recorded;
   }
 
   ///////////////////////////////////////////////////////////
@@ -437,8 +807,34 @@ int calculateTask(  const char*                   outputFileName,
   ///////////////////////////////////////////////////////////
 
   //Toss out any leftovers and cleanup
-  fclose(outputFile);
+  closeChannels( pipelines, channelCount, eventsFileName != NULL,
+                 slidingWindow > 0 );
+  closeIndexFiles( indexFile, channelCount );
 
-  return 1;
+  return return_code;
 }
 
+
+
+
+
+
+
+
+/*******************************************************************************
+
+
+*******************************************************************************/
+void closeChannels( energy_channel* pipelines, size_t count, bool events,
+                    bool sliding )
+{
+  for( size_t c = 0; c < count; c++ )
+  {
+    closePyramid( pipelines[c].outputFiles );
+    if( events )
+      closeBurstDetector( pipelines[c].detector );
+    if( sliding )
+      destroySlidingEnergy( pipelines[c].slider );
+  }
+  delete [] pipelines;
+}
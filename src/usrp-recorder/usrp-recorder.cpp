@@ -39,20 +39,142 @@
  *                               bandwidth of the FFT calculation.
  *
  * -t [time]       Runtime      -The runtime in seconds for the sensing process.
- *
+ *                               The device is asked for exactly this many
+ *                               seconds of samples and ends the stream by
+ *                               itself, so nothing past the end is recorded.
  *
  * -g [gain]       RX Gain      -Gain in DB of the rx chain
  *
+ * -C [list]       Channels     -Comma separated list of the channels to record
+ *                               (default 0).  All channels are tuned to the
+ *                               same frequency and gain and start on the same
+ *                               sample.  With more than one channel, channel
+ *                               N is written to "[Output File].chN".
+ *
+ * -R [source]     Time Source  -Set the device time to UNIX time before
+ *                               streaming: "gpsdo", "external" (PPS input) or
+ *                               "host".  Falls back to "host" when the source
+ *                               is not available.
+ *
+ * -Z [time]       Start Time   -Start recording at this device time (UNIX
+ *                               seconds).  Implies -R host unless -R is given.
+ *
+ * -N [count]      Captures     -Record this many captures of -t seconds in a
+ *                               row (default 1) on the open device.  With
+ *                               more than one, capture N is written to
+ *                               "[Output File].N" (and "[Index File].N").
+ *
+ * -P [period]     Period       -Seconds between the starts of consecutive
+ *                               captures.  They are scheduled on the device
+ *                               clock from -Z, or from the next whole second
+ *                               without -Z.  By default only the first
+ *                               capture waits for -Z and each later one
+ *                               starts as soon as the previous one is written.
+ *
+ * -J [file]       Job File     -Record the captures listed in this file, one
+ *                               per line, instead of -o/-f/-r/-g/-t/-N:
+ *                                 [freq] [rate] [gain] [time] [output file]
+ *                               Blank lines and text after '#' are skipped.
+ *                               The device stays open between the captures.
+ *                               A capture at the rate of the one before it is
+ *                               tuned on the device clock the moment that
+ *                               one ends (the device must support timed
+ *                               tuning); a new rate is set between captures.
+ *                               -Z, -P, -C and -I apply to every capture.
+ *
+ * -X [rate]       Output Rate  -Resample every capture from the device rate to
+ *                               this rate before it is written, e.g. when
+ *                               the device cannot hit the rate to archive.
+ *                               A polyphase FIR (see ddc.h) on a thread of
+ *                               its own changes the rate by the smallest
+ *                               ratio L/M (up to 512/512) that hits it,
+ *                               and passes the band of the lower rate.  Needs
+ *                               -F fc32.  The -I stamps then count output
+ *                               samples and date the first output of every
+ *                               buffer, with the filter delay taken out.
+ *                               An "L" marks a buffer lost because the
+ *                               resampler fell a quarter second behind.
+ *
+ * -I [file]       Index File   -Write the time stamp of every received buffer
+ *                               to this file (see usrp_common.h for the
+ *                               24-byte record).  Channel N uses
+ *                               "[Index File].chN".
+ *
+ * -O [format]     Wire Format  -Sample format between the device and the host:
+ *                               sc16 (default) or sc8.  sc8 halves the link
+ *                               load, so about twice the sample rate fits.
+ *
+ * -F [format]     Host Format  -Sample format of the output file: fc32
+ *                               (default), sc16 or sc8.  The integer formats
+ *                               skip the float conversion and shrink the
+ *                               file; fftcompute and energycalculator read
+ *                               them with -F.
+ *
+ *Description of error messages:
+ *
+ *Cannot read job file [file]
+ *  The -J file cannot be opened or lists no capture.
+ *
+ *Cannot parse line [xx] of the job file
+ *  Every job line needs a frequency, a positive rate, an integer gain, a
+ *  positive time and an output file.
+ *
+ *The capture period is shorter than the runtime
+ *  -P must leave room for the -t seconds of every capture.
+ *
+ *Start time has already passed
+ *  The start of a capture was less than 50 ms away when its stream command
+ *  was issued.  Move -Z later or lengthen -P.
+ *
+ *Resampling needs the fc32 host format
+ *  -X cannot be combined with -F sc16 or sc8.
+ *
+ *Cannot resample [xx] to [yy] samples per second
+ *  No ratio of two whole numbers up to 512 turns the device rate into the
+ *  -X rate.
+ *
+ *Cannot reserve the resampler ring
+ *  The buffers between the receive loop and the resampler could not be
+ *  mapped.
+ *
+ *Cannot start the resampling thread
+ *  pthread_create failed for the thread that resamples and writes.
+ *
+ *Capture ended after [xx] of [yy] samples
+ *  The device stopped sending before the capture was complete (e.g. after an
+ *  overflow), so its file is short.  The remaining captures still run.
+ *
+ *[xx] of [yy] captures are short
+ *  Printed at the end when any capture ended early; the exit status is then
+ *  1.
+ *
+ *[xx] buffers lost to a full resampler ring
+ *  The resampler could not keep up with the device rate; the output has
+ *  gaps where the "L"s were printed.
+ *
  *
  * Changelog
  *
  * 0.1 - Initial release 2013
  * 0.3 - Change to cmake and upload to github
+ * 0.4 - Multi-channel recording
+ *       Timed start and per-buffer time stamps
+ *       Wire and host formats selected at runtime
+ *       Exact-length captures and scheduled back-to-back captures
+ *       Job files run many captures on one open device
+ *       Rational resampling before the samples are written
  */
 
 //Define some of the values we use to setup the USRP and FFT process
 #define __USRP_CLK_SRC  "internal"
 
+//Default format of the output samples (-F)
+#ifdef HOST_SC16
+  #define __USRP_HOST_FMT SAMPLE_SC16
+#else
+  #define __USRP_HOST_FMT SAMPLE_FC32
+#endif
+
 //USRP Headers
 #include <uhd/utils/thread_priority.hpp>
 #include <uhd/utils/safe_main.hpp>
@@ -63,11 +185,19 @@
 #include <complex.h>
 
 #include <iostream>
+#include <algorithm>
 #include <cstring>
+#include <cmath>
 #include <cstdio>
 #include <cstdlib>
 #include <stdint.h>
 #include <unistd.h>
+#include <pthread.h>
+
+#include "usrp_common.h"
+#include "ddc.h"
+#include "buffer_arena.h"
+#include "sample_ring.h"
 
 using namespace std;
 
@@ -86,27 +216,120 @@ void useage();
 int openFiles( const char*  outputFileName,
                FILE*&       outputFile );
 
+//One capture: from the command line (-N of them) or a line of the job file
+struct capture_job
+{
+  float   center_freq;
+  float   sample_rate;
+  int     rx_gain;
+  float   record_time;
+  string  outputName;
+};
+
+//Arguments of the resampling thread
+struct resample_thread_data
+{
+  sample_ring*            ring;         //received blocks, fc32
+  resampler*              resamplers;   //one per channel
+  float*                  output;       //resampled block of one channel
+  vector<FILE*>*          outputFile;   //one per channel
+  FILE**                  indexFile;    //one per channel (entries may be NULL)
+  double                  rate;         //device rate, for the block ticks
+  volatile bool           done;         //set once the last block is published
+  int                     return_code;  //0 after a write error
+};
+
+/*captureFileName( const char*, unsigned long, unsigned long )
+ *
+ *The file name of capture number capture out of captureCount: fileName
+ *itself for a single capture, "[fileName].N" otherwise.  NULL stays NULL.
+ *Free with delete [].
+ */
+char* captureFileName( const char*    fileName,
+                       unsigned long  capture,
+                       unsigned long  captureCount );
+
+
+/*readJobs( const char*, vector<capture_job>& )
+ *
+ *Appends the captures listed in the job file to jobs, one per line:
+ *"[frequency] [rate] [gain] [time] [output file]".  Blank lines and
+ *everything after a '#' are skipped.  Returns 0 if the file cannot be read,
+ *a line is malformed or there is no job at all.
+ */
+int readJobs( const char*           jobFileName,
+              vector<capture_job>&  jobs );
 
 /*setupUSRP(...)
  *
- *Setup the USRP for receiving at the specified freq and rate
+ *Setup the USRP for receiving at the specified freq and rate on every channel
  */
 int setupUSRP(  uhd::usrp::multi_usrp::sptr&  usrp,
-                const char*                   wirefmt,
-                const char*                   hostfmt,
                 const float                   center_freq,
                 const float                   sample_rate,
                 const int                     rx_gain,
+                const vector<size_t>&         channels,
                 const char*                   dev_addr);
 
+/*setRate(...)
+ *
+ *Sets the sample rate, with a warning when the device cannot hit it exactly
+ */
+void setRate(   uhd::usrp::multi_usrp::sptr&  usrp,
+                const float                   sample_rate );
+
+/*tuneUSRP(...)
+ *
+ *Tunes every channel to center_freq with rx_gain, warning about any value the
+ *device cannot hit.  With a command time set on the device the tune happens
+ *at that time.  Returns 0 if a channel does not exist.
+ */
+int tuneUSRP(   uhd::usrp::multi_usrp::sptr&  usrp,
+                const float                   center_freq,
+                const int                     rx_gain,
+                const vector<size_t>&         channels );
+
+/*checkLocked(...)
+ *
+ *Ensures the LO of every channel that reports one is locked
+ */
+void checkLocked( uhd::usrp::multi_usrp::sptr&  usrp,
+                  const vector<size_t>&         channels );
+
+
 
 
+/*resampleThreadStart
+ *
+ *pthread starting function of the resampling thread: resamples the blocks of
+ *the ring (see resample_thread_data) in order and writes them, until done is
+ *set and the ring is empty
+ */
+void* resampleThreadStart( void* resample_thread_arg );
 
+/*calculateTask(...)
+ *
+ *Records exactly maximum_samples samples of every channel to its own output
+ *file, starting at device time startTime when it is positive.  The device
+ *streams them as one finite burst (see startBurst) on usrp_rx_stream, which
+ *carries them in hostFormat to the files.  A non-NULL indexFileName records
+ *the time stamp of every buffer written.  A non-NULL nextJob is tuned on
+ *the device clock for the moment the burst ends, so the retune overlaps the
+ *write-out of this capture.  A positive outputRate resamples the (fc32)
+ *samples to that rate on a thread of its own, fed through a sample ring.
+ *Returns 1 when the capture is complete, -1 when the device ended the burst
+ *early (the short file is kept) and 0 on any other failure.
+ */
 int calculateTask(  const char*                   outputFileName,
                     const unsigned long long	  maximum_samples,
-                    const char*			  wirefmt,
-                    const char*                   hostfmt,
-                    uhd::usrp::multi_usrp::sptr&  usrp );
+                    const sample_format           hostFormat,
+                    const vector<size_t>&         channels,
+                    const double                  startTime,
+                    const char*                   indexFileName,
+                    const capture_job*            nextJob,
+                    const double                  outputRate,
+                    uhd::usrp::multi_usrp::sptr&  usrp,
+                    uhd::rx_streamer::sptr&       usrp_rx_stream );
 
 
 
@@ -119,34 +342,26 @@ int main( int argc, char* argv[])
   //First things first, try to set realtime priority for the parent thread
   uhd::set_thread_priority_safe();
 
-  //Ensure the correct number of arguments were passed
-  if( argc != 13)
-  {
-    cout << "Only " << argc << " parameters entered" << endl;
-    useage();
-    return -1;
-  }
-
   char  *outputFileName = NULL;
   char  *usrpArgs       = NULL;
+  char  *timeSource     = NULL;
+  char  *indexFileName  = NULL;
+  char  *jobFileName    = NULL;
+  double startTime      = 0;
+  double capturePeriod  = 0;
+  double outputRate     = 0;
+  long  captureCount    = 1;
   int   usrpGain        = 0;
   int   arg             = 0;
   float usrpCenterFreq  = 0.0f;
   float usrpSampleRate  = 0.0f;
   float usrpRecordTime  = 0.0f;
-#ifdef WIRE_SC8
-  const char  *wirefmt  = "sc8";
-#else
-  const char  *wirefmt  = "sc16";
-#endif
-#ifdef HOST_SC16
-  const char  *hostfmt	= "sc16";
-#else
-  const char  *hostfmt  = "fc32";
-#endif
+  vector<size_t> channels( 1, 0 );
+  sample_format wireFormat = __USRP_WIRE_FMT;
+  sample_format hostFormat = __USRP_HOST_FMT;
 
   //argument parsing
-  while( (arg = getopt( argc, argv, ":g:o:a:f:r:t:")) != -1 )
+  while( (arg = getopt( argc, argv, ":g:o:a:f:r:t:C:R:Z:N:P:J:X:I:O:F:")) != -1 )
   {
     switch (arg)
     {
@@ -188,57 +403,249 @@ int main( int argc, char* argv[])
 	cout << "Rx Gain: " << usrpGain << endl;
 #endif
         break;
+      case 'R':
+        timeSource = new char[strlen(optarg)+1];
+        strcpy(timeSource,optarg);
+        break;
+      case 'Z':
+        startTime = atof(optarg);
+        break;
+      case 'N':
+        captureCount = atol(optarg);
+        break;
+      case 'P':
+        capturePeriod = atof(optarg);
+        break;
+      case 'J':
+        jobFileName = new char[strlen(optarg)+1];
+        strcpy(jobFileName,optarg);
+        break;
+      case 'X':
+        outputRate = atof(optarg);
+        break;
+      case 'I':
+        indexFileName = new char[strlen(optarg)+1];
+        strcpy(indexFileName,optarg);
+        break;
+      case 'O':
+        if( parseWireFormat( optarg, wireFormat ) )
+          break;
+        cout << "Unknown wire format " << optarg << endl;
+        useage();
+        delete [] outputFileName;
+        delete [] usrpArgs;
+        delete [] timeSource;
+        delete [] indexFileName;
+        delete [] jobFileName;
+        return 1;
+      case 'F':
+        if( parseSampleFormat( optarg, hostFormat ) )
+          break;
+        cout << "Unknown host format " << optarg << endl;
+        useage();
+        delete [] outputFileName;
+        delete [] usrpArgs;
+        delete [] timeSource;
+        delete [] indexFileName;
+        delete [] jobFileName;
+        return 1;
+      case 'C':
+        if( parseChannels( optarg, channels ) )
+          break;
+        cout << "Cannot parse channel list " << optarg << endl;
+        //fall through
       case '?':
         useage();
         if( outputFileName )
           delete [] outputFileName;
         if( usrpArgs )
           delete [] usrpArgs;
-        if( wirefmt )
-          delete [] wirefmt;
-        if( hostfmt )
-          delete [] hostfmt;
+        if( timeSource )
+          delete [] timeSource;
+        if( indexFileName )
+          delete [] indexFileName;
+        if( jobFileName )
+          delete [] jobFileName;
         return 1;
       }
   }
+
+  //Ensure the required arguments were passed
+  if( !usrpArgs || captureCount < 1 || capturePeriod < 0 || outputRate < 0 ||
+      ( !jobFileName && ( !outputFileName || usrpSampleRate <= 0.0f ||
+                          usrpRecordTime <= 0.0f ) ) )
+  {
+    useage();
+    delete [] outputFileName;
+    delete [] usrpArgs;
+    delete [] timeSource;
+    delete [] indexFileName;
+    delete [] jobFileName;
+    return -1;
+  }
+
+  if( outputRate > 0 && hostFormat != SAMPLE_FC32 )
+  {
+    cout << "Resampling needs the fc32 host format" << endl;
+    delete [] outputFileName;
+    delete [] usrpArgs;
+    delete [] timeSource;
+    delete [] indexFileName;
+    delete [] jobFileName;
+    return -1;
+  }
+
+  //The captures come from the job file, or are -N copies of the command line
+  vector<capture_job> jobs;
+  if( jobFileName )
+  {
+    if( !readJobs( jobFileName, jobs ) )
+    {
+      cout << "Cannot read job file " << jobFileName << endl;
+      delete [] outputFileName;
+      delete [] usrpArgs;
+      delete [] timeSource;
+      delete [] indexFileName;
+      delete [] jobFileName;
+      return -1;
+    }
+  }
+  else
+  {
+    for( long capture = 0; capture < captureCount; capture++ )
+    {
+      char*       name = captureFileName( outputFileName, capture,
+                                          captureCount );
+      capture_job job;
+      job.center_freq = usrpCenterFreq;
+      job.sample_rate = usrpSampleRate;
+      job.rx_gain     = usrpGain;
+      job.record_time = usrpRecordTime;
+      job.outputName  = name;
+      jobs.push_back( job );
+      delete [] name;
+    }
+  }
+
+  bool periodTooShort = false;
+  for( size_t j = 0; j < jobs.size(); j++ )
+    periodTooShort |= capturePeriod > 0 && capturePeriod < jobs[j].record_time;
+  if( periodTooShort )
+  {
+    cout << "The capture period is shorter than the runtime" << endl;
+    delete [] outputFileName;
+    delete [] usrpArgs;
+    delete [] timeSource;
+    delete [] indexFileName;
+    delete [] jobFileName;
+    return -1;
+  }
+
   cout << "Initializing USRP device" << endl;
   //Initialize the USRP hardware
   uhd::usrp::multi_usrp::sptr the_usrp;
   if( !setupUSRP( the_usrp,
-                  wirefmt,
-                  hostfmt,
-                  usrpCenterFreq,
-                  usrpSampleRate,
-                  usrpGain,
+                  jobs[0].center_freq,
+                  jobs[0].sample_rate,
+                  jobs[0].rx_gain,
+                  channels,
                   usrpArgs ))
   {
     cout << "Error initializing the USRP device." << endl;
     delete [] outputFileName;
     delete [] usrpArgs;
-    delete [] wirefmt;
-    delete [] hostfmt;
+    delete [] timeSource;
+    delete [] indexFileName;
+    delete [] jobFileName;
     return 1;
   }
 
-  //Perform the actual work
-  if( !calculateTask( outputFileName,
-                      static_cast<unsigned long long int>(usrpSampleRate*usrpRecordTime),
-                      wirefmt, hostfmt,
-                      the_usrp ) )
+  //A start time only makes sense on a known clock
+  if( timeSource || startTime > 0 || capturePeriod > 0 )
+    syncTime( the_usrp, timeSource ? timeSource : "host" );
+
+  //A schedule without -Z begins on the next whole second
+  if( capturePeriod > 0 && startTime <= 0 )
+    startTime = floor( the_usrp->get_time_now().get_real_secs() ) + 1;
+
+  //The stream is set up once and carries every capture
+  uhd::stream_args_t      stream_args( sampleFormatName( hostFormat ),
+                                       sampleFormatName( wireFormat ) );
+  stream_args.channels    = channels;
+  uhd::rx_streamer::sptr  usrp_rx_stream = the_usrp->get_rx_stream(stream_args);
+
+  //Perform the actual work.  A job at the rate of the one before it was
+  //already retuned on the device clock as that capture ended; a new rate
+  //cannot be timed, so it is set (and tuned) between the captures.
+  size_t  shortCaptures = 0;
+  for( size_t j = 0; j < jobs.size(); j++ )
   {
-    cout << "Error performing recording" << endl;
-    delete [] outputFileName;
-    delete [] usrpArgs;
-    delete [] wirefmt;
-    delete [] hostfmt;
-    return 1;
+    const capture_job&  job     = jobs[j];
+    const capture_job*  nextJob = NULL;
+    bool                tuned   = true;
+
+    if( j && job.sample_rate != jobs[j-1].sample_rate )
+    {
+      setRate( the_usrp, job.sample_rate );
+      tuned = tuneUSRP( the_usrp, job.center_freq, job.rx_gain, channels );
+    }
+    if( j && job.center_freq != jobs[j-1].center_freq )
+      checkLocked( the_usrp, channels );
+
+    if( j+1 < jobs.size() && jobs[j+1].sample_rate == job.sample_rate &&
+        ( jobs[j+1].center_freq != job.center_freq ||
+          jobs[j+1].rx_gain != job.rx_gain ) )
+      nextJob = &jobs[j+1];
+
+    //Without -P only the first capture waits for -Z; the rest start now
+    const double captureStart = startTime <= 0 ? 0 :
+                                capturePeriod > 0 ? startTime + j*capturePeriod :
+                                j == 0 ? startTime : 0;
+    char* captureIndexName  = captureFileName( indexFileName, j,
+                                               jobs.size() );
+    int   recorded          = !tuned ? 0 : calculateTask( job.outputName.c_str(),
+                      static_cast<unsigned long long int>(job.sample_rate*job.record_time),
+                      hostFormat,
+                      channels,
+                      captureStart,
+                      captureIndexName,
+                      nextJob,
+                      outputRate,
+                      the_usrp,
+                      usrp_rx_stream );
+    delete [] captureIndexName;
+
+    //A short capture (e.g. after an overflow) keeps its file and the rest of
+    //the jobs still run; the next job may not be tuned yet
+    if( recorded < 0 )
+    {
+      shortCaptures++;
+      if( nextJob )
+        tuneUSRP( the_usrp, nextJob->center_freq, nextJob->rx_gain, channels );
+      continue;
+    }
+    if( !recorded )
+    {
+      cout << "Error performing recording" << endl;
+      delete [] outputFileName;
+      delete [] usrpArgs;
+      delete [] timeSource;
+      delete [] indexFileName;
+      delete [] jobFileName;
+      return 1;
+    }
   }
-  uhd::stream_cmd_t       usrp_stream_stop(uhd::stream_cmd_t::STREAM_MODE_STOP_CONTINUOUS);
-  usrp_stream_stop.stream_now = false;
-  usrp_stream_stop.time_spec = uhd::time_spec_t();
-  the_usrp->issue_stream_cmd( usrp_stream_stop );
   delete [] outputFileName;
   delete [] usrpArgs;
+  delete [] timeSource;
+  delete [] indexFileName;
+  delete [] jobFileName;
+  if( shortCaptures )
+  {
+    cout  << shortCaptures << " of " << jobs.size() << " captures are short"
+          << endl;
+    return 1;
+  }
   return 0;
 }
 
@@ -254,11 +661,10 @@ int main( int argc, char* argv[])
 
 *******************************************************************************/
 int setupUSRP(  uhd::usrp::multi_usrp::sptr&  usrp,
-                const char*	              wirefmt,
-                const char*                   hostfmt,
                 const float                   center_freq,
                 const float                   sample_rate,
                 const int                     rx_gain,
+                const vector<size_t>&         channels,
                 const char*                   dev_addr)
 {
   //Initialize the USRP to the specified address
@@ -269,11 +675,30 @@ int setupUSRP(  uhd::usrp::multi_usrp::sptr&  usrp,
   //Output some useful information
   cout  << "Using the following USRP device: " << endl
         << usrp->get_pp_string() << endl;
-  
-  //Setup the wire format
-  uhd::stream_args_t      stream_args(hostfmt,wirefmt);
-  usrp->get_rx_stream(stream_args);
 
+  //The stream (and with it the wire format) is set up once in main
+  setRate( usrp, sample_rate );
+  if( !tuneUSRP( usrp, center_freq, rx_gain, channels ) )
+    return 0;
+  checkLocked( usrp, channels );
+
+  return 1;
+}
+
+
+
+
+
+
+
+
+/*******************************************************************************
+
+
+*******************************************************************************/
+void setRate(   uhd::usrp::multi_usrp::sptr&  usrp,
+                const float                   sample_rate )
+{
   //Try setting the sample rate.  If the rate we get is not the same as the
   //requested rate, we will return with a warning to ensure the user is aware
   //of the actual sample rate
@@ -288,46 +713,94 @@ int setupUSRP(  uhd::usrp::multi_usrp::sptr&  usrp,
           << "WARNING! Actual rate = " << usrp->get_rx_rate() << endl;
     cout.setf(originalFlags);
   }
+}
+
 
-  //Try setting the center frequency.  Like above, if we get a different
-  //frequency than the one we're requesting, we will spit out a warning for the
-  //user
-  usrp->set_rx_freq( center_freq );
 
-  if( usrp->get_rx_freq() != center_freq )
-  {
-    ios_base::fmtflags originalFlags = cout.flags();
-    cout.setf(ios_base::left,ios_base::floatfield);
-    cout.precision(15);
-    cout  << "WARNING! Requested frequency = " << center_freq << endl
-          << "WARNING! Actual frequency = " << usrp->get_rx_freq() << endl;
-    cout.setf(originalFlags);
-  }
 
-  //Set the RX gain.  There really shouldn't be any problems here, but the user
-  //might request something silly like 50dB of gain when the module can't
-  //accomodate.  So we'll perform a similar check here.
-  usrp->set_rx_gain( rx_gain );
 
-  if( usrp->get_rx_gain() != rx_gain )
+
+
+
+/*******************************************************************************
+
+
+*******************************************************************************/
+int tuneUSRP(   uhd::usrp::multi_usrp::sptr&  usrp,
+                const float                   center_freq,
+                const int                     rx_gain,
+                const vector<size_t>&         channels )
+{
+  for( size_t i = 0; i < channels.size(); i++ )
   {
-    cout  << "WARNING! Requested gain = " << rx_gain << endl
-          << "WARNING! Actual gain = " << usrp->get_rx_gain() << endl;
+    size_t chan = channels[i];
+    if( chan >= usrp->get_rx_num_channels() )
+    {
+      cout  << "Channel " << chan << " does not exist, the device has "
+            << usrp->get_rx_num_channels() << " channels" << endl;
+      return 0;
+    }
+
+    //Try setting the center frequency.  Like above, if we get a different
+    //frequency than the one we're requesting, we will spit out a warning for
+    //the user
+    usrp->set_rx_freq( center_freq, chan );
+
+    if( usrp->get_rx_freq( chan ) != center_freq )
+    {
+      ios_base::fmtflags originalFlags = cout.flags();
+      cout.setf(ios_base::left,ios_base::floatfield);
+      cout.precision(15);
+      cout  << "WARNING! Requested frequency = " << center_freq << endl
+            << "WARNING! Actual frequency = " << usrp->get_rx_freq( chan ) << endl;
+      cout.setf(originalFlags);
+    }
+
+    //Set the RX gain.  There really shouldn't be any problems here, but the
+    //user might request something silly like 50dB of gain when the module
+    //can't accomodate.  So we'll perform a similar check here.
+    usrp->set_rx_gain( rx_gain, chan );
+
+    if( usrp->get_rx_gain( chan ) != rx_gain )
+    {
+      cout  << "WARNING! Requested gain = " << rx_gain << endl
+            << "WARNING! Actual gain = " << usrp->get_rx_gain( chan ) << endl;
+    }
   }
 
-  //Ensure the LO locked
-  vector<string> sensor_names;
-  sensor_names = usrp->get_rx_sensor_names(0);
-  if( find(sensor_names.begin(), sensor_names.end(), "lo_locked")
-      != sensor_names.end() )
+  return 1;
+}
+
+
+
+
+
+
+
+
+/*******************************************************************************
+
+
+*******************************************************************************/
+void checkLocked( uhd::usrp::multi_usrp::sptr&  usrp,
+                  const vector<size_t>&         channels )
+{
+  for( size_t i = 0; i < channels.size(); i++ )
   {
-    uhd::sensor_value_t lo_locked = usrp->get_rx_sensor("lo_locked",0);
-    cout  << "Checking RX: " << endl
-          << lo_locked.to_pp_string() << endl;
-    UHD_ASSERT_THROW(lo_locked.to_bool());      //We should probably catch this
+    size_t chan = channels[i];
+
+    //Ensure the LO locked
+    vector<string> sensor_names;
+    sensor_names = usrp->get_rx_sensor_names( chan );
+    if( find(sensor_names.begin(), sensor_names.end(), "lo_locked")
+        != sensor_names.end() )
+    {
+      uhd::sensor_value_t lo_locked = usrp->get_rx_sensor("lo_locked", chan);
+      cout  << "Checking RX " << chan << ": " << endl
+            << lo_locked.to_pp_string() << endl;
+      UHD_ASSERT_THROW(lo_locked.to_bool());    //We should probably catch this
+    }
   }
-  
-  return 1;
 }
 
 
@@ -349,7 +822,17 @@ void useage( )
         << "-f <freq>\t USRP Center Frequency" << endl
         << "-r <rate>\t USRP Sample Rate" << endl
         << "-g <gain>\t USRP Rx Gain" << endl
-        << "-t <time>\t Time to record" << endl;
+        << "-t <time>\t Time to record" << endl
+        << "-C <list>\t Channels (default 0)" << endl
+        << "-R <source>\t Time Source (gpsdo, external or host)" << endl
+        << "-Z <time>\t Start Time (device UNIX seconds)" << endl
+        << "-N <count>\t Captures (default 1)" << endl
+        << "-P <period>\t Seconds between capture starts" << endl
+        << "-J <file>\t Job File of captures" << endl
+        << "-X <rate>\t Resample to this rate" << endl
+        << "-I <file>\t Time Stamp Index File" << endl
+        << "-O <format>\t Wire Format (sc16 or sc8)" << endl
+        << "-F <format>\t Host Format (fc32, sc16 or sc8)" << endl;
 }
 
 
@@ -384,6 +867,82 @@ int openFiles( const char*  outputFileName,
 
 
 
+/*******************************************************************************
+
+
+*******************************************************************************/
+char* captureFileName( const char*    fileName,
+                       unsigned long  capture,
+                       unsigned long  captureCount )
+{
+  if( !fileName )
+    return NULL;
+
+  char* name = new char[strlen(fileName)+32];
+  if( captureCount == 1 )
+    strcpy( name, fileName );
+  else
+    sprintf( name, "%s.%lu", fileName, capture );
+  return name;
+}
+
+
+
+
+
+
+
+
+/*******************************************************************************
+
+
+*******************************************************************************/
+int readJobs( const char*           jobFileName,
+              vector<capture_job>&  jobs )
+{
+  FILE* jobFile = fopen( jobFileName, "r" );
+  char  line[1024];
+  char  output[1024];
+  int   lineNumber = 0;
+
+  if( !jobFile )
+    return 0;
+
+  while( fgets( line, sizeof(line), jobFile ) )
+  {
+    capture_job job;
+    char*       comment = strchr( line, '#' );
+    int         fields  = 0;
+
+    lineNumber++;
+    if( comment )
+      *comment = '\0';
+    fields = sscanf( line, "%f %f %d %f %1023s", &job.center_freq,
+                     &job.sample_rate, &job.rx_gain, &job.record_time,
+                     output );
+    if( fields == EOF )
+      continue;
+    if( fields != 5 || job.sample_rate <= 0.0f || job.record_time <= 0.0f )
+    {
+      cout << "Cannot parse line " << lineNumber << " of the job file" << endl;
+      fclose( jobFile );
+      return 0;
+    }
+    job.outputName = output;
+    jobs.push_back( job );
+  }
+
+  fclose( jobFile );
+  return !jobs.empty();
+}
+
+
+
+
+
+
+
+
 
 /*******************************************************************************
 
@@ -391,57 +950,162 @@ int openFiles( const char*  outputFileName,
 *******************************************************************************/
 int calculateTask(  const char*                   outputFileName,
                     const unsigned long long	  maximum_samples,
-                    const char*                   wirefmt,
-                    const char*                   hostfmt,
-                    uhd::usrp::multi_usrp::sptr&  usrp )
+                    const sample_format           hostFormat,
+                    const vector<size_t>&         channels,
+                    const double                  startTime,
+                    const char*                   indexFileName,
+                    const capture_job*            nextJob,
+                    const double                  outputRate,
+                    uhd::usrp::multi_usrp::sptr&  usrp,
+                    uhd::rx_streamer::sptr&       usrp_rx_stream )
 {
   ///////////////////////////////////////////////////////////
   //
   //Initialization Section
   ///////////////////////////////////////////////////////////
 
-  //Setup the input buffer and tracking variables
+  //Setup the input buffers (one per channel) and tracking variables.  UHD
+  //fills them in the host format, which goes to the files as it is.
+  const size_t          channelCount      = channels.size();
   int                   sample_size       = 1024;
   int                   return_code       = 1;
-#ifdef HOST_SC16
-    const int COMPLEX_SIZE = sizeof( _Complex int16_t );
-    vector<_Complex int16_t> usrpBuffer(sample_size);
-#else
-    const int COMPLEX_SIZE = sizeof( _Complex float );
-    vector<_Complex float> usrpBuffer(sample_size);
-#endif    
-  //Initialize and open the input/output files
-  FILE *outputFile;
+  const int             COMPLEX_SIZE      = sampleFormatSize( hostFormat );
+  vector< vector<char> > usrpBuffer( channelCount,
+                                     vector<char>( sample_size*COMPLEX_SIZE ) );
+  vector<void*>         usrpBuffers( channelCount );
+  for( size_t i = 0; i < channelCount; i++ )
+    usrpBuffers[i] = &usrpBuffer[i].front();
+
+  //Initialize and open the output files, one per channel
+  vector<FILE*> outputFile( channelCount, static_cast<FILE*>(NULL) );
+
+  for( size_t i = 0; i < channelCount; i++ )
+  {
+    char* channelOutputName = channelFileName( outputFileName, channels[i],
+                                               channelCount );
+    int   opened            = openFiles( channelOutputName, outputFile[i] );
+    delete [] channelOutputName;
+    if( !opened )
+    {
+      for( size_t j = 0; j < i; j++ )
+        fclose( outputFile[j] );
+      return 0;
+    }
+  }
 
-  if(!openFiles( outputFileName, outputFile ))
+  //The time stamps of the buffers, one index file per channel
+  FILE** indexFile = openIndexFiles( indexFileName, channels );
+  if( !indexFile )
+  {
+    for( size_t i = 0; i < channelCount; i++ )
+      fclose( outputFile[i] );
     return 0;
+  }
+
 
+  //Resampling moves the writes to a thread of its own, which takes the
+  //received buffers from a ring of __SAMPLE_RING_SECONDS of samples
+  const double          rate              = usrp->get_rx_rate();
+  const bool            resampling        = outputRate > 0;
+  int                   interpolation     = 1;
+  int                   decimation        = 1;
+  buffer_arena          arena;
+  sample_ring           ring;
+  vector<resampler>     resamplers;
+  resample_thread_data  resampleArgs;
+  pthread_t             resampleThread;
+  bool                  resamplerRunning  = false;
+  if( resampling )
+  {
+    const size_t ringSlots  = max( static_cast<size_t>( ceil(
+                                __SAMPLE_RING_SECONDS*rate/sample_size ) ),
+                                   static_cast<size_t>( 2 ) );
+    const size_t blockBytes = sample_size*COMPLEX_SIZE;
+
+    if( !rationalFactors( rate, outputRate, interpolation, decimation ) )
+    {
+      cout  << "Cannot resample " << rate << " to " << outputRate
+            << " samples per second" << endl;
+      return_code = 0;
+    }
+    else if( !openArena( arena, ringSlots*channelCount*arenaBytes( blockBytes ) ) ||
+             !createSampleRing( ring, ringSlots, channelCount, blockBytes, 0, 0,
+                                arena ) )
+    {
+      cout << "Cannot reserve the resampler ring" << endl;
+      closeArena( arena );
+      return_code = 0;
+    }
+    else
+    {
+      cout  << "Resampling by " << interpolation << "/" << decimation
+            << " to " << rate*interpolation/decimation
+            << " samples per second" << endl;
+      resamplers.resize( channelCount );
+      for( size_t i = 0; i < channelCount; i++ )
+        initializeResampler( resamplers[i], interpolation, decimation,
+                             sample_size );
+      resampleArgs.ring         = &ring;
+      resampleArgs.resamplers   = &resamplers.front();
+      resampleArgs.output       = new float[2*resamplerOutputs( resamplers[0],
+                                                                sample_size )];
+      resampleArgs.outputFile   = &outputFile;
+      resampleArgs.indexFile    = indexFile;
+      resampleArgs.rate         = rate;
+      resampleArgs.done         = false;
+      resampleArgs.return_code  = 1;
+      resamplerRunning = !pthread_create( &resampleThread, NULL,
+                                  resampleThreadStart,
+                                  reinterpret_cast<void *>(&resampleArgs) );
+      if( !resamplerRunning )
+      {
+        cout << "Cannot start the resampling thread" << endl;
+        return_code = 0;
+      }
+    }
+  }
 
-  //Setup the USRP for streaming
-  uhd::stream_args_t      stream_args(hostfmt,wirefmt);
-  uhd::rx_streamer::sptr  usrp_rx_stream = usrp->get_rx_stream(stream_args);
+  //Tracking of the burst.  samples_requested counts the samples not yet asked
+  //of the device; the rest were asked for in commands of up to
+  //__USRP_BURST_SAMPS samples.  burstEnded marks a device that stopped
+  //sending before the capture was complete.
   uhd::rx_metadata_t      rx_md;
   unsigned long long int  samples_recorded = 0;
+  unsigned long long int  samples_requested = maximum_samples;
   unsigned long long int  buffer_samples_recorded = 0;
-  uhd::stream_cmd_t       usrp_stream_command(uhd::stream_cmd_t::STREAM_MODE_START_CONTINUOUS);
-
-  usrp_stream_command.stream_now  = true;
-  usrp_stream_command.time_spec   = uhd::time_spec_t();
+  double                  timeout = 0;
+  bool                    burstEnded = false;
 
   ///////////////////////////////////////////////////////////
   //
   //Work Section
   ///////////////////////////////////////////////////////////
-  cout << "Begin Data Collection" << endl;
+  cout << "Begin Data Collection: " << outputFileName << endl;
   //Start streaming!
-  usrp->issue_stream_cmd( usrp_stream_command );
+  if( return_code )
+    timeout = startBurst( usrp, channelCount, startTime, samples_requested );
+  if( return_code && !timeout )
+  {
+    cout << "Start time has already passed" << endl;
+    return_code = 0;
+  }
 
-  while( (samples_recorded < maximum_samples) and return_code )
+  while( (samples_recorded < maximum_samples) and return_code and !burstEnded )
   {
-    //Read in the I-Q of sample_size samples...
-    buffer_samples_recorded = usrp_rx_stream->recv( &usrpBuffer.front(),
-                                                    usrpBuffer.size(),
-                                                    rx_md );
+    //With the resampler behind a full ring the samples still have to be
+    //taken off the device, or it overflows
+    sample_block* block = resampling ? freeBlock( ring ) : NULL;
+    for( size_t i = 0; resampling && i < channelCount; i++ )
+      usrpBuffers[i] = block ? block->data[i] : &usrpBuffer[i].front();
+
+    //Read in the I-Q of sample_size samples on every channel, but never past
+    //the end of the capture
+    buffer_samples_recorded = usrp_rx_stream->recv( usrpBuffers,
+                                  min<unsigned long long>( sample_size,
+                                          maximum_samples - samples_recorded ),
+                                  rx_md,
+                                  timeout );
+    timeout = 0.1;
 
     //Check the USRP for errors (including Overflow indication)
     if( rx_md.error_code != uhd::rx_metadata_t::ERROR_CODE_NONE )
@@ -452,17 +1116,68 @@ int calculateTask(  const char*                   outputFileName,
           cout << "O";
           break;
         case uhd::rx_metadata_t::ERROR_CODE_TIMEOUT:
+          //The burst is over early, nothing else is coming
           cout << "USRP Timeout" << endl;
-          //return_code = 0;
+          burstEnded = true;
           break;
         default:
           cout << "Unexpected USRP Error: " << rx_md.error_code;
           return_code = 0;
       }
     }
+    //Hand the buffers to the resampler, or write results to the output
+    //files, stamped with the time of their first sample
+    if( block )
+    {
+      block->samples  = buffer_samples_recorded;
+      block->tick     = rx_md.time_spec.to_ticks( rate );
+      block->error    = rx_md.error_code;
+      publishBlock( ring );
+    }
+    else if( resampling )
+    {
+      loseBlock( ring );
+      cout << "L";
+    }
+    for( size_t i = 0; !resampling && i < channelCount &&
+                       buffer_samples_recorded; i++ )
+    {
+      fwrite( usrpBuffers[i], COMPLEX_SIZE, buffer_samples_recorded,
+              outputFile[i] );
+      if( !writeFrameTime( indexFile[i], samples_recorded, rx_md.time_spec ) )
+        return_code = 0;
+    }
     samples_recorded += buffer_samples_recorded;
-    //Write results to the output file
-    fwrite(&usrpBuffer.front(), COMPLEX_SIZE, sample_size, outputFile );
+
+    //The first buffer dates the burst, and so its end.  Tuning for the next
+    //job at that moment lets the device settle while this capture is written.
+    if( nextJob && samples_recorded &&
+        samples_recorded == buffer_samples_recorded )
+    {
+      usrp->set_command_time( rx_md.time_spec +
+              uhd::time_spec_t::from_ticks( maximum_samples, usrp->get_rx_rate() ) );
+      tuneUSRP( usrp, nextJob->center_freq, nextJob->rx_gain, channels );
+      usrp->clear_command_time();
+    }
+
+    //Once the last command asked for streams, queue the next one behind it
+    if( samples_requested && buffer_samples_recorded &&
+        samples_recorded > maximum_samples - samples_requested -
+                           __USRP_BURST_SAMPS )
+      continueBurst( usrp, samples_requested );
+  }
+
+  //A burst that broke off may still have commands queued on the device
+  if( samples_recorded < maximum_samples )
+  {
+    if( timeout )
+    {
+      cout  << "Capture ended after " << samples_recorded << " of "
+            << maximum_samples << " samples" << endl;
+      usrp->issue_stream_cmd(
+              uhd::stream_cmd_t( uhd::stream_cmd_t::STREAM_MODE_STOP_CONTINUOUS ) );
+    }
+    return_code = return_code && burstEnded ? -1 : 0;
   }
 
   ///////////////////////////////////////////////////////////
@@ -470,9 +1185,87 @@ int calculateTask(  const char*                   outputFileName,
   //Cleanup Section
   ///////////////////////////////////////////////////////////
 
+  //Let the resampler finish the ring
+  if( resamplerRunning )
+  {
+    resampleArgs.done = true;
+    pthread_join( resampleThread, NULL );
+    if( !resampleArgs.return_code )
+      return_code = 0;
+    if( ring.lost )
+      cout  << endl << ring.lost << " buffers lost to a full resampler ring"
+            << endl;
+  }
+  if( resampling && !resamplers.empty() )
+  {
+    for( size_t i = 0; i < channelCount; i++ )
+      destroyResampler( resamplers[i] );
+    delete [] resampleArgs.output;
+    destroySampleRing( ring );
+    closeArena( arena );
+  }
+
   //Toss out any leftovers and cleanup
-  fclose(outputFile);
+  for( size_t i = 0; i < channelCount; i++ )
+    fclose( outputFile[i] );
+  closeIndexFiles( indexFile, channelCount );
 
-  return 1;
+  return return_code;
 }
 
+
+
+
+
+
+
+
+/*******************************************************************************
+
+
+*******************************************************************************/
+void* resampleThreadStart( void* resample_thread_arg )
+{
+  resample_thread_data*   my_data   = reinterpret_cast<resample_thread_data*>(resample_thread_arg);
+  sample_ring&            ring      = *(my_data->ring);
+  vector<FILE*>&          outputFile = *(my_data->outputFile);
+  unsigned long long      nextBlock = 0;
+  unsigned long long      written   = 0;
+
+  while( true )
+  {
+    //done is only set after the last block is published
+    sample_block* block = waitBlock( ring, nextBlock, 0.1 );
+    if( !block )
+    {
+      if( my_data->done && nextBlock == ring.written )
+        break;
+      continue;
+    }
+
+    //Every channel yields the same number of samples.  The first output of
+    //the block sits position + phase/L input samples into it, less the
+    //delay of the filter, which dates its time stamp.
+    int outputs = 0;
+    for( size_t i = 0; i < ring.channels && block->samples; i++ )
+    {
+      resampler&    rs    = my_data->resamplers[i];
+      const double  first = rs.position +
+                            static_cast<double>(rs.phase)/rs.interpolation -
+                            rs.delay;
+      outputs = resample( rs, reinterpret_cast<float*>(block->data[i]),
+                          block->samples, my_data->output );
+      fwrite( my_data->output, sizeof(float)*2, outputs, outputFile[i] );
+      if( outputs &&
+          !writeFrameTime( my_data->indexFile[i], written,
+                           uhd::time_spec_t::from_ticks( block->tick,
+                                                         my_data->rate ) +
+                           uhd::time_spec_t( first/my_data->rate ) ) )
+        my_data->return_code = 0;
+    }
+    written += outputs;
+    releaseBlocks( ring, ++nextBlock );
+  }
+
+  pthread_exit(NULL);
+}
@@ -46,6 +46,34 @@
  *                               input array to fftw3f, and zero-pads the
  *                               remaining values.
  *
+ * -P [taps]       PFB Taps     -Run a critically sampled polyphase filter
+ *                               bank channelizer with this many taps per
+ *                               channel instead of the windowed FFT (default
+ *                               1, off).  Every frame then spans
+ *                               (FFT Size)*taps samples, consecutive frames
+ *                               are (FFT Size)/Overlap samples apart (use -l 1
+ *                               for critical sampling), and the prototype
+ *                               filter replaces the window file.  See
+ *                               polyphase.h.
+ *
+ * -D [list]       DDC Offsets  -Digital down-converter mode.  A comma
+ *                               separated list of channel offsets (Hz) from
+ *                               the center frequency and start:stop:step
+ *                               ranges, e.g. "-300e3,0,250e3".  Every offset
+ *                               is mixed to DC, decimated by -M and analysed
+ *                               as its own channel: Channel N (the N-th
+ *                               offset) writes "[Output File].chN".  Needs a
+ *                               single receive channel and no sweep.  See
+ *                               ddc.h.
+ *
+ * -M [factor]     Decimation   -Decimation of the DDC channels (default 1).
+ *                               Every channel then runs at (Sample Rate)/factor
+ *                               and its FFT bins are factor times narrower.
+ *                               Frame time stamps of the index file (-I)
+ *                               take out the filter delay (see ddc.h); its
+ *                               sample numbers still count the decimated
+ *                               samples of the channel, so they do not.
+ *
  * -c [children]   Child Threads-This specifies the number of child worker
  *                               threads to spawn for .  If your
  *                               processor has N cores (including hyperthreading
@@ -59,23 +87,255 @@
  *                               for information about identifying USRPs.
  *
  * -f [frequency]  Center Freq  -The center frequency for the FFT process.
- *                               Future plans including adding sweep
- *                               functionality to the program.
+ *                               Not needed with -S.
  *
  * -r [rate]       Sample Rate  -The sample rate of the USRP.  Because of the
  *                               I-Q data from the USRP, this correlates to the
  *                               bandwidth of the FFT calculation.
  *
  * -t [time]       Runtime      -The runtime in seconds for the sensing process.
+ *                               Optional with -L (default: until "quit" or
+ *                               a signal).
  *
  * -g [gain]       RX Gain      -Gain in DB of the rx chain
  *
+ * -S [list]       Sweep        -Sweep mode.  A comma separated list of center
+ *                               frequencies and start:stop:step ranges, e.g.
+ *                               "70e6:6e9:20e6" or "915e6,2.4e9:2.5e9:25e6".
+ *                               The steps are tuned in order with timed
+ *                               commands while the stream keeps running, and
+ *                               each sweep is written as one wideband frame
+ *                               of (steps)*(FFT Size) floats: the spectrum of
+ *                               every step, in list order, negative freqs
+ *                               first.  Pick a step equal to the sample rate
+ *                               for a contiguous spectrum.
+ *
+ * -d [time]       Settle Time  -Seconds of samples discarded after each retune
+ *                               in sweep or daemon mode (default 0.002)
+ *
+ * -n [frames]     Step Frames  -FFT frames averaged into each sweep step
+ *                               (default 1).  The frames overlap according to
+ *                               -l.
+ *
+ * -C [list]       Channels     -Comma separated list of the channels to
+ *                               process (default 0).  All channels are tuned
+ *                               (and swept) together, start on the same sample
+ *                               and share the worker threads.  With more than
+ *                               one channel, channel N is written to
+ *                               "[Output File].chN".
+ *
+ * -R [source]     Time Source  -Set the device time to UNIX time before
+ *                               streaming: "gpsdo" (GPS time on the GPSDO
+ *                               PPS), "external" (host time on the external
+ *                               PPS) or "host" (host time, no PPS).  Falls
+ *                               back to "host" when the source is not
+ *                               available.  Sensors synced to the same PPS
+ *                               produce directly comparable time stamps.
+ *
+ * -Z [time]       Start Time   -Start streaming at this device time (UNIX
+ *                               seconds, e.g. `date +%s` plus a few seconds).
+ *                               Implies -R host unless -R is given.
+ *
+ * -I [file]       Index File   -Write the time stamp of every output frame to
+ *                               this file: one 24-byte record per frame with
+ *                               the stream sample number of its first sample
+ *                               (uint64), and the device time of that sample
+ *                               in whole (int64) and fractional (double)
+ *                               seconds.  In sweep mode the time is that of
+ *                               the first step.  Channel N uses
+ *                               "[Index File].chN".
+ *
+ * -m [name]       Live Feed    -Also publish every output frame into a POSIX
+ *                               shared-memory ring of that name (e.g.
+ *                               "/usrp_sensor"), for live displays on this
+ *                               host.  Channel N uses "[name].chN".  See
+ *                               spectrum_shm.h for the layout and the reader
+ *                               protocol.
+ *
+ * -N [frames]     Feed Frames  -Frames in the live feed ring (default 64)
+ *
+ * -L [path]       Daemon       -Daemon mode.  Keep the device, the workers
+ *                               and the FFT plans alive and take commands on
+ *                               a Unix socket at this path, so a change of
+ *                               frequency, gain, FFT size or output costs
+ *                               milliseconds instead of a restart.  -o is
+ *                               optional: without it the outputs start out
+ *                               stopped.  Not combined with -S.  See the
+ *                               daemon commands below and control_socket.h.
+ *
+ * -p [list]       FFT Pool     -Comma separated list of further FFT sizes to
+ *                               plan up front for the "fft" command of the
+ *                               daemon mode.  Each must be a multiple of the
+ *                               overlap; not combined with -k.  Only the -s
+ *                               size uses the window file, the others use a
+ *                               uniform window (or their own PFB prototype).
+ *
+ * -q [bits]       Quantize     -Write every bin as an 8 or 16-bit dB code
+ *                               instead of a 32-bit float magnitude (default
+ *                               32, no quantization).  Each output file then
+ *                               starts with a header holding the scale, see
+ *                               spectrum_format.h.  8 bits cut the output to a
+ *                               quarter for long monitoring runs.
+ *
+ * -B [dB]         Reference    -dB of code 0 (default -100)
+ *
+ * -U [dB]         Step         -dB per code (default 0.5 for 8 bits, 0.005
+ *                               for 16 bits)
+ *
+ * -k [list]       Bins         -Only compute and write these bins of every
+ *                               frame: a comma separated list of output bin
+ *                               numbers and first:last ranges, where 0 is the
+ *                               most negative frequency and (FFT Size)/2 is
+ *                               DC.  In sweep mode the list applies to every
+ *                               step.  A handful of bins is computed with
+ *                               Goertzel filters instead of the FFT, see
+ *                               bin_selection.h.
+ *
+ * -O [format]     Wire Format  -Sample format between the device and the host:
+ *                               sc16 (default) or sc8.  sc8 halves the link
+ *                               load, so about twice the sample rate fits.
+ *
+ * -F [format]     Host Format  -Sample format UHD hands to the sensor: fc32
+ *                               (default), sc16 or sc8.  The integer formats
+ *                               skip UHD's float conversion; the sensor then
+ *                               converts the samples itself while it copies
+ *                               them into the FFT input buffers.
+ *
+ * -A [plan]       CPU Plan     -Pin the receive thread and the workers (which
+ *                               also write the output) to cpus: "auto" uses
+ *                               the cpus of NUMA node 0, "auto:[interface]"
+ *                               those of the node of that NIC (e.g.
+ *                               "auto:eth2"), and "[recv]:[list]" names them,
+ *                               e.g. "2:4-7,12" (workers take the list in
+ *                               turn).  Every worker's buffers are allocated
+ *                               on its own node.  See cpu_affinity.h.
+ *
+ * -Q [policy]     Worker Policy-Scheduling of the workers: "fifo:[priority]"
+ *                               or "rr:[priority]" (realtime, 1-99; needs
+ *                               CAP_SYS_NICE or an rtprio limit, else the
+ *                               workers run normally with a warning) or
+ *                               "other" (default).  A realtime policy needs
+ *                               -A to give every worker a cpu of its own.
+ *
+ * -H              Lock Memory  -mlockall the sensor once its buffers are
+ *                               set up, so no page of the run is ever
+ *                               swapped out (needs CAP_IPC_LOCK or a large
+ *                               enough memlock limit, else the run goes on
+ *                               unlocked with a warning).  The streaming
+ *                               buffers always come from one arena that is
+ *                               reserved and faulted in up front, on huge
+ *                               pages when some are reserved.  See
+ *                               buffer_arena.h.
+ *
+ * -W [policy]     Overload     -What the receive loop does when every worker
+ *                               is busy: "block" (default) waits for one,
+ *                               which stalls the frames until the receive
+ *                               ring (-b) is full and samples are lost;
+ *                               "drop" drops the frames, "overlap" hands out
+ *                               fewer frames (down to no overlap) while the
+ *                               workers are loaded and "decimate:[n]" down
+ *                               to 1 in n frames.  The sample stream stays
+ *                               gap-free, and the shed frames are counted at
+ *                               the end of the run, by the daemon's status
+ *                               and as gaps in the -I time stamps.  Sweeps
+ *                               always wait.  See overload_policy.h.
+ *
+ * -b [seconds]    Ring Time    -Samples the receive ring holds (default
+ *                               0.25).  A thread of its own does nothing but
+ *                               recv into the ring, so a stall of the rest
+ *                               of the sensor up to that long costs no
+ *                               samples.  An "L" marks samples lost to a full
+ *                               ring; the peak fill is printed at the end of
+ *                               the run.  Sweeps receive without the ring.
+ *                               See sample_ring.h.
+ *
+ *Daemon commands (-L), one per line, each answered with a line that starts
+ *with "ok" or "error":
+ *
+ * freq [Hz]              Retune every channel.  The retune is a timed
+ *                        command right after the newest buffer, and the
+ *                        samples up to the end of the settle time (-d) are
+ *                        dropped, so no frame mixes two frequencies.
+ * gain [dB]              Change the RX gain the same way
+ * fft [size]             Switch to the -s size or one of the -p sizes.  The
+ *                        outputs must be stopped; the live feed rings are
+ *                        created again for the new frame size, so readers
+ *                        attach again.
+ * start [file] [index]   Start writing the output (and the optional index
+ *                        file), named like -o and -I
+ * stop                   Stop writing the output
+ * status                 Frequency, gain, FFT size, output, the frame
+ *                        intervals shed and dropped by -W, the peak fill,
+ *                        size and lost blocks of the receive ring, and the
+ *                        time to the first sample ("ttfs", ms)
+ * quit                   Stop the sensor, like SIGINT or SIGTERM
+ *
+ *SIGINT and SIGTERM (e.g. Ctrl-C) end any run cleanly: the frames in flight
+ *are written and the files closed.  A second signal kills the program.
+ *
+ *At startup the device is set up (and its time synced) on a thread of its
+ *own while the FFT sizes are planned.  Once the first samples are in, the
+ *time since the launch is printed ("Time to first sample") along with when
+ *the device and the plans were ready.
+ *
  *Description of error messages:
  *
  *Need at least one child thread
  *  Worker threads spawn from the parent process.  You must specify at least
  *  one child thread to do the FFT calculations.
  *
+ *Daemon mode cannot sweep
+ *  -L and -S cannot be combined.
+ *
+ *Cannot parse cpu plan
+ *  The -A plan is malformed, names a cpu the program may not run on, or the
+ *  interface has no NUMA node in /sys/class/net.
+ *
+ *Unknown scheduling policy
+ *  -Q takes fifo:[priority], rr:[priority] or other.
+ *
+ *Realtime workers need a cpu each, apart from the receive cpu
+ *  A worker waiting for its turn to write spins, so under -Q fifo or rr it
+ *  would never yield to another worker (or the receive thread) on its cpu.
+ *  Give -A at least -c worker cpus that do not include the receive cpu.
+ *
+ *Unknown overload policy
+ *  -W takes block, drop, overlap or decimate:[n] with n of at least 2.
+ *
+ *Cannot reserve the buffer arena
+ *  The streaming buffers of every planned FFT size do not fit in memory.
+ *
+ *Cannot start the receive thread
+ *  pthread_create failed for the thread that fills the receive ring.
+ *
+ *Cannot lock memory, page faults are possible
+ *  The program lacks the permission for -H.  The run goes on.
+ *
+ *Cannot use the realtime policy for worker [xx], using the normal policy
+ *  The program lacks the permission for -Q.  The run goes on.
+ *
+ *An FFT size pool needs daemon mode and no bin selection
+ *  -p only works with -L and without -k.
+ *
+ *Cannot open control socket
+ *  The -L path is too long or its directory is not writable.
+ *
+ *Cannot parse bin selection
+ *  The -k list is malformed or names a bin outside the frame.
+ *
+ *DDC channels need one receive channel, no sweep and a decimation >= 1
+ *  -D cannot be combined with -S or with several -C channels.
+ *
+ *DDC offset outside the receive band
+ *  Every -D offset must lie within half the sample rate of the center.
+ *
+ *Cannot create shared memory ring
+ *  shm_open or mmap failed for the -m name.  The name must start with a
+ *  slash, and /dev/shm must have room for the ring.
+ *
+ *Quantization must be 8, 16 or 32 bits
+ *  -q only accepts those widths.
+ *
  *Cannot open window file
  *  There was a problem opening the window file.
  *
@@ -105,6 +365,13 @@
  *  There was a serious problem creating child threads.  The program could have
  *  run out of system resources, or any number of reasons.
  *
+ *Start time has already passed
+ *  The -Z time is not far enough in the future to issue the stream command.
+ *
+ *Sweep step [xx] lost
+ *  An overflow dropped samples inside the capture window of that step.  Its
+ *  part of the wideband frame is left at zero.
+ *
  *Input data terminated with unaligned data
  *  It is entirely possible to have an input data file that is not some integral
  *  mutiple of (FFT Size)/Overlap.  If this is the case, the program runs until
@@ -129,19 +396,32 @@
  * 0.2 - Changed USRP streaming mode to continuous and changed the counter datatype
  *        to accomodate large sample periods (unsigned long long int = 2^128) 2012
  * 0.3 - Changed to cmake and upload to github 20130701
+ * 0.4 - Frequency sweep mode with timed retuning
+ *       Multi-channel receive
+ *       Timed stream start and per-frame time stamps
+ *       Quantized dB output
+ *       Frequency-subset output
+ *       Polyphase filter bank channelizer
+ *       Digital down-converter channels
+ *       Shared-memory live feed
+ *       Daemon mode with a control socket
+ *       Wire and host formats selected at runtime
+ *       Single-pass frame assembly
+ *       CPU affinity plan and realtime workers
+ *       Huge-page buffer arena and memory locking
+ *       Overload policy that sheds frames instead of blocking recv
+ *       Receive thread with a lock-free sample ring
+ *       Parallel startup with a time to first sample report
  */
 
 //Define some of the values we use to setup the USRP and FFT process
-#define __USRP_CPU_FMT  "fc32"
-
-#ifdef WIRE_SC8
-  #define __USRP_WIRE_FMT "sc8"
-#else
-  #define __USRP_WIRE_FMT "sc16"
-#endif
-
 #define __USRP_CLK_SRC  "internal"
 
+//Minimum time (seconds) between the newest received sample and a timed
+//retune.  Covers the latency between the host and the device clock so the
+//command never arrives late.
+#define __SWEEP_COMMAND_LEAD  0.01
+
 //USRP Headers
 #include <uhd/utils/thread_priority.hpp>
 #include <uhd/utils/safe_main.hpp>
@@ -155,11 +435,25 @@
 #include <cstring>
 #include <cstdio>
 #include <cstdlib>
+#include <cmath>
+#include <climits>
+#include <ctime>
 #include <pthread.h>
 #include <mqueue.h>
 #include <unistd.h>
 
 #include "fft_thread.h"
+#include "usrp_common.h"
+#include "spectrum_format.h"
+#include "bin_selection.h"
+#include "polyphase.h"
+#include "ddc.h"
+#include "spectrum_shm.h"
+#include "control_socket.h"
+#include "cpu_affinity.h"
+#include "buffer_arena.h"
+#include "overload_policy.h"
+#include "sample_ring.h"
 
 
 #ifdef BENCHMARK
@@ -173,6 +467,58 @@
 
 using namespace std;
 
+//One FFT size of the daemon pool: a plan and buffers for every worker
+struct fft_pool_entry
+{
+  int               size;         //FFT size
+  fftwf_plan*       plans;        //one plan per worker
+  _Complex float**  inputData;    //fft input of every worker
+  _Complex float**  outputData;   //fft output of every worker
+  _Complex float**  frameData;    //PFB frame of every worker (inputData
+                                  //when taps is 1)
+  float*            window2;      //window or PFB prototype, interleaved and
+                                  //scaled for the input buffers (see
+                                  //interleaveWindow)
+};
+
+//Arguments of the receive thread
+struct recv_thread_data
+{
+  uhd::rx_streamer::sptr  stream;       //the running stream
+  sample_ring*            ring;         //blocks to receive into
+  vector<void*>           spare;        //buffers of a receive that found the
+                                        //ring full (its samples are lost)
+  volatile int            rxSamples;    //samples per block (switched by the
+                                        //reader along with the FFT size)
+  double                  rate;         //sample rate, for the block ticks
+  double                  firstTimeout; //wait for the first block
+  const cpu_plan*         cpuPlan;      //the thread runs on recvCpu
+  volatile bool           stop;         //set by the reader to end the thread
+};
+
+//Milestones of the startup, in ms since the launch
+struct startup_timing
+{
+  timespec                launch;       //CLOCK_MONOTONIC at the launch
+  double                  deviceReady;  //device set up and its time synced
+  double                  plansReady;   //every FFT size planned
+  double                  firstSample;  //first samples in, -1 until then
+};
+
+//Arguments of the device bring-up thread
+struct device_setup_data
+{
+  uhd::usrp::multi_usrp::sptr usrp;     //the device, once it is set up
+  float                   centerFreq;
+  float                   sampleRate;
+  int                     gain;
+  const vector<size_t>*   channels;
+  const char*             usrpArgs;
+  const char*             timeSource;   //NULL leaves the device time alone
+  int                     ready;        //1 once the device is set up
+  startup_timing*         startup;      //gets deviceReady
+};
+
 /*useage()
  *
  *Display program useage information
@@ -180,6 +526,22 @@ using namespace std;
  */
 void useage();
 
+/*freeArguments(...)
+ *
+ *Frees what main allocated from the options: the strings, the window and the
+ *bin selection (any of them may still be NULL)
+ */
+void freeArguments( char*           outputFileName,
+                    char*           windowFileName,
+                    char*           usrpArgs,
+                    char*           timeSource,
+                    char*           indexFileName,
+                    char*           binList,
+                    char*           shmName,
+                    char*           controlPath,
+                    float*          window,
+                    bin_selection*  bins );
+
 /*openFiles( char*, FILE*&, char*, FILE*& )
  *
  *Open the input and output files, and perform error handling if there is a
@@ -188,21 +550,48 @@ void useage();
 int openFiles( const char*  outputFileName,
                FILE*&       outputFile );
 
+/*openOutputs(...)
+ *
+ *Opens the output file (with its format header) and the index file of every
+ *output channel.  A NULL outputFileName leaves the outputs stopped: every
+ *outputFile and indexFile entry is NULL.  Returns 0, with the outputs
+ *stopped, if a file cannot be opened.
+ */
+int openOutputs( const char*             outputFileName,
+                 const char*             indexFileName,
+                 const vector<size_t>&   outputs,
+                 const spectrum_format&  format,
+                 const int               frameBins,
+                 FILE**                  outputFile,
+                 FILE**&                 indexFile );
+
+/*closeOutputs( FILE**, FILE**&, size_t )
+ *
+ *Closes the files of openOutputs and frees indexFile
+ */
+void closeOutputs( FILE** outputFile, FILE**& indexFile, size_t channelCount );
+
 /*createFFTPlans( fftwf_plan*&, _Complex float**&, _Complex float**&,
-                  int, int)
+                  int, int, const cpu_plan&, buffer_arena& )
  *
- *Initialize the FFT plans.  This creates max_children plans for FFTSize FFTs
+ *Initialize the FFT plans.  This creates max_children plans for FFTSize FFTs.
+ *The buffers of every worker are carved out of arena and planned on the
+ *worker's cpu, so they live on its NUMA node.
  */
 void createFFTPlans( fftwf_plan*&     plans,
                      _Complex float**& inputData,
                      _Complex float**& outputData,
                      int              FFTSize,
-                     int              max_children );
+                     int              max_children,
+                     const cpu_plan&  cpuPlan,
+                     buffer_arena&    arena );
 
 /*initializeThreads(...)
  *
- *Initialize and spawn all the child threads.  Returns 0 upon thread or mqueue
- *failure.
+ *Initialize and spawn all the child threads, on the cpus and with the
+ *policy of cpuPlan.  The PFB frames and the magnitude scratch (for FFTs of
+ *up to maxFFTSize) of the workers come out of arena.  Returns 0 upon thread
+ *or mqueue failure.
  */
 int initializeThreads( pthread_mutex_t&         mutex,
                        pthread_mutexattr_t&     attr,
@@ -217,29 +606,204 @@ int initializeThreads( pthread_mutex_t&         mutex,
                        _Complex float**&         outputData,
                        float*&                  window,
                        int                      FFTSize,
-                       int*&                    thread_control );
+                       int*&                    thread_control,
+                       const spectrum_format&   format,
+                       const bin_selection*     bins,
+                       int                      taps,
+                       const cpu_plan&          cpuPlan,
+                       int                      maxFFTSize,
+                       buffer_arena&            arena );
+
+/*recvThreadStart
+ *
+ *pthread starting function of the receive thread: receives blocks into the
+ *ring (see recv_thread_data and sample_ring.h) until it is stopped or the
+ *stream fails
+ */
+void* recvThreadStart( void* recv_thread_arg );
+
+/*deviceSetupStart
+ *
+ *pthread starting function of the device bring-up: setupUSRP and syncTime
+ *with the arguments of a device_setup_data.  A UHD exception counts as a
+ *failed setup.
+ */
+void* deviceSetupStart( void* device_setup_arg );
+
+/*primeFFTPlans( int, const vector<int>& )
+ *
+ *Plans FFTSize and every pool size once on scratch buffers.  FFTW keeps the
+ *wisdom, so the plans of the workers are made later on without measuring.
+ */
+void primeFFTPlans( const int FFTSize, const vector<int>& fftPool );
+
+/*msSince( const timespec& )
+ *
+ *Milliseconds of CLOCK_MONOTONIC since since
+ */
+double msSince( const timespec& since );
+
+/*reportStartup( startup_timing& )
+ *
+ *Stamps the first sample and prints the startup milestones
+ */
+void reportStartup( startup_timing& startup );
+
+/*useFFTSize( struct fft_thread_data*, int, const fft_pool_entry& )
+ *
+ *Hands the plans and buffers of one pool size to the workers, which must be
+ *idle
+ */
+void useFFTSize( struct fft_thread_data*  fft_child_args,
+                 const int                max_children,
+                 const fft_pool_entry&    entry );
+
+/*waitForWorkers( struct fft_thread_data*, int )
+ *
+ *Blocks until every worker has written its frame
+ */
+void waitForWorkers( struct fft_thread_data* fft_child_args,
+                     const int               max_children );
+
+/*parseSweep( const char*, vector<double>& )
+ *
+ *Expands a sweep list (see -S) into the center frequency of every step.
+ *Returns 0 on a malformed list.
+ */
+int parseSweep( const char* list, vector<double>& frequencies );
 
 /*calculateTask(...)
  *
  *This is the main work of the program, performing the specified overlapped
- *FFT transforms
+ *FFT transforms.  A non-empty sweepFrequencies selects the sweep mode.  Each
+ *channel has its own input buffer and output file, and its frames are handed
+ *to the shared worker pool in turn.  A non-NULL indexFileName records the
+ *time stamp of every output frame.  The frames are written in outputFormat.
+ *A non-NULL bins writes only the selected bins of every frame (or step).
+ *With pfbTaps > 1 window is the (FFTSize*pfbTaps)-point prototype of a
+ *polyphase filter bank.  A non-empty ddcOffsets replaces the channels by DDC
+ *channels of the first receive channel, decimated by ddcDecimation.  A
+ *non-NULL shmName also publishes every frame into a shared-memory ring of
+ *shmSlots frames per channel.  A non-NULL control runs the daemon mode: its
+ *commands are applied between two buffers while the stream keeps running,
+ *fftPool holds the further FFT sizes planned up front, retunes settle for
+ *sweepSettle seconds and a NULL outputFileName starts with the outputs
+ *stopped.  The run ends after maximum_samples samples, on a "quit" command
+ *or on SIGINT/SIGTERM.  The samples cross the wire in wireFormat and arrive
+ *in hostFormat.  A receive thread of its own (on the receive cpu of cpuPlan)
+ *receives them into a ring of ringSeconds of samples, and the frames are
+ *converted and windowed straight out of the ring's blocks in the single pass
+ *that assembles each frame.
+ *cpuPlan places the receive thread and the workers.  Every streaming buffer
+ *comes out of one arena reserved up front; lockPages also locks the memory
+ *of the process once it is set up.  overloadPolicy decides what happens to
+ *the frames while every worker is busy.  The first samples complete startup
+ *(see reportStartup).  Returns 0 if anything failed along the way.
  */
 int calculateTask(  const char*                   outputFileName,
                     const int                     FFTSize,
                     const int                     FFTOverlap,
                     const int                     max_children,
                     float*                        window,
+                    const int                     pfbTaps,
+                    const vector<size_t>&         channels,
+                    const vector<double>&         ddcOffsets,
+                    const int                     ddcDecimation,
+                    const vector<double>&         sweepFrequencies,
+                    const double                  sweepSettle,
+                    const int                     sweepFrames,
+                    const double                  startTime,
+                    const char*                   indexFileName,
+                    const spectrum_format&        outputFormat,
+                    const bin_selection*          bins,
+                    const char*                   shmName,
+                    const int                     shmSlots,
+                    const vector<int>&            fftPool,
+                    control_socket*               control,
+                    const sample_format           wireFormat,
+                    const sample_format           hostFormat,
+                    const cpu_plan&               cpuPlan,
+                    const bool                    lockPages,
+                    const overload_policy&        overloadPolicy,
+                    const double                  ringSeconds,
                     const unsigned long long int  maximum_samples,
+                    startup_timing&               startup,
                     uhd::usrp::multi_usrp::sptr&  usrp );
 
+/*sweepTask(...)
+ *
+ *Work section of the sweep mode.  The stream is already running on the first
+ *frequency.  While the samples of one step are collected the timed retune
+ *for the next step is already queued on the device, and the frames of a
+ *finished step are computed by the workers while the following steps are
+ *collected.  Each step's frames are averaged into its slot of a wideband
+ *frame, which is written once the whole sweep is done.  Every channel has
+ *its own wideband frame and output file (and live feed, if shm is not
+ *NULL).  firstTimeout covers the wait for the stream start.  The stream
+ *delivers hostFormat samples, which are converted and windowed with window2
+ *(see interleaveWindow) while each frame is assembled.  The first samples
+ *complete startup.
+ */
+int sweepTask(  struct fft_thread_data*       fft_child_args,
+                mqd_t*                        fft_mq,
+                const int                     max_children,
+                const int                     FFTSize,
+                const int                     FFTOverlap,
+                const vector<size_t>&         channels,
+                FILE**                        outputFile,
+                FILE**                        indexFile,
+                spectrum_shm*                 shm,
+                const vector<double>&         frequencies,
+                const double                  settle,
+                const int                     frames,
+                const unsigned long long int  maximum_samples,
+                const double                  firstTimeout,
+                const sample_format           hostFormat,
+                const float*                  window2,
+                startup_timing&               startup,
+                uhd::rx_streamer::sptr&       usrp_rx_stream,
+                uhd::usrp::multi_usrp::sptr&  usrp );
+
+/*tuneStep(...)
+ *
+ *Queues a retune of every channel to frequency at sample tick tick of the
+ *device clock.  Returns tick.
+ */
+long long tuneStep( uhd::usrp::multi_usrp::sptr&  usrp,
+                    const vector<size_t>&         channels,
+                    const double                  frequency,
+                    const long long               tick,
+                    const double                  rate );
+
+/*writeSweep(...)
+ *
+ *Scales the accumulated wideband frame of every channel to the frame average,
+ *writes it to the channel's output file in format (and its time stamp to the
+ *index file, and the frame to the live feed if shm is not NULL) and clears
+ *it for the next sweep.  scratch has room for
+ *frameSize 16-bit codes.  Returns 0 on a write error.
+ */
+int writeSweep( float**                   sweepFrame,
+                FILE**                    outputFile,
+                FILE**                    indexFile,
+                spectrum_shm*             shm,
+                const unsigned long long  sample,
+                const uhd::time_spec_t&   time,
+                const size_t              channelCount,
+                const int                 frameSize,
+                const float               frameScale,
+                const spectrum_format&    format,
+                void*                     scratch );
+
 /*setupUSRP(...)
  *
- *Setup the USRP for receiving at the specified freq and rate
+ *Setup the USRP for receiving at the specified freq and rate on every channel
  */
 int setupUSRP(  uhd::usrp::multi_usrp::sptr&  usrp,
                 const float                   center_freq,
                 const float                   sample_rate,
                 const int                     rx_gain,
+                const vector<size_t>&         channels,
                 const char*                   dev_addr);
 
 
@@ -257,31 +821,61 @@ int main( int argc, char* argv[])
   //First things first, try to set realtime priority for the parent thread
   uhd::set_thread_priority_safe();
 
+  //Ctrl-C and kill end the run cleanly
+  installStopHandler();
+
+  //The clock of the time to first sample starts now
+  startup_timing startup;
+  clock_gettime( CLOCK_MONOTONIC, &startup.launch );
+  startup.firstSample = -1;
+
   const int FLOAT_SIZE = sizeof(float); //Size of single-precision float
   //in bytes
 
-  //Ensure the correct number of arguments were passed
-  if( argc != 19)
-  {
-    cout << "Only " << argc << " parameters entered" << endl;
-    useage();
-    return -1;
-  }
-
   char  *outputFileName = NULL;
   char  *windowFileName = NULL;
   char  *usrpArgs       = NULL;
+  char  *timeSource     = NULL;
+  char  *indexFileName  = NULL;
+  double startTime      = 0;
+  int   quantizeBits    = 32;
+  float dbReference     = __SPECTRUM_REFERENCE;
+  float dbStep          = 0;
+  char  *binList        = NULL;
+  char  *shmName        = NULL;
+  int   shmSlots        = __SPECTRUM_SHM_SLOTS;
+  char  *controlPath    = NULL;
+  vector<size_t> poolSizes;
+  vector<int>    fftPool;
   int   usrpGain        = 0;
   int   FFTSize         = 0;
   int   FFTOverlap      = 0;
+  int   pfbTaps         = 1;
+  int   ddcDecimation   = 1;
   int   arg             = 0;
   int   max_children    = 0;
   float usrpCenterFreq  = 0.0f;
   float usrpSampleRate  = 0.0f;
   float usrpRecordTime  = 0.0f;
+  double sweepSettle    = 0.002;
+  int   sweepFrames     = 1;
+  vector<double> sweepFrequencies;
+  vector<double> ddcOffsets;
+  vector<size_t> channels( 1, 0 );
+  sample_format wireFormat = __USRP_WIRE_FMT;
+  sample_format hostFormat = SAMPLE_FC32;
+  cpu_plan      cpuPlan;
+  initializeCpuPlan( cpuPlan );
+  bool          lockPages = false;
+  overload_policy overload;
+  parseOverloadPolicy( "block", overload );
+  double        ringSeconds = __SAMPLE_RING_SECONDS;
+  float*        window    = NULL;
+  bin_selection selection;
+  bin_selection* bins     = NULL;
 
   //argument parsing
-  while( (arg = getopt( argc, argv, "o:s:l:c:w:a:f:r:t:g:")) != -1 )
+  while( (arg = getopt( argc, argv, "o:s:l:c:w:a:f:r:t:g:S:d:n:C:R:Z:I:q:B:U:k:P:D:M:m:N:L:p:O:F:A:Q:HW:b:")) != -1 )
   {
     switch (arg)
     {
@@ -318,39 +912,304 @@ int main( int argc, char* argv[])
       case 'g':
         usrpGain = atoi(optarg);
         break;
+      case 'd':
+        sweepSettle = atof(optarg);
+        break;
+      case 'b':
+        ringSeconds = atof(optarg);
+        break;
+      case 'n':
+        sweepFrames = atoi(optarg);
+        break;
+      case 'q':
+        quantizeBits = atoi(optarg);
+        break;
+      case 'B':
+        dbReference = atof(optarg);
+        break;
+      case 'U':
+        dbStep = atof(optarg);
+        break;
+      case 'P':
+        pfbTaps = atoi(optarg);
+        break;
+      case 'M':
+        ddcDecimation = atoi(optarg);
+        break;
+      case 'm':
+        shmName = new char[strlen(optarg)+1];
+        strcpy(shmName,optarg);
+        break;
+      case 'N':
+        shmSlots = atoi(optarg);
+        break;
+      case 'L':
+        controlPath = new char[strlen(optarg)+1];
+        strcpy(controlPath,optarg);
+        break;
+      case 'k':
+        binList = new char[strlen(optarg)+1];
+        strcpy(binList,optarg);
+        break;
+      case 'R':
+        timeSource = new char[strlen(optarg)+1];
+        strcpy(timeSource,optarg);
+        break;
+      case 'Z':
+        startTime = atof(optarg);
+        break;
+      case 'I':
+        indexFileName = new char[strlen(optarg)+1];
+        strcpy(indexFileName,optarg);
+        break;
+      case 'C':
+        if( parseChannels( optarg, channels ) )
+          break;
+        cout << "Cannot parse channel list " << optarg << endl;
+        useage();
+        freeArguments( outputFileName, windowFileName, usrpArgs, timeSource,
+                       indexFileName, binList, shmName, controlPath, window,
+                       bins );
+        return -1;
+      case 'p':
+        if( parseChannels( optarg, poolSizes ) )
+          break;
+        cout << "Cannot parse FFT size pool " << optarg << endl;
+        useage();
+        freeArguments( outputFileName, windowFileName, usrpArgs, timeSource,
+                       indexFileName, binList, shmName, controlPath, window,
+                       bins );
+        return -1;
+      case 'O':
+        if( parseWireFormat( optarg, wireFormat ) )
+          break;
+        cout << "Unknown wire format " << optarg << endl;
+        useage();
+        freeArguments( outputFileName, windowFileName, usrpArgs, timeSource,
+                       indexFileName, binList, shmName, controlPath, window,
+                       bins );
+        return -1;
+      case 'F':
+        if( parseSampleFormat( optarg, hostFormat ) )
+          break;
+        cout << "Unknown host format " << optarg << endl;
+        useage();
+        freeArguments( outputFileName, windowFileName, usrpArgs, timeSource,
+                       indexFileName, binList, shmName, controlPath, window,
+                       bins );
+        return -1;
+      case 'A':
+        if( parseCpuPlan( optarg, cpuPlan ) )
+          break;
+        cout << "Cannot parse cpu plan " << optarg << endl;
+        useage();
+        freeArguments( outputFileName, windowFileName, usrpArgs, timeSource,
+                       indexFileName, binList, shmName, controlPath, window,
+                       bins );
+        return -1;
+      case 'Q':
+        if( parseSchedPolicy( optarg, cpuPlan ) )
+          break;
+        cout << "Unknown scheduling policy " << optarg << endl;
+        useage();
+        freeArguments( outputFileName, windowFileName, usrpArgs, timeSource,
+                       indexFileName, binList, shmName, controlPath, window,
+                       bins );
+        return -1;
+      case 'H':
+        lockPages = true;
+        break;
+      case 'W':
+        if( parseOverloadPolicy( optarg, overload ) )
+          break;
+        cout << "Unknown overload policy " << optarg << endl;
+        useage();
+        freeArguments( outputFileName, windowFileName, usrpArgs, timeSource,
+                       indexFileName, binList, shmName, controlPath, window,
+                       bins );
+        return -1;
+      case 'D':
+        if( parseSweep( optarg, ddcOffsets ) )
+          break;
+        cout << "Cannot parse DDC offset list " << optarg << endl;
+        useage();
+        freeArguments( outputFileName, windowFileName, usrpArgs, timeSource,
+                       indexFileName, binList, shmName, controlPath, window,
+                       bins );
+        return -1;
+      case 'S':
+        if( parseSweep( optarg, sweepFrequencies ) )
+          break;
+        cout << "Cannot parse sweep list " << optarg << endl;
+        //fall through
       case '?':
         useage();
-        if( outputFileName )
-          delete [] outputFileName;
-        if( usrpArgs )
-          delete [] usrpArgs;
-        if( windowFileName )
-          delete [] windowFileName;
+        freeArguments( outputFileName, windowFileName, usrpArgs, timeSource,
+                       indexFileName, binList, shmName, controlPath, window,
+                       bins );
         return -1;
       }
   }
-  //Check FFT and Overlap compatibility
-  if( FFTSize % FFTOverlap )
+
+  //Ensure the required arguments were passed.  The daemon mode can start
+  //with the outputs stopped and run until it is told to quit.
+  if( ( !outputFileName && !controlPath ) || !usrpArgs || FFTSize < 1 ||
+      FFTOverlap < 1 || pfbTaps < 1 || shmSlots < 1 || ringSeconds <= 0 ||
+      usrpSampleRate <= 0.0f || usrpRecordTime < 0.0f ||
+      ( usrpRecordTime == 0.0f && !controlPath ) )
   {
-    cout  << "Incompatible FFT Size and Overlap factor " << endl
-          << "FFT Size: " << FFTSize << endl
-          << "Overlap: " << FFTOverlap << endl
-          << "Modulus: " << FFTSize % FFTOverlap
-          << endl;
+    useage();
+    freeArguments( outputFileName, windowFileName, usrpArgs, timeSource,
+                   indexFileName, binList, shmName, controlPath, window,
+                   bins );
+    return -1;
+  }
+
+  //Check the daemon options.  The pool holds the sizes besides FFTSize.
+  if( controlPath && !sweepFrequencies.empty() )
+  {
+    cout  << "Daemon mode cannot sweep" << endl;
+    freeArguments( outputFileName, windowFileName, usrpArgs, timeSource,
+                   indexFileName, binList, shmName, controlPath, window,
+                   bins );
+    return -1;
+  }
+  if( !poolSizes.empty() && ( !controlPath || binList ) )
+  {
+    cout  << "An FFT size pool needs daemon mode and no bin selection" << endl;
+    freeArguments( outputFileName, windowFileName, usrpArgs, timeSource,
+                   indexFileName, binList, shmName, controlPath, window,
+                   bins );
     return -1;
   }
+  for( size_t k = 0; k < poolSizes.size(); k++ )
+    if( static_cast<int>(poolSizes[k]) != FFTSize &&
+        find( fftPool.begin(), fftPool.end(),
+              static_cast<int>(poolSizes[k]) ) == fftPool.end() )
+      fftPool.push_back( static_cast<int>(poolSizes[k]) );
+
+  //Check FFT and Overlap compatibility
+  for( size_t k = 0; k <= fftPool.size(); k++ )
+  {
+    int size = k ? fftPool[k-1] : FFTSize;
+    if( size % FFTOverlap || size < 1 )
+    {
+      cout  << "Incompatible FFT Size and Overlap factor " << endl
+            << "FFT Size: " << size << endl
+            << "Overlap: " << FFTOverlap << endl
+            << "Modulus: " << size % FFTOverlap
+            << endl;
+      freeArguments( outputFileName, windowFileName, usrpArgs, timeSource,
+                     indexFileName, binList, shmName, controlPath, window,
+                     bins );
+      return -1;
+    }
+  }
 
   //Check multithreading options
   if( max_children < 1 )
   {
     cout  << "Need at least one child thread" << endl;
+    freeArguments( outputFileName, windowFileName, usrpArgs, timeSource,
+                   indexFileName, binList, shmName, controlPath, window,
+                   bins );
     return -1;
   }
+  if( !realtimeFits( cpuPlan, max_children ) )
+  {
+    cout  << "Realtime workers need a cpu each, apart from the receive cpu"
+          << endl;
+    freeArguments( outputFileName, windowFileName, usrpArgs, timeSource,
+                   indexFileName, binList, shmName, controlPath, window,
+                   bins );
+    return -1;
+  }
+  if( cpuPlan.recvCpu >= 0 )
+  {
+    cout  << "Receive thread on cpu " << cpuPlan.recvCpu << ", workers on cpus";
+    for( int i = 0; i < max_children; i++ )
+      cout << ( i ? "," : " " ) << workerCpu( cpuPlan, i );
+    if( cpuPlan.node >= 0 )
+      cout << " (node " << cpuPlan.node << ")";
+    cout << endl;
+  }
+
+  //Check the output format
+  spectrum_format outputFormat;
+  if( !initializeSpectrumFormat( outputFormat, quantizeBits, dbReference,
+                                 dbStep ) )
+  {
+    cout  << "Quantization must be 8, 16 or 32 bits" << endl;
+    freeArguments( outputFileName, windowFileName, usrpArgs, timeSource,
+                   indexFileName, binList, shmName, controlPath, window,
+                   bins );
+    return -1;
+  }
+
+  //Check the bin selection
+  if( binList )
+  {
+    if( !parseBinSelection( binList, FFTSize, selection ) )
+    {
+      cout  << "Cannot parse bin selection " << binList << endl;
+      freeArguments( outputFileName, windowFileName, usrpArgs, timeSource,
+                     indexFileName, binList, shmName, controlPath, window,
+                     bins );
+      return -1;
+    }
+    bins = &selection;
+    cout  << "Computing " << selection.count << " bins with "
+          << ( selection.goertzel ? "Goertzel filters" : "the FFT" ) << endl;
+  }
+
+  //Check sweep options
+  if( sweepFrames < 1 || sweepSettle < 0 )
+  {
+    cout  << "Need at least one frame per sweep step and a non-negative "
+          << "settle time" << endl;
+    freeArguments( outputFileName, windowFileName, usrpArgs, timeSource,
+                   indexFileName, binList, shmName, controlPath, window,
+                   bins );
+    return -1;
+  }
+
+  //Check DDC options
+  if( !ddcOffsets.empty() &&
+      ( channels.size() != 1 || !sweepFrequencies.empty() || ddcDecimation < 1 ) )
+  {
+    cout  << "DDC channels need one receive channel, no sweep and a "
+          << "decimation >= 1" << endl;
+    freeArguments( outputFileName, windowFileName, usrpArgs, timeSource,
+                   indexFileName, binList, shmName, controlPath, window,
+                   bins );
+    return -1;
+  }
+  for( size_t k = 0; k < ddcOffsets.size(); k++ )
+    if( fabs( ddcOffsets[k] ) >= 0.5*usrpSampleRate )
+    {
+      cout  << "DDC offset outside the receive band: " << ddcOffsets[k] << endl;
+      freeArguments( outputFileName, windowFileName, usrpArgs, timeSource,
+                     indexFileName, binList, shmName, controlPath, window,
+                     bins );
+      return -1;
+    }
+
+  //A sweep starts out on its first step
+  if( !sweepFrequencies.empty() )
+    usrpCenterFreq = sweepFrequencies[0];
 
-  float* window = new float[FFTSize];
+  //A filter bank replaces the window with its prototype filter
+  window = pfbTaps > 1 ? pfbPrototype( FFTSize, pfbTaps )
+                       : new float[FFTSize];
   FILE* window_file;
-  window_file = fopen( windowFileName, "r" );
-  if( !window_file )
+  window_file = windowFileName && pfbTaps == 1 ? fopen( windowFileName, "r" )
+                                               : NULL;
+  if( pfbTaps > 1 )
+  {
+    cout << "Polyphase filter bank with " << pfbTaps
+         << " taps per channel" << endl;
+  }
+  else if( !window_file )
   {
     cout << "Cannot open window file" << endl
          << "Assuming uniform window" << endl;
@@ -374,11 +1233,10 @@ int main( int argc, char* argv[])
       cout  << "Window is too large!" << endl
             << "FFT Size: " << FFTSize << endl
             << "Window Size: " << window_size << endl;
-      delete [] outputFileName;
-      delete [] windowFileName;
-      delete [] window;
-      delete [] usrpArgs;
       fclose( window_file );
+      freeArguments( outputFileName, windowFileName, usrpArgs, timeSource,
+                     indexFileName, binList, shmName, controlPath, window,
+                     bins );
       return 1;
     }
 
@@ -398,35 +1256,100 @@ int main( int argc, char* argv[])
     }
   }
   cout << "Initializing USRP device" << endl;
-  //Initialize the USRP hardware
-  uhd::usrp::multi_usrp::sptr the_usrp;
-  if( !setupUSRP( the_usrp,
-                  usrpCenterFreq,
-                  usrpSampleRate,
-                  usrpGain,
-                  usrpArgs ))
+  //Initialize the USRP hardware on a thread of its own (a start time only
+  //makes sense on a known clock) while this one plans the FFTs.  Without the
+  //thread the two run one after the other.
+  device_setup_data deviceSetup;
+  pthread_t         deviceThread;
+  deviceSetup.centerFreq  = usrpCenterFreq;
+  deviceSetup.sampleRate  = usrpSampleRate;
+  deviceSetup.gain        = usrpGain;
+  deviceSetup.channels    = &channels;
+  deviceSetup.usrpArgs    = usrpArgs;
+  deviceSetup.timeSource  = timeSource ? timeSource :
+                            startTime > 0 ? "host" : NULL;
+  deviceSetup.ready       = 0;
+  deviceSetup.startup     = &startup;
+  bool deviceThreaded     = !pthread_create( &deviceThread, NULL,
+                                deviceSetupStart,
+                                reinterpret_cast<void *>(&deviceSetup) );
+  if( !deviceThreaded )
+    deviceSetupStart( &deviceSetup );
+  primeFFTPlans( FFTSize, fftPool );
+  startup.plansReady = msSince( startup.launch );
+  if( deviceThreaded )
+    pthread_join( deviceThread, NULL );
+
+  uhd::usrp::multi_usrp::sptr the_usrp = deviceSetup.usrp;
+  if( !deviceSetup.ready )
   {
     cout << "Error initializing the USRP device." << endl;
-    delete [] outputFileName;
-    delete [] windowFileName;
-    delete [] window;
-    delete [] usrpArgs;
+    freeArguments( outputFileName, windowFileName, usrpArgs, timeSource,
+                   indexFileName, binList, shmName, controlPath, window,
+                   bins );
     return 1;
   }
+
+  //Take commands once the device is ready
+  control_socket  controlSocket;
+  control_socket* control = NULL;
+  if( controlPath )
+  {
+    if( !openControlSocket( controlSocket, controlPath ) )
+    {
+      cout << "Cannot open control socket " << controlPath << endl;
+      freeArguments( outputFileName, windowFileName, usrpArgs, timeSource,
+                     indexFileName, binList, shmName, controlPath, window,
+                     bins );
+      return 1;
+    }
+    control = &controlSocket;
+    cout << "Listening on " << controlPath << endl;
+  }
+
+  //Without a runtime the daemon runs until it is told to stop
+  unsigned long long int maximum_samples = usrpRecordTime > 0.0f ?
+    static_cast<unsigned long long int>(usrpSampleRate*usrpRecordTime) :
+    ULLONG_MAX;
+
   //Perform the actual work
-  if( !calculateTask( outputFileName,
+  int return_code = calculateTask( outputFileName,
                       FFTSize,
                       FFTOverlap,
                       max_children,
                       window,
-                      static_cast<unsigned long long int>(usrpSampleRate*usrpRecordTime),
-                      the_usrp ) )
+                      pfbTaps,
+                      channels,
+                      ddcOffsets,
+                      ddcDecimation,
+                      sweepFrequencies,
+                      sweepSettle,
+                      sweepFrames,
+                      startTime,
+                      indexFileName,
+                      outputFormat,
+                      bins,
+                      shmName,
+                      shmSlots,
+                      fftPool,
+                      control,
+                      wireFormat,
+                      hostFormat,
+                      cpuPlan,
+                      lockPages,
+                      overload,
+                      ringSeconds,
+                      maximum_samples,
+                      startup,
+                      the_usrp );
+  if( control )
+    closeControlSocket( *control );
+  if( !return_code )
   {
     cout << "Error performing calculations" << endl;
-    delete [] outputFileName;
-    delete [] windowFileName;
-    delete [] window;
-    delete [] usrpArgs;
+    freeArguments( outputFileName, windowFileName, usrpArgs, timeSource,
+                   indexFileName, binList, shmName, controlPath, window,
+                   bins );
     return 1;
   }
 
@@ -434,10 +1357,9 @@ int main( int argc, char* argv[])
   usrp_stream_stop.stream_now = false;
   usrp_stream_stop.time_spec = uhd::time_spec_t();
   the_usrp->issue_stream_cmd( usrp_stream_stop );
-  delete [] outputFileName;
-  delete [] windowFileName;
-  delete [] window;
-  delete [] usrpArgs;
+  freeArguments( outputFileName, windowFileName, usrpArgs, timeSource,
+                 indexFileName, binList, shmName, controlPath, window,
+                 bins );
   return 0;
 }
 
@@ -456,6 +1378,7 @@ int setupUSRP(  uhd::usrp::multi_usrp::sptr&  usrp,
                 const float                   center_freq,
                 const float                   sample_rate,
                 const int                     rx_gain,
+                const vector<size_t>&         channels,
                 const char*                   dev_addr)
 {
   //Initialize the USRP to the specified address
@@ -482,42 +1405,53 @@ int setupUSRP(  uhd::usrp::multi_usrp::sptr&  usrp,
     cout.setf(originalFlags);
   }
 
-  //Try setting the center frequency.  Like above, if we get a different
-  //frequency than the one we're requesting, we will spit out a warning for the
-  //user
-  usrp->set_rx_freq( center_freq );
-
-  if( usrp->get_rx_freq() != center_freq )
+  for( size_t i = 0; i < channels.size(); i++ )
   {
-    ios_base::fmtflags originalFlags = cout.flags();
-    cout.setf(ios_base::left,ios_base::floatfield);
-    cout.precision(15);
-    cout  << "WARNING! Requested frequency = " << center_freq << endl
-          << "WARNING! Actual frequency = " << usrp->get_rx_freq() << endl;
-    cout.setf(originalFlags);
-  }
+    size_t chan = channels[i];
+    if( chan >= usrp->get_rx_num_channels() )
+    {
+      cout  << "Channel " << chan << " does not exist, the device has "
+            << usrp->get_rx_num_channels() << " channels" << endl;
+      return 0;
+    }
 
-  //Set the RX gain.  There really shouldn't be any problems here, but the user
-  //might request something silly like 50dB of gain when the module can't
-  //accomodate.  So we'll perform a similar check here.
-  usrp->set_rx_gain( rx_gain );
+    //Try setting the center frequency.  Like above, if we get a different
+    //frequency than the one we're requesting, we will spit out a warning for
+    //the user
+    usrp->set_rx_freq( center_freq, chan );
 
-  if( usrp->get_rx_gain() != rx_gain )
-  {
-    cout  << "WARNING! Requested gain = " << rx_gain << endl
-          << "WARNING! Actual gain = " << usrp->get_rx_gain() << endl;
-  }
+    if( usrp->get_rx_freq( chan ) != center_freq )
+    {
+      ios_base::fmtflags originalFlags = cout.flags();
+      cout.setf(ios_base::left,ios_base::floatfield);
+      cout.precision(15);
+      cout  << "WARNING! Requested frequency = " << center_freq << endl
+            << "WARNING! Actual frequency = " << usrp->get_rx_freq( chan ) << endl;
+      cout.setf(originalFlags);
+    }
 
-  //Ensure the LO locked
-  vector<string> sensor_names;
-  sensor_names = usrp->get_rx_sensor_names(0);
-  if( find(sensor_names.begin(), sensor_names.end(), "lo_locked")
-      != sensor_names.end() )
-  {
-    uhd::sensor_value_t lo_locked = usrp->get_rx_sensor("lo_locked",0);
-    cout  << "Checking RX: " << endl
-          << lo_locked.to_pp_string() << endl;
-    UHD_ASSERT_THROW(lo_locked.to_bool());      //We should probably catch this
+    //Set the RX gain.  There really shouldn't be any problems here, but the
+    //user might request something silly like 50dB of gain when the module
+    //can't accomodate.  So we'll perform a similar check here.
+    usrp->set_rx_gain( rx_gain, chan );
+
+    if( usrp->get_rx_gain( chan ) != rx_gain )
+    {
+      cout  << "WARNING! Requested gain = " << rx_gain << endl
+            << "WARNING! Actual gain = " << usrp->get_rx_gain( chan ) << endl;
+    }
+
+    //Ensure the LO locked
+    vector<string> sensor_names;
+    sensor_names = usrp->get_rx_sensor_names( chan );
+    if( find(sensor_names.begin(), sensor_names.end(), "lo_locked")
+        != sensor_names.end() )
+    {
+      uhd::sensor_value_t lo_locked = usrp->get_rx_sensor("lo_locked", chan);
+      cout  << "Checking RX " << chan << ": " << endl
+            << lo_locked.to_pp_string() << endl;
+      UHD_ASSERT_THROW(lo_locked.to_bool());    //We should probably catch this
+    }
   }
 
   return 1;
@@ -530,6 +1464,41 @@ int setupUSRP(  uhd::usrp::multi_usrp::sptr&  usrp,
 
 
 
+/*******************************************************************************
+
+
+*******************************************************************************/
+void freeArguments( char*           outputFileName,
+                    char*           windowFileName,
+                    char*           usrpArgs,
+                    char*           timeSource,
+                    char*           indexFileName,
+                    char*           binList,
+                    char*           shmName,
+                    char*           controlPath,
+                    float*          window,
+                    bin_selection*  bins )
+{
+  delete [] outputFileName;
+  delete [] windowFileName;
+  delete [] usrpArgs;
+  delete [] timeSource;
+  delete [] indexFileName;
+  delete [] binList;
+  delete [] shmName;
+  delete [] controlPath;
+  delete [] window;
+  if( bins )
+    destroyBinSelection( *bins );
+}
+
+
+
+
+
+
+
+
 /*******************************************************************************
 
 
@@ -542,11 +1511,36 @@ void useage( )
         << "-l <number>\t FFT Overlap" << endl
         << "-c <number>\t Number of Child Processes" << endl
         << "-w <file>\t Window File" << endl
+        << "-P <taps>\t PFB Taps per Channel (default 1, off)" << endl
         << "-a <args>\t USRP Address" << endl
         << "-f <freq>\t USRP Center Frequency" << endl
         << "-r <rate>\t USRP Sample Rate" << endl
         << "-g <gain>\t USRP RX Gain" << endl
-        << "-t <time>\t Time to record" << endl;
+        << "-t <time>\t Time to record" << endl
+        << "-S <list>\t Sweep Frequencies (f1,f2,start:stop:step,...)" << endl
+        << "-d <time>\t Sweep Settle Time (default 0.002)" << endl
+        << "-n <frames>\t Frames per Sweep Step (default 1)" << endl
+        << "-C <list>\t Channels (default 0)" << endl
+        << "-D <list>\t DDC Channel Offsets (o1,o2,start:stop:step,...)" << endl
+        << "-M <factor>\t DDC Decimation (default 1)" << endl
+        << "-R <source>\t Time Source (gpsdo, external or host)" << endl
+        << "-Z <time>\t Start Time (device UNIX seconds)" << endl
+        << "-I <file>\t Frame Time Stamp Index File" << endl
+        << "-m <name>\t Shared Memory Live Feed" << endl
+        << "-N <frames>\t Live Feed Frames (default 64)" << endl
+        << "-L <path>\t Daemon Mode Control Socket" << endl
+        << "-p <list>\t Daemon FFT Size Pool (s1,s2,...)" << endl
+        << "-q <bits>\t Output Bits per Bin (8, 16 or 32)" << endl
+        << "-B <dB>\t Quantization Reference (default -100)" << endl
+        << "-U <dB>\t Quantization Step" << endl
+        << "-k <list>\t Output Bins (b1,b2,first:last,...)" << endl
+        << "-O <format>\t Wire Format (sc16 or sc8)" << endl
+        << "-F <format>\t Host Format (fc32, sc16 or sc8)" << endl
+        << "-A <plan>\t CPU Plan (auto, auto:iface or recv:w1,w2-w3)" << endl
+        << "-Q <policy>\t Worker Policy (fifo:prio, rr:prio or other)" << endl
+        << "-H\t\t Lock Memory" << endl
+        << "-W <policy>\t Overload Policy (block, drop, overlap or decimate:n)" << endl
+        << "-b <seconds>\t Receive Ring Time (default 0.25)" << endl;
 }
 
 
@@ -555,23 +1549,23 @@ void useage( )
 
 
 
+
 /*******************************************************************************
 
 
 *******************************************************************************/
-int openFiles( const char*  outputFileName,
-               FILE*&       outputFile )
+void useFFTSize( struct fft_thread_data*  fft_child_args,
+                 const int                max_children,
+                 const fft_pool_entry&    entry )
 {
-  outputFile = fopen( outputFileName, "w" );
-
-  /*Make sure the files actually opened.
-   *
-   *If not... gracefully exit.
-   *We should really be throwing exceptions...
-   */
-  if( !outputFile)
-    return 0;
-  return 1;
+  for( int i = 0; i < max_children; i++ )
+  {
+    fft_child_args[i].fft_size    = entry.size;
+    fft_child_args[i].plan        = entry.plans[i];
+    fft_child_args[i].inputData   = entry.inputData[i];
+    fft_child_args[i].outputData  = entry.outputData[i];
+    fft_child_args[i].frameData   = entry.frameData[i];
+  }
 }
 
 
@@ -586,25 +1580,212 @@ int openFiles( const char*  outputFileName,
 
 
 *******************************************************************************/
-void createFFTPlans( fftwf_plan*&     plans,
-                     _Complex float**& inputData,
+void waitForWorkers( struct fft_thread_data* fft_child_args,
+                     const int               max_children )
+{
+  for( int i = 0; i < max_children; i++ )
+    while( fft_child_args[i].is_running )
+      ;
+}
+
+
+
+
+
+
+
+
+
+/*******************************************************************************
+
+
+*******************************************************************************/
+int parseSweep( const char* list, vector<double>& frequencies )
+{
+  frequencies.clear();
+
+  const char* entry = list;
+  while( *entry )
+  {
+    char*   end;
+    double  start = strtod( entry, &end );
+    if( end == entry )
+      return 0;
+
+    if( *end == ':' )
+    {
+      //start:stop:step range, stop included when it lands on a step
+      const char* field = end + 1;
+      double stop = strtod( field, &end );
+      if( end == field || *end != ':' )
+        return 0;
+      field = end + 1;
+      double step = strtod( field, &end );
+      if( end == field || step <= 0 || stop < start )
+        return 0;
+
+      int count = static_cast<int>( floor( (stop - start)/step + 1e-9 ) ) + 1;
+      for( int i = 0; i < count; i++ )
+        frequencies.push_back( start + i*step );
+    }
+    else
+      frequencies.push_back( start );
+
+    if( *end == ',' )
+      end++;
+    else if( *end )
+      return 0;
+    entry = end;
+  }
+
+  return !frequencies.empty();
+}
+
+
+
+
+
+
+
+/*******************************************************************************
+
+
+*******************************************************************************/
+int openFiles( const char*  outputFileName,
+               FILE*&       outputFile )
+{
+  outputFile = fopen( outputFileName, "w" );
+
+  /*Make sure the files actually opened.
+   *
+   *If not... gracefully exit.
+   *We should really be throwing exceptions...
+   */
+  if( !outputFile)
+    return 0;
+  return 1;
+}
+
+
+
+
+
+
+
+
+
+/*******************************************************************************
+
+
+*******************************************************************************/
+int openOutputs( const char*             outputFileName,
+                 const char*             indexFileName,
+                 const vector<size_t>&   outputs,
+                 const spectrum_format&  format,
+                 const int               frameBins,
+                 FILE**                  outputFile,
+                 FILE**&                 indexFile )
+{
+  const size_t channelCount = outputs.size();
+
+  for( size_t c = 0; c < channelCount; c++ )
+    outputFile[c] = NULL;
+  if( !outputFileName )
+    indexFileName = NULL;
+
+  for( size_t c = 0; outputFileName && c < channelCount; c++ )
+  {
+    char* channelOutputName = channelFileName( outputFileName, outputs[c],
+                                               channelCount );
+    int   opened            = openFiles( channelOutputName, outputFile[c] );
+    delete [] channelOutputName;
+    if( opened && !writeSpectrumHeader( outputFile[c], format, frameBins ) )
+    {
+      fclose( outputFile[c] );
+      opened = 0;
+    }
+    if( !opened )
+    {
+      outputFile[c] = NULL;
+      closeOutputs( outputFile, indexFile, channelCount );
+      indexFile = openIndexFiles( NULL, outputs );
+      return 0;
+    }
+  }
+
+  indexFile = openIndexFiles( indexFileName, outputs );
+  if( !indexFile )
+  {
+    closeOutputs( outputFile, indexFile, channelCount );
+    indexFile = openIndexFiles( NULL, outputs );
+    return 0;
+  }
+  return 1;
+}
+
+
+
+
+
+
+
+
+
+/*******************************************************************************
+
+
+*******************************************************************************/
+void closeOutputs( FILE** outputFile, FILE**& indexFile, size_t channelCount )
+{
+  for( size_t c = 0; c < channelCount; c++ )
+  {
+    if( outputFile[c] )
+      fclose( outputFile[c] );
+    outputFile[c] = NULL;
+  }
+  if( indexFile )
+    closeIndexFiles( indexFile, channelCount );
+  indexFile = NULL;
+}
+
+
+
+
+
+
+
+
+
+/*******************************************************************************
+
+
+*******************************************************************************/
+void createFFTPlans( fftwf_plan*&     plans,
+                     _Complex float**& inputData,
                      _Complex float**& outputData,
                      int              FFTSize,
-                     int              max_children )
+                     int              max_children,
+                     const cpu_plan&  cpuPlan,
+                     buffer_arena&    arena )
 {
+  const size_t dataSize = FFTSize * sizeof(_Complex float);
+
   plans       = new fftwf_plan[ max_children ];
   inputData   = new _Complex float*[ max_children ];
   outputData  = new _Complex float*[ max_children ];
 
-  //Setup the FFT plans -- create one for each child thread
+  //Setup the FFT plans -- create one for each child thread.  Carving the
+  //buffers touches them, which places them on the node of the cpu we run on.
   for(int i = 0; i < max_children; i++ )
   {
-    inputData[i]  = new _Complex float[FFTSize];
-    outputData[i] = new _Complex float[FFTSize];
+    placeThread( cpuPlan, workerCpu( cpuPlan, i ) );
+    inputData[i]  = reinterpret_cast<_Complex float*>(arenaAlloc( arena, dataSize ));
+    outputData[i] = reinterpret_cast<_Complex float*>(arenaAlloc( arena, dataSize ));
     plans[i]      = fftwf_plan_dft_1d( FFTSize, (fftwf_complex*)inputData[i], 
                                        (fftwf_complex*)outputData[i],
                                        FFTW_FORWARD, FFTW_EXHAUSTIVE );
   }
+  placeThread( cpuPlan, -1 );
 
   return;
 }
@@ -635,7 +1816,13 @@ int initializeThreads( pthread_mutex_t&         mutex,
                        _Complex float**&         outputData,
                        float*&                  window,
                        int                      FFTSize,
-                       int*&                    thread_control )
+                       int*&                    thread_control,
+                       const spectrum_format&   format,
+                       const bin_selection*     bins,
+                       int                      taps,
+                       const cpu_plan&          cpuPlan,
+                       int                      maxFFTSize,
+                       buffer_arena&            arena )
 {
   //mutex attribute = PTHREAD_MUTEX_NORMAL
   pthread_mutexattr_init( &attr );
@@ -662,6 +1849,21 @@ int initializeThreads( pthread_mutex_t&         mutex,
     fft_child_args[i].output_mutex    = &mutex;
     fft_child_args[i].plan            = plans[i];
     fft_child_args[i].fft_size        = FFTSize;
+    fft_child_args[i].bins            = bins;
+    fft_child_args[i].shm             = NULL;
+    fft_child_args[i].taps            = taps;
+    //A PFB frame and the scratch are first touched (zeroed) on the worker's
+    //cpu
+    placeThread( cpuPlan, workerCpu( cpuPlan, i ) );
+    fft_child_args[i].frameData       = taps > 1 ?
+      reinterpret_cast<_Complex float*>(arenaAlloc( arena,
+                                        FFTSize*taps*sizeof(_Complex float) )) :
+      inputData[i];
+    fft_child_args[i].magnitude       = reinterpret_cast<float*>(
+                                        arenaAlloc( arena, maxFFTSize*sizeof(float) ));
+    fft_child_args[i].codes           = reinterpret_cast<unsigned char*>(
+                                        arenaAlloc( arena, maxFFTSize*2 ));
+    placeThread( cpuPlan, -1 );
     fft_child_args[i].inputData       = inputData[i];
     fft_child_args[i].outputData      = outputData[i];
     fft_child_args[i].is_running      = false;
@@ -671,6 +1873,9 @@ int initializeThreads( pthread_mutex_t&         mutex,
       return 0;
     fft_child_args[i].my_id           = i;
     fft_child_args[i].window          = window;
+    fft_child_args[i].accumulator     = NULL;
+    fft_child_args[i].pending         = NULL;
+    fft_child_args[i].format          = format;
     fft_child_args[i].next_thread     = thread_control;
     fft_child_args[i].max_children    = max_children;
     sprintf(fft_child_args[i].mq_name,"/fft_thread_%i",i);
@@ -693,8 +1898,8 @@ int initializeThreads( pthread_mutex_t&         mutex,
       cout << "ERROR; Cannot create message queue\n" << endl;
       return 0;
     }
-    rc = pthread_create( &fft_children[i], NULL, fft_thread_start,
-                         reinterpret_cast<void *>(&(fft_child_args[i])) );
+    rc = createWorker( fft_children[i], cpuPlan, i, fft_thread_start,
+                       reinterpret_cast<void *>(&(fft_child_args[i])) );
 
     if( rc )
     {
@@ -723,7 +1928,29 @@ int calculateTask(  const char*                   outputFileName,
                     const int                     FFTOverlap,
                     const int                     max_children,
                     float*                        window,
+                    const int                     pfbTaps,
+                    const vector<size_t>&         channels,
+                    const vector<double>&         ddcOffsets,
+                    const int                     ddcDecimation,
+                    const vector<double>&         sweepFrequencies,
+                    const double                  sweepSettle,
+                    const int                     sweepFrames,
+                    const double                  startTime,
+                    const char*                   indexFileName,
+                    const spectrum_format&        outputFormat,
+                    const bin_selection*          bins,
+                    const char*                   shmName,
+                    const int                     shmSlots,
+                    const vector<int>&            fftPool,
+                    control_socket*               control,
+                    const sample_format           wireFormat,
+                    const sample_format           hostFormat,
+                    const cpu_plan&               cpuPlan,
+                    const bool                    lockPages,
+                    const overload_policy&        overloadPolicy,
+                    const double                  ringSeconds,
                     const unsigned long long	  maximum_samples,
+                    startup_timing&               startup,
                     uhd::usrp::multi_usrp::sptr&  usrp )
 {
   ///////////////////////////////////////////////////////////
@@ -731,23 +1958,121 @@ int calculateTask(  const char*                   outputFileName,
   //Initialization Section
   ///////////////////////////////////////////////////////////
 
-  //Number of bytes in a single-precision float
-  const int   FLOAT_COMPLEX_SIZE  = sizeof(_Complex float);
   const char  msg_thread_start    = static_cast<char>(__FFT_THREAD_START);
   const char  msg_thread_kill     = static_cast<char>(__FFT_THREAD_KILL);
 
-  //Initialize and open the input/output files
-  FILE *outputFile;
+  //Initialize and open the output files, one per channel (or per DDC
+  //channel, which all come from the first receive channel).  A sweep frame
+  //holds every step.
+  const size_t  rxCount       = channels.size();
+  vector<size_t> outputs      = channels;
+  if( !ddcOffsets.empty() )
+  {
+    outputs.clear();
+    for( size_t k = 0; k < ddcOffsets.size(); k++ )
+      outputs.push_back( k );
+  }
+  //The time stamps of the frames go to one index file per channel.
+  const size_t  channelCount  = outputs.size();
+  FILE**        outputFile    = new FILE*[channelCount];
+  FILE**        indexFile     = NULL;
+  const int     stepBins      = bins ? bins->count : FFTSize;
+  int           frameBins     = stepBins * max( 1, (int)sweepFrequencies.size() );
+
+  if( !openOutputs( outputFileName, indexFileName, outputs, outputFormat,
+                    frameBins, outputFile, indexFile ) )
+  {
+    closeOutputs( outputFile, indexFile, channelCount );
+    delete [] outputFile;
+    return 0;
+  }
+
+  //The live feed, one ring per channel
+  spectrum_shm* shm           = shmName ? new spectrum_shm[channelCount] : NULL;
+  for( size_t c = 0; shm && c < channelCount; c++ )
+  {
+    char* channelShmName  = channelFileName( shmName, outputs[c], channelCount );
+    int   created         = createSpectrumShm( shm[c], channelShmName,
+                                               outputFormat, frameBins,
+                                               shmSlots );
+    delete [] channelShmName;
+    if( !created )
+    {
+      cout << "Cannot create shared memory ring" << endl;
+      for( size_t i = 0; i < c; i++ )
+        destroySpectrumShm( shm[i] );
+      delete [] shm;
+      closeOutputs( outputFile, indexFile, channelCount );
+      delete [] outputFile;
+      return 0;
+    }
+  }
 
-  if(!openFiles( outputFileName, outputFile ))
+  //The input buffers hold the samples as they arrive: hostFormat, or the
+  //floats of the DDC
+  const sample_format   ringFormat        = ddcOffsets.empty() ? hostFormat
+                                                               : SAMPLE_FC32;
+  const int             ringSize          = sampleFormatSize( ringFormat );
+  const float           ringScale         = sampleFormatScale( ringFormat );
+  const int             hostSize          = sampleFormatSize( hostFormat );
+  const bool            convertDDC        = !ddcOffsets.empty() &&
+                                            hostFormat != SAMPLE_FC32;
+
+  //Every streaming buffer comes out of one arena: the FFT buffers of every
+  //pool size, the scratch at the largest size and the sample ring, whose
+  //blocks fit the largest size too (so a switch allocates nothing).  Every
+  //FFT size spans the same number of blocks per frame.
+  const size_t          complexSize       = sizeof(_Complex float);
+  const double          rate              = usrp->get_rx_rate();
+  int                   maxSize           = FFTSize;
+  size_t                arenaSize         = 0;
+  for( size_t k = 0; k <= fftPool.size(); k++ )
+  {
+    const int size = k ? fftPool[k-1] : FFTSize;
+    maxSize    = max( maxSize, size );
+    arenaSize += max_children * 2 * arenaBytes( size*complexSize );
+    if( pfbTaps > 1 )
+      arenaSize += max_children * arenaBytes( size*pfbTaps*complexSize );
+  }
+  const int             maxInterval       = maxSize / FFTOverlap;
+  const int             maxRxSamples      = maxInterval * ddcDecimation;
+  arenaSize += max_children * ( arenaBytes( maxSize*sizeof(float) ) +
+                                arenaBytes( maxSize*2 ) );
+  const int             blocksPerFrame    = FFTOverlap * pfbTaps;
+  const size_t          ringSlots         = !sweepFrequencies.empty() ? 0 :
+    max( static_cast<size_t>( ceil( ringSeconds*rate /
+                                    ( FFTSize / FFTOverlap * ddcDecimation ) ) ),
+         static_cast<size_t>( 2*blocksPerFrame + 2 ) );
+  const size_t          derivedCount      = ddcOffsets.empty() ? 0 : channelCount;
+  arenaSize += ( ringSlots + 1 ) * rxCount * arenaBytes( maxRxSamples*hostSize );
+  arenaSize += ringSlots * derivedCount * arenaBytes( maxInterval*ringSize );
+  if( convertDDC )
+    arenaSize += arenaBytes( maxRxSamples*complexSize );
+
+  buffer_arena          arena;
+  if( !openArena( arena, arenaSize ) )
+  {
+    cout << "Cannot reserve the buffer arena" << endl;
+    for( size_t c = 0; shm && c < channelCount; c++ )
+      destroySpectrumShm( shm[c] );
+    closeOutputs( outputFile, indexFile, channelCount );
+    delete [] outputFile;
+    delete [] shm;
     return 0;
+  }
+  cout << "Buffer arena of " << arena.size/1048576.0 << " MB on ";
+  if( arena.pageSize )
+    cout << arena.pageSize/1048576 << " MB pages" << endl;
+  else
+    cout << "normal pages" << endl;
 
   //Create some FFT Plans
   fftwf_plan     *plans       = NULL;
   _Complex float **inputData   = NULL;
   _Complex float **outputData  = NULL;
 
-  createFFTPlans( plans, inputData, outputData, FFTSize, max_children );
+  createFFTPlans( plans, inputData, outputData, FFTSize, max_children,
+                  cpuPlan, arena );
 
   //Setup the mutex for the output file... we don't want a race condition
   pthread_mutex_t     output_mutex;
@@ -759,6 +2084,10 @@ int calculateTask(  const char*                   outputFileName,
   struct fft_thread_data  *fft_child_args = NULL;
   int                     *thread_control = NULL;
 
+  //The window or PFB prototype (and the integer scaling) is applied while
+  //the frame is assembled, so the workers get a NULL window
+  float                   *noWindow       = NULL;
+
   if( !initializeThreads( output_mutex,
                           output_mutex_attr,
                           fft_children,
@@ -766,13 +2095,19 @@ int calculateTask(  const char*                   outputFileName,
                           ma,
                           max_children,
                           fft_child_args,
-                          outputFile,
+                          outputFile[0],
                           plans,
                           inputData,
                           outputData,
-                          window,
+                          noWindow,
                           FFTSize,
-                          thread_control ))
+                          thread_control,
+                          outputFormat,
+                          bins,
+                          pfbTaps,
+                          cpuPlan,
+                          maxSize,
+                          arena ))
   {
     //Cleanup for a graceful exit
     //We have to check to see if things exist before deleting them because
@@ -785,19 +2120,9 @@ int calculateTask(  const char*                   outputFileName,
       delete [] plans;
     }
     if( inputData )
-    {
-      for(int i = 0; i < max_children; i++)
-	if( inputData[i] )
-          delete [] inputData[i];
       delete [] inputData;
-    }
     if( outputData )
-    {
-      for(int i = 0; i < max_children; i++)
-  	if( outputData[i] )
-	  delete [] outputData[i];
       delete [] outputData;
-    }
     if( fft_children )
     {
       for(int i = 0; i < max_children; i++)
@@ -826,33 +2151,142 @@ int calculateTask(  const char*                   outputFileName,
           delete [] fft_child_args[i].mq_name;
       delete [] fft_child_args;
     }
+    closeArena( arena );
+    for( size_t c = 0; shm && c < channelCount; c++ )
+      destroySpectrumShm( shm[c] );
+    closeOutputs( outputFile, indexFile, channelCount );
+    delete [] outputFile;
+    delete [] shm;
     return 0;
   }
 
 
 
-  //Setup the input buffer and tracking variables
+  //The daemon's FFT sizes, planned up front so a switch costs no planning.
+  //Entry 0 is FFTSize, whose plans and buffers the workers already hold.
+  vector<fft_pool_entry> pool( 1 + fftPool.size() );
+  pool[0].size        = FFTSize;
+  pool[0].plans       = plans;
+  pool[0].inputData   = inputData;
+  pool[0].outputData  = outputData;
+  pool[0].frameData   = new _Complex float*[max_children];
+  pool[0].window2     = interleaveWindow( window, FFTSize*pfbTaps, ringScale );
+  for( int i = 0; i < max_children; i++ )
+    pool[0].frameData[i] = fft_child_args[i].frameData;
+  for( size_t k = 1; k < pool.size(); k++ )
+  {
+    fft_pool_entry& entry = pool[k];
+    entry.size  = fftPool[k-1];
+    cout << "Planning FFT size " << entry.size << endl;
+    createFFTPlans( entry.plans, entry.inputData, entry.outputData,
+                    entry.size, max_children, cpuPlan, arena );
+    entry.frameData = new _Complex float*[max_children];
+    for( int i = 0; i < max_children; i++ )
+    {
+      placeThread( cpuPlan, workerCpu( cpuPlan, i ) );
+      entry.frameData[i] = pfbTaps > 1 ?
+        reinterpret_cast<_Complex float*>(arenaAlloc( arena,
+                                          entry.size*pfbTaps*complexSize )) :
+        entry.inputData[i];
+    }
+    placeThread( cpuPlan, -1 );
+    float* entryWindow;
+    if( pfbTaps > 1 )
+      entryWindow = pfbPrototype( entry.size, pfbTaps );
+    else
+    {
+      entryWindow = new float[entry.size];
+      for( int i = 0; i < entry.size; i++ )
+        entryWindow[i] = 1.0f;
+    }
+    entry.window2 = interleaveWindow( entryWindow, entry.size*pfbTaps,
+                                      ringScale );
+    delete [] entryWindow;
+  }
+
+  //Tracking variables.  Every channel receives the same number of samples,
+  //so they share the frame fill: a frame (frameLength samples, PFB included)
+  //spans the blocksPerFrame newest blocks of the ring.
   int                   fft_interval_size = FFTSize / FFTOverlap;
-  _Complex float*        input_buffer      = new _Complex float[FFTSize];
-  int                   head              = 0;
+  int                   frameLength       = FFTSize * pfbTaps;
+  const float*          window2           = pool[0].window2;
+  int                   filled            = 0;
+  unsigned long long    nextBlock         = 0;
   int                   child_tracker     = 0;
-  bool                  isFull            = false;
   int                   return_code       = 1;
-  //Check memory allocation
-  if( !input_buffer )
-    return_code = 0;
 
-  //Setup the USRP for streaming
-  vector<_Complex float>   usrpBuffer( fft_interval_size );
-  uhd::stream_args_t      stream_args(__USRP_CPU_FMT, __USRP_WIRE_FMT );
+  //Setup the USRP for streaming.  Every block of the ring holds rxSamples
+  //samples per channel: fft_interval_size samples, or the samples the DDC
+  //channels turn into fft_interval_size samples (as floats, in the derived
+  //buffers of the block).
+  int                   rxSamples         = fft_interval_size * ddcDecimation;
+  _Complex float*         ddcInput = !convertDDC ? NULL :
+    reinterpret_cast<_Complex float*>(arenaAlloc( arena,
+                                                  maxRxSamples*complexSize ));
+
+  uhd::stream_args_t      stream_args( sampleFormatName( hostFormat ),
+                                       sampleFormatName( wireFormat ) );
+  stream_args.channels    = channels;
   uhd::rx_streamer::sptr  usrp_rx_stream = usrp->get_rx_stream(stream_args);
-  uhd::rx_metadata_t      rx_md;
   unsigned long long int  samples_recorded = 0;
-  unsigned long long int  buffer_samples_recorded = 0;
-  uhd::stream_cmd_t       usrp_stream_command(uhd::stream_cmd_t::STREAM_MODE_START_CONTINUOUS);
-
-  usrp_stream_command.stream_now  = true;
-  usrp_stream_command.time_spec   = uhd::time_spec_t();
+  long long               firstTick = -1;
+  double                  timeout = 0;
+
+  //The receive thread fills the ring, so the ring is carved (and faulted
+  //in) on its cpu.  A sweep receives on this thread instead, which then
+  //runs on that cpu.  UHD's threads are already running and keep every cpu.
+  sample_ring             ring;
+  recv_thread_data        recvArgs;
+  pthread_t               recvThread;
+  bool                    receiving = false;
+  if( ringSlots )
+  {
+    placeThread( cpuPlan, cpuPlan.recvCpu );
+    if( !createSampleRing( ring, ringSlots, rxCount, maxRxSamples*hostSize,
+                           derivedCount, maxInterval*ringSize, arena ) )
+    {
+      cout << "Cannot reserve the buffer arena" << endl;
+      return_code = 0;
+    }
+    recvArgs.spare.resize( rxCount );
+    for( size_t c = 0; c < rxCount; c++ )
+      recvArgs.spare[c] = arenaAlloc( arena, maxRxSamples*hostSize );
+    placeThread( cpuPlan, -1 );
+  }
+  else if( cpuPlan.recvCpu >= 0 && !placeThread( cpuPlan, cpuPlan.recvCpu ) )
+    cout << "Cannot pin the receive thread to cpu " << cpuPlan.recvCpu << endl;
+
+  //Every buffer is carved and faulted in by now.  Locking also covers the
+  //mappings made later on (the sweep buffers, the live feed rings).
+  if( lockPages && !lockMemory() )
+    cout << "Cannot lock memory, page faults are possible" << endl;
+
+  //Daemon mode: retunes are timed right after the newest buffer, and the
+  //buffers before resumeTick are dropped
+  const long long         settleTicks = static_cast<long long>( ceil( sweepSettle*rate ) );
+  const long long         leadTicks   = static_cast<long long>( ceil( __SWEEP_COMMAND_LEAD*rate ) );
+  long long               resumeTick  = 0;
+  bool                    restart     = false;
+  bool                    quit        = false;
+  overload_policy         overload    = overloadPolicy;
+  resetOverload( overload, FFTOverlap );
+  int                     shedFactor  = 1;
+  string                  outputName  = outputFileName ? outputFileName : "";
+  char                    reply[__CONTROL_LINE_LENGTH];
+
+  //One down-converter per DDC channel, at the rate the device settled on
+  ddc_channel*            ddc     = ddcOffsets.empty() ? NULL
+                                    : new ddc_channel[channelCount];
+  size_t                  ddcReady = 0;
+  for( ; ddc && ddcReady < channelCount; ddcReady++ )
+    if( !initializeDdc( ddc[ddcReady], ddcOffsets[ddcReady], rate,
+                        ddcDecimation, maxInterval * ddcDecimation ) )
+    {
+      cout << "DDC offset outside the receive band: "
+           << ddcOffsets[ddcReady] << endl;
+      return_code = 0;
+      break;
+    }
 
   ///////////////////////////////////////////////////////////
   //
@@ -867,24 +2301,91 @@ int calculateTask(  const char*                   outputFileName,
   (*thread_control) = 0;
   cout << "Begin Data Collection" << endl;
   //Start streaming!
-  usrp->issue_stream_cmd( usrp_stream_command );
+  if( return_code )
+    timeout = startStream( usrp, rxCount, startTime );
+  if( return_code && !timeout )
+  {
+    cout << "Start time has already passed" << endl;
+    return_code = 0;
+  }
+
+  //Outside a sweep the receive thread takes over recv
+  if( return_code && ringSlots )
+  {
+    recvArgs.stream       = usrp_rx_stream;
+    recvArgs.ring         = &ring;
+    recvArgs.rxSamples    = rxSamples;
+    recvArgs.rate         = rate;
+    recvArgs.firstTimeout = timeout;
+    recvArgs.cpuPlan      = &cpuPlan;
+    recvArgs.stop         = false;
+    receiving = !pthread_create( &recvThread, NULL, recvThreadStart,
+                                 reinterpret_cast<void *>(&recvArgs) );
+    if( !receiving )
+    {
+      cout << "Cannot start the receive thread" << endl;
+      return_code = 0;
+    }
+  }
 
 #ifdef BENCHMARK
   gettimeofday(&a, 0);
 #endif
 
-  while( (samples_recorded < maximum_samples) and return_code )
+  const bool sweeping = !sweepFrequencies.empty();
+  if( sweeping && return_code )
+    return_code = sweepTask( fft_child_args,
+                             fft_mq,
+                             max_children,
+                             FFTSize,
+                             FFTOverlap,
+                             channels,
+                             outputFile,
+                             indexFile,
+                             shm,
+                             sweepFrequencies,
+                             sweepSettle,
+                             sweepFrames,
+                             maximum_samples,
+                             timeout,
+                             hostFormat,
+                             window2,
+                             startup,
+                             usrp_rx_stream,
+                             usrp );
+
+  while( !sweeping && (samples_recorded < maximum_samples) and return_code &&
+         !quit && !stopRequested() )
   {
-    //Read in the I-Q of fft_interval_size samples...
-    buffer_samples_recorded = usrp_rx_stream->recv( &usrpBuffer.front(),
-                                                    usrpBuffer.size(),
-                                                    rx_md );
+    //Hand back the blocks no frame needs anymore.  The next frame takes the
+    //newest blocksPerFrame-1 blocks along.
+    releaseBlocks( ring, nextBlock - min( filled, blocksPerFrame - 1 ) );
+
+    //Take the next block of rxSamples samples on every channel, checking
+    //for a stop every now and then
+    sample_block* block = waitBlock( ring, nextBlock, 0.1 );
+    if( !block )
+      continue;
+    nextBlock++;
+    if( startup.firstSample < 0 && block->samples )
+      reportStartup( startup );
+
+    //The run is measured on the device clock from its first sample, so the
+    //samples of lost, short and overflowed blocks count too
+    if( block->samples )
+    {
+      if( firstTick < 0 )
+        firstTick = block->tick;
+      samples_recorded = max( samples_recorded,
+                              static_cast<unsigned long long>(
+                                block->tick + block->samples - firstTick ) );
+    }
 
     //Check the USRP for errors (including Overflow indication)
-    if( rx_md.error_code != uhd::rx_metadata_t::ERROR_CODE_NONE )
+    if( block->error != uhd::rx_metadata_t::ERROR_CODE_NONE )
     {
       //There was a USRP-related problem
-      switch( rx_md.error_code ){
+      switch( block->error ){
         case uhd::rx_metadata_t::ERROR_CODE_OVERFLOW:
           cout << "O";
           break;
@@ -893,37 +2394,207 @@ int calculateTask(  const char*                   outputFileName,
           return_code = 0;
           break;
         default:
-          cout << "Unexpected USRP Error: " << rx_md.error_code;
+          cout << "Unexpected USRP Error: " << block->error;
           return_code = 0;
       }
     }
 
-    //Ensure we grabbed the correct number of samples
-    if( buffer_samples_recorded == static_cast<unsigned int>(fft_interval_size))
+    //The ring was full and samples were lost before this block
+    if( block->gap )
     {
-      samples_recorded += buffer_samples_recorded;
+      cout << "L";
+      filled = 0;
+    }
 
-      //copy into the fftsize-long input buffer at the proper spot
-      memmove( input_buffer+head, &usrpBuffer.front(),
-                FLOAT_COMPLEX_SIZE * fft_interval_size );
+    //Ensure we grabbed the correct number of samples.  A short block (or one
+    //of the old FFT size) breaks the sample sequence of the frames.
+    if( block->samples != static_cast<size_t>(rxSamples) )
+      filled = 0;
+    else
+    {
+      const long long bufferTick = block->tick;
+
+      //Samples from before the end of a retune never reach a frame
+      bool            drop       = bufferTick < resumeTick;
 
-      //Time to take an FFT yet?
-      if( !isFull )
+      //Apply a daemon command between this buffer and the next
+      const char* command = control ? pendingControl( *control ) : NULL;
+      if( command )
       {
-        //If we're not full, then we're still filling the input buffer for the
-        //very first FFT
-        if( head == (FFTSize - fft_interval_size) )
+        char      verb[__CONTROL_LINE_LENGTH] = "";
+        char      name[__CONTROL_LINE_LENGTH];
+        char      index[__CONTROL_LINE_LENGTH];
+        double    value   = 0;
+        int       fields  = sscanf( command, "%255s %lf", verb, &value );
+        long long tick    = latestBlock( ring )->tick + rxSamples + leadTicks;
+        size_t    k       = 0;
+
+        if( fields == 2 && !strcmp( verb, "freq" ) )
+        {
+          tuneStep( usrp, channels, value, tick, rate );
+          resumeTick = tick + settleTicks;
+          sprintf( reply, "ok %.1f", usrp->get_rx_freq( channels[0] ) );
+        }
+        else if( fields == 2 && !strcmp( verb, "gain" ) )
+        {
+          usrp->set_command_time( uhd::time_spec_t::from_ticks( tick, rate ) );
+          for( size_t c = 0; c < rxCount; c++ )
+            usrp->set_rx_gain( value, channels[c] );
+          usrp->clear_command_time();
+          resumeTick = tick + settleTicks;
+          sprintf( reply, "ok %.1f", usrp->get_rx_gain( channels[0] ) );
+        }
+        else if( fields == 2 && !strcmp( verb, "fft" ) )
+        {
+          while( k < pool.size() && pool[k].size != value )
+            k++;
+          if( k == pool.size() )
+            sprintf( reply, "error FFT size %g is not planned", value );
+          else if( !outputName.empty() )
+            strcpy( reply, "error stop the outputs first" );
+          else
+          {
+            //Every buffer and live feed ring follows the new frame size
+            waitForWorkers( fft_child_args, max_children );
+            useFFTSize( fft_child_args, max_children, pool[k] );
+            fft_interval_size = pool[k].size / FFTOverlap;
+            frameLength       = pool[k].size * pfbTaps;
+            rxSamples         = fft_interval_size * ddcDecimation;
+            recvArgs.rxSamples = rxSamples;
+            frameBins         = pool[k].size;
+            window2           = pool[k].window2;
+            for( size_t c = 0; shm && c < channelCount; c++ )
+            {
+              char* channelShmName = channelFileName( shmName, outputs[c],
+                                                      channelCount );
+              destroySpectrumShm( shm[c] );
+              if( !createSpectrumShm( shm[c], channelShmName, outputFormat,
+                                      frameBins, shmSlots ) )
+              {
+                //The ring cannot come back, so the sensor stops
+                cout << "Cannot create shared memory ring" << endl;
+                return_code = 0;
+              }
+              delete [] channelShmName;
+            }
+            restart = true;
+            sprintf( reply, "ok %d", pool[k].size );
+          }
+        }
+        else if( !strcmp( verb, "start" ) &&
+                 ( fields = sscanf( command, "%*s %255s %255s", name, index ) ) >= 1 )
         {
-          //Now we are full and ready to take an FFT
-          isFull = true;
+          if( !outputName.empty() )
+            strcpy( reply, "error outputs already running" );
+          else
+          {
+            closeOutputs( outputFile, indexFile, channelCount );
+            //A failed start leaves the outputs stopped
+            if( openOutputs( name, fields == 2 ? index : NULL, outputs,
+                             outputFormat, frameBins, outputFile, indexFile ) )
+            {
+              outputName = name;
+              strcpy( reply, "ok" );
+            }
+            else
+              strcpy( reply, "error cannot open output file" );
+          }
+        }
+        else if( !strcmp( verb, "stop" ) )
+        {
+          //The workers may still be writing to the files
+          waitForWorkers( fft_child_args, max_children );
+          closeOutputs( outputFile, indexFile, channelCount );
+          openOutputs( NULL, NULL, outputs, outputFormat, frameBins,
+                       outputFile, indexFile );
+          outputName.clear();
+          strcpy( reply, "ok" );
         }
+        else if( !strcmp( verb, "status" ) )
+          snprintf( reply, sizeof(reply),
+                    "ok freq %.1f gain %.1f fft %d output %s shed %llu dropped %llu "
+                    "ring %llu/%llu lost %llu ttfs %.1f",
+                    usrp->get_rx_freq( channels[0] ),
+                    usrp->get_rx_gain( channels[0] ),
+                    fft_child_args[0].fft_size,
+                    outputName.empty() ? "stopped" : outputName.c_str(),
+                    overload.shed, overload.dropped,
+                    ring.peak, ring.slots, ring.lost, startup.firstSample );
+        else if( !strcmp( verb, "quit" ) )
+        {
+          quit = true;
+          strcpy( reply, "ok" );
+        }
+        else
+          strcpy( reply, "error unknown command" );
+        replyControl( *control, reply );
+      }
+
+      //A dropped buffer (or one in the old FFT size) starts the frame fill
+      //over
+      if( restart || drop )
+      {
+        filled  = 0;
+        restart = false;
+        continue;
       }
-      //Increment the head pointer before we take the FFT so the head is pointing
-      //to the oldest data in the buffer
-      head += fft_interval_size;
-      if( head == FFTSize )
-        head = 0;
-      if( isFull )
+
+      //Down-convert into the derived buffers of the block (without the DDC
+      //the frames are made of the received samples themselves)
+      if( ddc )
+      {
+        const float* rxInput = reinterpret_cast<float*>(block->data[0]);
+        if( convertDDC )
+        {
+          convertSamples( hostFormat, block->data[0],
+                          reinterpret_cast<float*>(ddcInput), rxSamples );
+          rxInput = reinterpret_cast<float*>(ddcInput);
+        }
+        for( size_t c = 0; c < channelCount; c++ )
+          ddcProcess( ddc[c], rxInput, rxSamples,
+                      reinterpret_cast<float*>(block->derived[c]) );
+      }
+
+      //Time to take an FFT yet?  Only once the blocks of a whole frame are
+      //there, the very first time (or after a restart).
+      if( filled < blocksPerFrame )
+        filled++;
+      const bool isFull = filled == blocksPerFrame;
+
+      //The frame starts frameLength - fft_interval_size (decimated) samples
+      //before the buffer that just arrived, and a DDC channel's samples lag
+      //the antenna by the delay of its filters
+      uhd::time_spec_t frameTime = uhd::time_spec_t::from_ticks(
+        bufferTick - (long long)(frameLength - fft_interval_size)*ddcDecimation,
+        rate ) - uhd::time_spec_t( ( ddc ? ddc[0].delay : 0 )/rate );
+
+      //Unless the policy blocks, a busy pool sheds the frames of this
+      //interval instead of stalling recv
+      bool handOut = isFull;
+      if( isFull && overload.mode != OVERLOAD_BLOCK )
+      {
+        int busy = 0;
+        for( int i = 0; i < max_children; i++ )
+          busy += fft_child_args[i].is_running;
+        handOut = frameDue( overload, busy, max_children );
+        for( int c = 0; handOut && c < min( (int)channelCount, max_children ); c++ )
+          if( fft_child_args[(child_tracker + c) % max_children].is_running )
+          {
+            overload.dropped++;
+            handOut = false;
+          }
+        if( overload.factor != shedFactor )
+        {
+          shedFactor = overload.factor;
+          cout << "Overload: 1 in " << shedFactor << " frames" << endl;
+        }
+      }
+
+      //One frame per channel, handed out to the workers in turn.  The
+      //workers write in hand-out order, so every channel's file stays in
+      //order too.  (With more channels than workers a worker may still be
+      //busy with this interval even under a shedding policy.)
+      for( size_t c = 0; handOut && c < channelCount; c++ )
       {
         //Check to see if the thread is still active before copying data
         //This ideally shouldn't happen... but if it does, we can potentially lose
@@ -939,12 +2610,30 @@ int calculateTask(  const char*                   outputFileName,
               //So instead we wait for the running flag to go false
           }
         }
-        //Copy the buffer into the FFT input data using a 2-part memmove
-        memmove( fft_child_args[child_tracker].inputData,
-                 input_buffer+head, FLOAT_COMPLEX_SIZE * (FFTSize-head) );
-        memmove( fft_child_args[child_tracker].inputData+FFTSize-head,
-                 input_buffer, FLOAT_COMPLEX_SIZE * head );
+        //Convert and window the blocks of the frame into the FFT input data in
+        //one pass, oldest block first
+        float* frame = reinterpret_cast<float*>(fft_child_args[child_tracker].frameData);
+        for( int j = 0; j < blocksPerFrame; j++ )
+        {
+          const sample_block* part = ringBlock( ring, nextBlock - blocksPerFrame + j );
+          convertWindow( ringFormat, ddc ? part->derived[c] : part->data[c],
+                         window2 + 2*j*fft_interval_size,
+                         frame + 2*j*fft_interval_size, fft_interval_size );
+        }
+        fft_child_args[child_tracker].outputFile = outputFile[c];
+        fft_child_args[child_tracker].shm        = shm ? &shm[c] : NULL;
+
+        //Frames reach the output file in hand-out order, so their time stamps
+        //can be written right away
+        if( !writeFrameTime( indexFile[c],
+                             (bufferTick + rxSamples - firstTick)/ddcDecimation -
+                             frameLength,
+                             frameTime ) )
+          return_code = 0;
 
+        //Mark the worker busy before handing it the frame, so we never
+        //overwrite a frame the worker has not picked up yet
+        fft_child_args[child_tracker].is_running = true;
         //Send a message to the worker to compute the FFT
         mq_send( fft_mq[child_tracker], &msg_thread_start,
                  __FFT_THREAD_MSG_LENGTH, __FFT_THREAD_MSG_PRIO );
@@ -960,7 +2649,23 @@ int calculateTask(  const char*                   outputFileName,
   seconds += b.tv_usec/1000000.0f - a.tv_usec/1000000.0f;
   printf("ET: %.6f s\n",seconds);
 #endif
+  //The receive thread ends with its current recv, before the stream stops
+  if( receiving )
+  {
+    recvArgs.stop = true;
+    pthread_join( recvThread, NULL );
+    cout << "Sample ring: peak " << ring.peak << " of " << ring.slots
+         << " blocks (" << ring.peak*rxSamples/rate*1000 << " ms), "
+         << ring.lost << " lost" << endl;
+  }
+  if( stopRequested() )
+    cout << "Stopped by signal" << endl;
   cout << "End data collection" << endl;
+  if( !sweeping && overload.mode != OVERLOAD_BLOCK )
+    cout << "Overload policy " << overloadName( overload ) << ": "
+         << overload.shed << " frame intervals shed (down to 1 in "
+         << overload.peakFactor << "), " << overload.dropped << " dropped"
+         << endl;
 
   usrp->issue_stream_cmd(uhd::stream_cmd_t::STREAM_MODE_STOP_CONTINUOUS);
 
@@ -969,22 +2674,47 @@ int calculateTask(  const char*                   outputFileName,
   //Cleanup Section
   ///////////////////////////////////////////////////////////
 
-  //Toss out any leftovers and cleanup
-  fclose(outputFile);
-
-  //Destroy plans
+  //Stop the workers before their buffers and the output file go away
   for(int i = 0; i < max_children; i++)
   {
     //Send a message for the child to kill itself
     mq_send( fft_mq[i], &msg_thread_kill,
              __FFT_THREAD_MSG_LENGTH, __FFT_THREAD_MSG_PRIO );
+    //Wait for the child to kill itself
+    pthread_join( fft_children[i], NULL );
+  }
+
+  //Give the workers back their own FFT size and drop the rest of the pool
+  useFFTSize( fft_child_args, max_children, pool[0] );
+  delete [] pool[0].frameData;
+  delete [] pool[0].window2;
+  for( size_t k = 1; k < pool.size(); k++ )
+  {
+    for( int i = 0; i < max_children; i++ )
+      fftwf_destroy_plan( pool[k].plans[i] );
+    delete [] pool[k].plans;
+    delete [] pool[k].inputData;
+    delete [] pool[k].outputData;
+    delete [] pool[k].frameData;
+    delete [] pool[k].window2;
+  }
+
+  //Toss out any leftovers and cleanup
+  for( size_t c = 0; shm && c < channelCount; c++ )
+    destroySpectrumShm( shm[c] );
+  closeOutputs( outputFile, indexFile, channelCount );
+  delete [] outputFile;
+  delete [] shm;
+  for( size_t c = 0; c < ddcReady; c++ )
+    destroyDdc( ddc[c] );
+  delete [] ddc;
+
+  //Destroy plans
+  for(int i = 0; i < max_children; i++)
+  {
     fftwf_destroy_plan(plans[i]);
-    delete [] inputData[i];
-    delete [] outputData[i];
     mq_close( fft_mq[i] );
     mq_unlink( fft_child_args[i].mq_name );
-    //Wait for the child to kill itself
-    pthread_join( fft_children[i], NULL );
   }
 
   //cleanup mutex
@@ -1001,8 +2731,525 @@ int calculateTask(  const char*                   outputFileName,
   delete [] ma;
   delete [] fft_mq;
   delete [] fft_child_args;
-  delete [] input_buffer;
+  if( ringSlots )
+    destroySampleRing( ring );
+  closeArena( arena );
 
-  return 1;
+  return return_code;
+}
+
+
+
+
+
+
+
+
+
+/*******************************************************************************
+
+
+*******************************************************************************/
+void* recvThreadStart( void* recv_thread_arg )
+{
+  recv_thread_data*   my_data = reinterpret_cast<recv_thread_data*>(recv_thread_arg);
+  sample_ring&        ring    = *(my_data->ring);
+  const cpu_plan&     cpuPlan = *(my_data->cpuPlan);
+  vector<void*>       buffers( ring.channels );
+  uhd::rx_metadata_t  rx_md;
+  double              timeout = my_data->firstTimeout;
+  bool                failed  = false;
+
+  //Nothing but recv runs here: at realtime priority if we may, on its own
+  //cpu near the NIC
+  uhd::set_thread_priority_safe();
+  if( cpuPlan.recvCpu >= 0 && !placeThread( cpuPlan, cpuPlan.recvCpu ) )
+    cout << "Cannot pin the receive thread to cpu " << cpuPlan.recvCpu << endl;
+
+  while( !my_data->stop && !failed )
+  {
+    //With the ring full the samples still have to be taken off the device,
+    //or it overflows
+    sample_block* block = freeBlock( ring );
+    for( size_t c = 0; c < ring.channels; c++ )
+      buffers[c] = block ? block->data[c] : my_data->spare[c];
+    const size_t samples = my_data->stream->recv( buffers,
+                                                  my_data->rxSamples,
+                                                  rx_md,
+                                                  timeout );
+    timeout = 0.1;
+    if( !block )
+    {
+      loseBlock( ring );
+      continue;
+    }
+
+    block->samples  = samples;
+    block->tick     = rx_md.time_spec.to_ticks( my_data->rate );
+    block->error    = rx_md.error_code;
+    //Anything but an overflow ends the stream
+    failed = rx_md.error_code != uhd::rx_metadata_t::ERROR_CODE_NONE &&
+             rx_md.error_code != uhd::rx_metadata_t::ERROR_CODE_OVERFLOW;
+    publishBlock( ring );
+  }
+
+  pthread_exit(NULL);
+}
+
+
+
+
+
+
+
+
+
+/*******************************************************************************
+
+
+*******************************************************************************/
+void* deviceSetupStart( void* device_setup_arg )
+{
+  device_setup_data*  my_data = reinterpret_cast<device_setup_data*>(device_setup_arg);
+
+  //Runs straight from main when the thread cannot be made, so it returns
+  //instead of calling pthread_exit
+  try
+  {
+    my_data->ready = setupUSRP( my_data->usrp,
+                                my_data->centerFreq,
+                                my_data->sampleRate,
+                                my_data->gain,
+                                *(my_data->channels),
+                                my_data->usrpArgs );
+    if( my_data->ready && my_data->timeSource )
+      syncTime( my_data->usrp, my_data->timeSource );
+  }
+  catch( uhd::exception& e )
+  {
+    cout << "USRP error: " << e.what() << endl;
+    my_data->ready = 0;
+  }
+  my_data->startup->deviceReady = msSince( my_data->startup->launch );
+
+  return NULL;
+}
+
+
+
+
+
+
+
+
+
+/*******************************************************************************
+
+
+*******************************************************************************/
+void primeFFTPlans( const int FFTSize, const vector<int>& fftPool )
+{
+  for( size_t k = 0; k <= fftPool.size(); k++ )
+  {
+    const int       size    = k ? fftPool[k-1] : FFTSize;
+    fftwf_complex*  input   = reinterpret_cast<fftwf_complex*>(
+                                fftwf_malloc( size*sizeof(fftwf_complex) ));
+    fftwf_complex*  output  = reinterpret_cast<fftwf_complex*>(
+                                fftwf_malloc( size*sizeof(fftwf_complex) ));
+
+    //Same flags, direction and placement as createFFTPlans, and the arena is
+    //as aligned as fftwf_malloc, so its plans find this wisdom
+    fftwf_destroy_plan( fftwf_plan_dft_1d( size, input, output,
+                                           FFTW_FORWARD, FFTW_EXHAUSTIVE ) );
+    fftwf_free( input );
+    fftwf_free( output );
+  }
+}
+
+
+
+
+
+
+
+
+
+/*******************************************************************************
+
+
+*******************************************************************************/
+double msSince( const timespec& since )
+{
+  timespec now;
+  clock_gettime( CLOCK_MONOTONIC, &now );
+  return ( now.tv_sec - since.tv_sec ) * 1e3 +
+         ( now.tv_nsec - since.tv_nsec ) / 1e6;
 }
 
+
+
+
+
+
+
+
+
+/*******************************************************************************
+
+
+*******************************************************************************/
+void reportStartup( startup_timing& startup )
+{
+  startup.firstSample = msSince( startup.launch );
+  cout  << "Time to first sample " << startup.firstSample << " ms (device "
+        << "ready at " << startup.deviceReady << " ms, FFTs planned at "
+        << startup.plansReady << " ms)" << endl;
+}
+
+
+
+
+
+
+
+
+
+/*******************************************************************************
+
+
+*******************************************************************************/
+int sweepTask(  struct fft_thread_data*       fft_child_args,
+                mqd_t*                        fft_mq,
+                const int                     max_children,
+                const int                     FFTSize,
+                const int                     FFTOverlap,
+                const vector<size_t>&         channels,
+                FILE**                        outputFile,
+                FILE**                        indexFile,
+                spectrum_shm*                 shm,
+                const vector<double>&         frequencies,
+                const double                  settle,
+                const int                     frames,
+                const unsigned long long int  maximum_samples,
+                const double                  firstTimeout,
+                const sample_format           hostFormat,
+                const float*                  window2,
+                startup_timing&               startup,
+                uhd::rx_streamer::sptr&       usrp_rx_stream,
+                uhd::usrp::multi_usrp::sptr&  usrp )
+{
+  ///////////////////////////////////////////////////////////
+  //
+  //Initialization Section
+  ///////////////////////////////////////////////////////////
+
+  const char  msg_thread_start    = static_cast<char>(__FFT_THREAD_START);
+
+  //All the scheduling is done in sample ticks of the device clock
+  const double    rate          = usrp->get_rx_rate();
+  const int       steps         = frequencies.size();
+  const size_t    channelCount  = channels.size();
+  const int       interval      = FFTSize / FFTOverlap;
+  const int       frameLength   = FFTSize * fft_child_args[0].taps;
+  const int       stepSamples   = frameLength + (frames - 1)*interval;
+  const long long settleTicks   = static_cast<long long>( ceil( settle*rate ) );
+  const long long leadTicks     = static_cast<long long>( ceil( __SWEEP_COMMAND_LEAD*rate ) );
+  const int       stepBins      = fft_child_args[0].bins ?
+                                  fft_child_args[0].bins->count : FFTSize;
+  const int       frameSize     = steps*stepBins;
+  const float     frameScale    = 1.0f / frames;
+
+  //Two wideband frames per channel: the workers finish one sweep while the
+  //next one is being collected.  The frame counts cover all channels.
+  float**         sweepFrame[2];
+  volatile int    pending[2]    = { 0, 0 };
+  bool            complete[2]   = { false, false };
+  int             current       = 0;
+  pthread_mutex_t* mutex        = fft_child_args[0].output_mutex;
+
+  //The sweep's buffers come out of an arena of their own (zeroed, so the
+  //wideband frames start out empty)
+  const int               hostSize      = sampleFormatSize( hostFormat );
+  const size_t            bufferSamples = usrp_rx_stream->get_max_num_samps();
+  buffer_arena            arena;
+  if( !openArena( arena, arenaBytes( frameSize*sizeof(uint16_t) ) +
+                         channelCount*( 2*arenaBytes( frameSize*sizeof(float) ) +
+                                        arenaBytes( stepSamples*hostSize ) +
+                                        arenaBytes( bufferSamples*hostSize ) ) ) )
+  {
+    cout << "Cannot reserve the buffer arena" << endl;
+    return 0;
+  }
+
+  //Samples of the current step, in order, per channel (still in hostFormat)
+  char**                  stepBuffer  = new char*[channelCount];
+
+  //Quantized codes of one wideband frame
+  uint16_t*               codes       = reinterpret_cast<uint16_t*>(
+                                        arenaAlloc( arena, frameSize*sizeof(uint16_t) ));
+
+  sweepFrame[0] = new float*[channelCount];
+  sweepFrame[1] = new float*[channelCount];
+  for( size_t c = 0; c < channelCount; c++ )
+  {
+    sweepFrame[0][c]  = reinterpret_cast<float*>(arenaAlloc( arena,
+                                                 frameSize*sizeof(float) ));
+    sweepFrame[1][c]  = reinterpret_cast<float*>(arenaAlloc( arena,
+                                                 frameSize*sizeof(float) ));
+    stepBuffer[c]     = reinterpret_cast<char*>(arenaAlloc( arena,
+                                                stepSamples*hostSize ));
+  }
+
+  int                     step        = 0;
+  int                     filled      = 0;
+  long long               stepStart   = 0;
+  long long               stepEnd     = 0;
+  long long               nextStart   = 0;
+  long long               streamStart = 0;
+  long long               sweepStart[2] = { 0, 0 };
+  bool                    started     = false;
+
+  vector<void*>           usrpBuffers( channelCount );
+  for( size_t c = 0; c < channelCount; c++ )
+    usrpBuffers[c] = arenaAlloc( arena, bufferSamples*hostSize );
+
+  uhd::rx_metadata_t      rx_md;
+  unsigned long long int  samples_recorded = 0;
+  int                     child_tracker    = 0;
+  int                     return_code      = 1;
+  double                  timeout          = firstTimeout;
+
+  ///////////////////////////////////////////////////////////
+  //
+  //Work Section
+  ///////////////////////////////////////////////////////////
+  while( (samples_recorded < maximum_samples) and return_code &&
+         !stopRequested() )
+  {
+    size_t buffer_samples_recorded = usrp_rx_stream->recv( usrpBuffers,
+                                                           bufferSamples,
+                                                           rx_md,
+                                                           timeout );
+    timeout = 0.1;
+    if( startup.firstSample < 0 && buffer_samples_recorded )
+      reportStartup( startup );
+
+    //Check the USRP for errors (including Overflow indication).  Dropped
+    //samples show up as a jump in the time stamps below.
+    if( rx_md.error_code != uhd::rx_metadata_t::ERROR_CODE_NONE )
+    {
+      switch( rx_md.error_code ){
+        case uhd::rx_metadata_t::ERROR_CODE_OVERFLOW:
+          cout << "O";
+          break;
+        case uhd::rx_metadata_t::ERROR_CODE_TIMEOUT:
+          cout << "USRP Timeout" << endl;
+          return_code = 0;
+          break;
+        default:
+          cout << "Unexpected USRP Error: " << rx_md.error_code;
+          return_code = 0;
+      }
+    }
+    if( !buffer_samples_recorded || !rx_md.has_time_spec )
+      continue;
+    samples_recorded += buffer_samples_recorded;
+
+    long long first = rx_md.time_spec.to_ticks( rate );
+    long long last  = first + buffer_samples_recorded;
+
+    if( !started )
+    {
+      //The first step is already tuned, just give it time to settle.  Then
+      //queue the retune for the second step to happen right after it.
+      started   = true;
+      streamStart = first;
+      stepStart = first + settleTicks;
+      sweepStart[current] = stepStart;
+      stepEnd   = stepStart + stepSamples;
+      nextStart = stepEnd;
+      if( steps > 1 )
+        nextStart = tuneStep( usrp, channels, frequencies[1],
+                              max( stepEnd, last + leadTicks ), rate ) + settleTicks;
+    }
+
+    //A buffer can finish any number of (short) steps
+    while( true )
+    {
+      long long from  = max( first, stepStart );
+      long long to    = min( last, stepEnd );
+      if( from < to )
+      {
+        for( size_t c = 0; c < channelCount; c++ )
+          memcpy( stepBuffer[c] + (from - stepStart)*hostSize,
+                  reinterpret_cast<char*>(usrpBuffers[c]) + (from - first)*hostSize,
+                  hostSize * (to - from) );
+        filled += to - from;
+      }
+      if( last < stepEnd )
+        break;
+
+      //The step is complete.  Hand its frames to the workers.
+      if( filled == stepSamples )
+      {
+        for( int k = 0; k < frames; k++ )
+          for( size_t c = 0; c < channelCount; c++ )
+          {
+            //Same flow control as the streaming mode
+            while( fft_child_args[child_tracker].is_running )
+              ;
+
+            convertWindow( hostFormat, stepBuffer[c] + k*interval*hostSize, window2,
+                           reinterpret_cast<float*>(fft_child_args[child_tracker].frameData),
+                           frameLength );
+            fft_child_args[child_tracker].accumulator = sweepFrame[current][c] + step*stepBins;
+            fft_child_args[child_tracker].pending     = &pending[current];
+
+            pthread_mutex_lock( mutex );
+            pending[current]++;
+            pthread_mutex_unlock( mutex );
+
+            fft_child_args[child_tracker].is_running = true;
+            mq_send( fft_mq[child_tracker], &msg_thread_start,
+                     __FFT_THREAD_MSG_LENGTH, __FFT_THREAD_MSG_PRIO );
+            child_tracker = child_tracker == max_children - 1 ? 0 : child_tracker + 1;
+          }
+      }
+      else
+        cout << "Sweep step " << step << " lost" << endl;
+
+      //Move on to the next step.  Its retune is already queued, so queue the
+      //one after it.
+      if( ++step == steps )
+      {
+        //The sweep is complete.  Write out the previous one (its frames
+        //finished long ago) and reuse its frames for the next sweep.
+        step              = 0;
+        complete[current] = true;
+        current           = 1 - current;
+        if( complete[current] )
+        {
+          while( pending[current] )
+            ;
+          if( !writeSweep( sweepFrame[current], outputFile, indexFile, shm,
+                           sweepStart[current] - streamStart,
+                           uhd::time_spec_t::from_ticks( sweepStart[current], rate ),
+                           channelCount, frameSize, frameScale,
+                           fft_child_args[0].format, codes ) )
+            return_code = 0;
+          complete[current] = false;
+        }
+      }
+
+      stepStart = nextStart;
+      stepEnd   = stepStart + stepSamples;
+      filled    = 0;
+      if( step == 0 )
+        sweepStart[current] = stepStart;
+      nextStart = stepEnd;
+      if( steps > 1 )
+        nextStart = tuneStep( usrp, channels, frequencies[ (step + 1) % steps ],
+                              max( stepEnd, last + leadTicks ), rate ) + settleTicks;
+    }
+  }
+
+  ///////////////////////////////////////////////////////////
+  //
+  //Cleanup Section
+  ///////////////////////////////////////////////////////////
+
+  //Let the workers finish both frames, then write the last complete sweep.
+  //The sweep in progress is tossed out.
+  while( pending[0] || pending[1] )
+    ;
+  if( complete[1 - current] &&
+      !writeSweep( sweepFrame[1 - current], outputFile, indexFile, shm,
+                   sweepStart[1 - current] - streamStart,
+                   uhd::time_spec_t::from_ticks( sweepStart[1 - current], rate ),
+                   channelCount, frameSize, frameScale,
+                   fft_child_args[0].format, codes ) )
+    return_code = 0;
+
+  //Hand the workers back to the streaming output
+  for( int i = 0; i < max_children; i++ )
+  {
+    fft_child_args[i].accumulator = NULL;
+    fft_child_args[i].pending     = NULL;
+  }
+
+  delete [] sweepFrame[0];
+  delete [] sweepFrame[1];
+  delete [] stepBuffer;
+  closeArena( arena );
+
+  return return_code;
+}
+
+
+
+
+
+
+
+
+/*******************************************************************************
+
+
+*******************************************************************************/
+long long tuneStep( uhd::usrp::multi_usrp::sptr&  usrp,
+                    const vector<size_t>&         channels,
+                    const double                  frequency,
+                    const long long               tick,
+                    const double                  rate )
+{
+  usrp->set_command_time( uhd::time_spec_t::from_ticks( tick, rate ) );
+  for( size_t c = 0; c < channels.size(); c++ )
+    usrp->set_rx_freq( frequency, channels[c] );
+  usrp->clear_command_time();
+
+  return tick;
+}
+
+
+
+
+
+
+
+
+/*******************************************************************************
+
+
+*******************************************************************************/
+int writeSweep( float**                   sweepFrame,
+                FILE**                    outputFile,
+                FILE**                    indexFile,
+                spectrum_shm*             shm,
+                const unsigned long long  sample,
+                const uhd::time_spec_t&   time,
+                const size_t              channelCount,
+                const int                 frameSize,
+                const float               frameScale,
+                const spectrum_format&    format,
+                void*                     scratch )
+{
+  int       return_code = 1;
+
+  for( size_t c = 0; c < channelCount; c++ )
+  {
+    for( int i = 0; i < frameSize; i++ )
+      sweepFrame[c][i] *= frameScale;
+    if( !writeSpectrum( outputFile[c], sweepFrame[c], frameSize, format,
+                        scratch ) )
+      return_code = 0;
+    //writeSpectrum left the quantized codes in scratch
+    if( shm )
+      publishSpectrum( shm[c], format.bits == 32 ? sweepFrame[c] : scratch );
+    if( !writeFrameTime( indexFile[c], sample, time ) )
+      return_code = 0;
+    for( int i = 0; i < frameSize; i++ )
+      sweepFrame[c][i] = 0.0f;
+  }
+
+  return return_code;
+}